@@ -4,13 +4,16 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
-../TCS34087/TCS34087.c 
+../TCS34087/TCS34087.c \
+../TCS34087/flicker.c 
 
 C_DEPS += \
-./TCS34087/TCS34087.d 
+./TCS34087/TCS34087.d \
+./TCS34087/flicker.d 
 
 OBJS += \
-./TCS34087/TCS34087.o 
+./TCS34087/TCS34087.o \
+./TCS34087/flicker.o 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -25,7 +28,7 @@ TCS34087/%.o: ../TCS34087/%.c TCS34087/subdir.mk
 clean: clean-TCS34087
 
 clean-TCS34087:
-	-$(RM) ./TCS34087/TCS34087.d ./TCS34087/TCS34087.o
+	-$(RM) ./TCS34087/TCS34087.d ./TCS34087/TCS34087.o ./TCS34087/flicker.d ./TCS34087/flicker.o
 
 .PHONY: clean-TCS34087
 
@@ -7,19 +7,25 @@ C_SRCS += \
 ../imu/AK09918.c \
 ../imu/IMU.c \
 ../imu/QMI8658.c \
-../imu/imu_test.c 
+../imu/imu_bias.c \
+../imu/imu_test.c \
+../imu/mag_cal.c 
 
 C_DEPS += \
 ./imu/AK09918.d \
 ./imu/IMU.d \
 ./imu/QMI8658.d \
-./imu/imu_test.d 
+./imu/imu_bias.d \
+./imu/imu_test.d \
+./imu/mag_cal.d 
 
 OBJS += \
 ./imu/AK09918.o \
 ./imu/IMU.o \
 ./imu/QMI8658.o \
-./imu/imu_test.o 
+./imu/imu_bias.o \
+./imu/imu_test.o \
+./imu/mag_cal.o 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -34,7 +40,7 @@ imu/%.o: ../imu/%.c imu/subdir.mk
 clean: clean-imu
 
 clean-imu:
-	-$(RM) ./imu/AK09918.d ./imu/AK09918.o ./imu/IMU.d ./imu/IMU.o ./imu/QMI8658.d ./imu/QMI8658.o ./imu/imu_test.d ./imu/imu_test.o
+	-$(RM) ./imu/AK09918.d ./imu/AK09918.o ./imu/IMU.d ./imu/IMU.o ./imu/QMI8658.d ./imu/QMI8658.o ./imu/imu_bias.d ./imu/imu_bias.o ./imu/imu_test.d ./imu/imu_test.o ./imu/mag_cal.d ./imu/mag_cal.o
 
 .PHONY: clean-imu
 
@@ -7,12 +7,28 @@ C_SRCS += \
 ../src/AD.c \
 ../src/LPS22HB.c \
 ../src/SHTC3.c \
+../src/cal_lut.c \
 ../src/cosmic_watch.c \
+../src/device_supervisor.c \
 ../src/dfrobot_gas.c \
+../src/event_capture.c \
+../src/log_index.c \
+../src/o2_cal.c \
+../src/pressure_trend.c \
+../src/sensor_drivers.c \
+../src/sensor_registry.c \
+../src/sensor_stats.c \
 ../src/sensors.c \
+../src/sensors_cal_file.c \
 ../src/sensors_config.c \
 ../src/sensors_gpio.c \
 ../src/serial_util.c \
+../src/storage_quota.c \
+../src/telem_agg.c \
+../src/telem_archive.c \
+../src/telem_schema.c \
+../src/time_service.c \
+../src/trace.c \
 ../src/ultrasonic_mic.c \
 ../src/xensiv_pasco2.c 
 
@@ -20,12 +36,28 @@ C_DEPS += \
 ./src/AD.d \
 ./src/LPS22HB.d \
 ./src/SHTC3.d \
+./src/cal_lut.d \
 ./src/cosmic_watch.d \
+./src/device_supervisor.d \
 ./src/dfrobot_gas.d \
+./src/event_capture.d \
+./src/log_index.d \
+./src/o2_cal.d \
+./src/pressure_trend.d \
+./src/sensor_drivers.d \
+./src/sensor_registry.d \
+./src/sensor_stats.d \
 ./src/sensors.d \
+./src/sensors_cal_file.d \
 ./src/sensors_config.d \
 ./src/sensors_gpio.d \
 ./src/serial_util.d \
+./src/storage_quota.d \
+./src/telem_agg.d \
+./src/telem_archive.d \
+./src/telem_schema.d \
+./src/time_service.d \
+./src/trace.d \
 ./src/ultrasonic_mic.d \
 ./src/xensiv_pasco2.d 
 
@@ -33,12 +65,28 @@ OBJS += \
 ./src/AD.o \
 ./src/LPS22HB.o \
 ./src/SHTC3.o \
+./src/cal_lut.o \
 ./src/cosmic_watch.o \
+./src/device_supervisor.o \
 ./src/dfrobot_gas.o \
+./src/event_capture.o \
+./src/log_index.o \
+./src/o2_cal.o \
+./src/pressure_trend.o \
+./src/sensor_drivers.o \
+./src/sensor_registry.o \
+./src/sensor_stats.o \
 ./src/sensors.o \
+./src/sensors_cal_file.o \
 ./src/sensors_config.o \
 ./src/sensors_gpio.o \
 ./src/serial_util.o \
+./src/storage_quota.o \
+./src/telem_agg.o \
+./src/telem_archive.o \
+./src/telem_schema.o \
+./src/time_service.o \
+./src/trace.o \
 ./src/ultrasonic_mic.o \
 ./src/xensiv_pasco2.o 
 
@@ -55,7 +103,7 @@ src/%.o: ../src/%.c src/subdir.mk
 clean: clean-src
 
 clean-src:
-	-$(RM) ./src/AD.d ./src/AD.o ./src/LPS22HB.d ./src/LPS22HB.o ./src/SHTC3.d ./src/SHTC3.o ./src/cosmic_watch.d ./src/cosmic_watch.o ./src/dfrobot_gas.d ./src/dfrobot_gas.o ./src/sensors.d ./src/sensors.o ./src/sensors_config.d ./src/sensors_config.o ./src/sensors_gpio.d ./src/sensors_gpio.o ./src/serial_util.d ./src/serial_util.o ./src/ultrasonic_mic.d ./src/ultrasonic_mic.o ./src/xensiv_pasco2.d ./src/xensiv_pasco2.o
+	-$(RM) ./src/AD.d ./src/AD.o ./src/LPS22HB.d ./src/LPS22HB.o ./src/SHTC3.d ./src/SHTC3.o ./src/cal_lut.d ./src/cal_lut.o ./src/cosmic_watch.d ./src/cosmic_watch.o ./src/device_supervisor.d ./src/device_supervisor.o ./src/dfrobot_gas.d ./src/dfrobot_gas.o ./src/event_capture.d ./src/event_capture.o ./src/log_index.d ./src/log_index.o ./src/o2_cal.d ./src/o2_cal.o ./src/pressure_trend.d ./src/pressure_trend.o ./src/sensor_drivers.d ./src/sensor_drivers.o ./src/sensor_registry.d ./src/sensor_registry.o ./src/sensor_stats.d ./src/sensor_stats.o ./src/sensors.d ./src/sensors.o ./src/sensors_cal_file.d ./src/sensors_cal_file.o ./src/sensors_config.d ./src/sensors_config.o ./src/sensors_gpio.d ./src/sensors_gpio.o ./src/serial_util.d ./src/serial_util.o ./src/storage_quota.d ./src/storage_quota.o ./src/telem_agg.d ./src/telem_agg.o ./src/telem_archive.d ./src/telem_archive.o ./src/telem_schema.d ./src/telem_schema.o ./src/time_service.d ./src/time_service.o ./src/trace.d ./src/trace.o ./src/ultrasonic_mic.d ./src/ultrasonic_mic.o ./src/xensiv_pasco2.d ./src/xensiv_pasco2.o
 
 .PHONY: clean-src
 
@@ -29,14 +29,24 @@
 # THE SOFTWARE.
 #
 ******************************************************************************/
+#define _GNU_SOURCE /* For PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP */
+#include <pthread.h>
 #include "TCS34087.h"
+#include "sensor_stats.h"
 
 TCS34087_ASTEP_Time_t IntegrationTime_t = TCS34725_INTEGRATIONTIME_2_78MS;
 TCS34087Gain_t  Gain_t = TCS34087_GAIN_64X;
 uint8_t Atime = 0;
+uint16_t Astep = 999;
 RGB_Offset rgb_offset;
 int tcs_fd;
 
+/* The flicker thread drains the FIFO while the main loop reads the ALS and changes the
+   gain.  Each register access holds this, and so does each sequence of accesses that must
+   not be split, such as a read-modify-write of ENABLE.  It is recursive so a sequence can
+   call the single register functions */
+static pthread_mutex_t tcs_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
 /******************************************************************************
 function:   Write a byte to TCS34087
 parameter	:
@@ -49,7 +59,9 @@ static void TCS34087_WriteByte(uint8_t add, uint8_t data)
     //Responsible for not finding the register, 
     //refer to the data sheet Command Register CMD(Bit 7)
 //    DEV_I2C_WriteByte(add, data);
-    lgI2cWriteByteData(tcs_fd, add, data);
+    pthread_mutex_lock(&tcs_mutex);
+    stats_i2c(STATS_I2C_TCS34087, lgI2cWriteByteData(tcs_fd, add, data));
+    pthread_mutex_unlock(&tcs_mutex);
 }
 
 /******************************************************************************
@@ -59,7 +71,10 @@ parameter	:
 ******************************************************************************/
 static uint8_t TCS34087_ReadByte(uint8_t add)
 {
-    return lgI2cReadByteData(tcs_fd, add);
+    pthread_mutex_lock(&tcs_mutex);
+    uint8_t data = stats_i2c(STATS_I2C_TCS34087, lgI2cReadByteData(tcs_fd, add));
+    pthread_mutex_unlock(&tcs_mutex);
+    return data;
 }
 /******************************************************************************
 function:   Wirt a word to TCS34087
@@ -69,7 +84,9 @@ parameter	:
 ******************************************************************************/
 static void TCS34087_WirtWord(uint8_t add, uint16_t data)
 {
-    lgI2cWriteWordData(tcs_fd, add, data);
+    pthread_mutex_lock(&tcs_mutex);
+    stats_i2c(STATS_I2C_TCS34087, lgI2cWriteWordData(tcs_fd, add, data));
+    pthread_mutex_unlock(&tcs_mutex);
 }
 /******************************************************************************
 function:   Read a word to TCS34087
@@ -79,7 +96,26 @@ parameter	:
 ******************************************************************************/
 static uint16_t TCS34087_ReadWord(uint8_t add)
 {
-	return lgI2cReadWordData(tcs_fd, add);
+	pthread_mutex_lock(&tcs_mutex);
+	uint16_t data = stats_i2c(STATS_I2C_TCS34087, lgI2cReadWordData(tcs_fd, add));
+	pthread_mutex_unlock(&tcs_mutex);
+	return data;
+}
+
+/******************************************************************************
+function:   Read a block of consecutive registers from TCS34087
+parameter	:
+        add : First register address
+        buf : Buffer for the data
+        len : Number of bytes
+return      : 0 if all the bytes were read
+******************************************************************************/
+static uint8_t TCS34087_ReadBlock(uint8_t add, uint8_t *buf, uint8_t len)
+{
+	pthread_mutex_lock(&tcs_mutex);
+	int rc = stats_i2c(STATS_I2C_TCS34087, lgI2cReadI2CBlockData(tcs_fd, add, (char *)buf, len));
+	pthread_mutex_unlock(&tcs_mutex);
+	return (rc == len) ? 0 : 1;
 }
 
 /******************************************************************************
@@ -91,7 +127,20 @@ static void TCS34087_Enable(void)
     // TCS34087_WriteByte(TCS34087_ENABLE, TCS34087_ENABLE_PON);
     // DEV_Delay_ms(3);
     TCS34087_WriteByte(TCS34087_ENABLE,TCS34087_ENABLE_FDEN | TCS34087_ENABLE_PON | TCS34087_ENABLE_AEN);
-    lguSleep(3 / 1000);
+    lguSleep(0.003);
+}
+
+/******************************************************************************
+function:   
+        Restart the ALS so the next valid result uses the current gain and
+        integration time.  AEN must be cleared while they are changed.
+******************************************************************************/
+static void TCS34087_Restart(void)
+{
+    pthread_mutex_lock(&tcs_mutex);
+    TCS34087_WriteByte(TCS34087_ENABLE, TCS34087_ENABLE_FDEN | TCS34087_ENABLE_PON);
+    TCS34087_WriteByte(TCS34087_ENABLE, TCS34087_ENABLE_FDEN | TCS34087_ENABLE_PON | TCS34087_ENABLE_AEN);
+    pthread_mutex_unlock(&tcs_mutex);
 }
 
 /******************************************************************************
@@ -102,8 +151,10 @@ void TCS34087_Disable(void)
 {
     /* Turn the device off to save power */
     uint8_t reg = 0;
+    pthread_mutex_lock(&tcs_mutex);
     reg = TCS34087_ReadByte(TCS34087_ENABLE);
     TCS34087_WriteByte(TCS34087_ENABLE, reg & ~(TCS34087_ENABLE_FDEN | TCS34087_ENABLE_PON | TCS34087_ENABLE_AEN));
+    pthread_mutex_unlock(&tcs_mutex);
 }
 
 /******************************************************************************
@@ -111,16 +162,72 @@ function:   TCS34087 Set Integration Time
 parameter	:
         Atime: Sets the number of ALS/color integration steps from 1 to 256.
         time: Integration Time Reference "TCS34087.h" Enumeration Type
+info:       The integration time is (ATIME + 1) x (ASTEP + 1) x 2.78us.  The
+            step size is the 16 bit ASTEP register at 0xCA/0xCB.
 ******************************************************************************/
 void TCS34087_Set_Integration_Time(uint8_t atime,TCS34087_ASTEP_Time_t time)
 {
+    switch (time) {
+        case TCS34725_INTEGRATIONTIME_2_78US:
+            Astep = 0;
+            break;
+        case TCS34725_INTEGRATIONTIME_nMS: // Keep the step size already set
+            break;
+        case TCS34725_INTEGRATIONTIME_1_67MS:
+            Astep = 599;
+            break;
+        case TCS34725_INTEGRATIONTIME_2_78MS:
+            Astep = 999;
+            break;
+        case TCS34725_INTEGRATIONTIME_50MS:
+            Astep = 17999;
+            break;
+        case TCS34725_INTEGRATIONTIME_182MS:
+            Astep = 65534; // 65535 is reserved
+            break;
+    }
+    pthread_mutex_lock(&tcs_mutex);
     TCS34087_WriteByte(TCS34087_ATIME,atime);
     /* Update the timing register */
-    TCS34087_WirtWord(TCS34087_ASTEP, (0xE7<<8)|time);
+    TCS34087_WirtWord(TCS34087_ASTEPL, Astep);
+    pthread_mutex_unlock(&tcs_mutex);
     Atime = atime;
     IntegrationTime_t = time;
 }
 
+/******************************************************************************
+function:   Integration time of the current settings in ms
+******************************************************************************/
+float TCS34087_Get_Integration_Time_ms(void)
+{
+    return (Atime + 1) * (Astep + 1) * TCS34087_ASTEP_US / 1000.0f;
+}
+
+/******************************************************************************
+function:   Maximum count of the current settings.  Short integrations can not
+            reach the 16 bit limit
+******************************************************************************/
+uint16_t TCS34087_Get_Full_Scale(void)
+{
+    uint32_t fs = (uint32_t)(Atime + 1) * (Astep + 1);
+    return (fs > 65535) ? 65535 : fs;
+}
+
+TCS34087Gain_t TCS34087_Get_Gain(void)
+{
+    return Gain_t;
+}
+
+/******************************************************************************
+function:   Gain multiplier for a CFG1 AGAIN value.  0 is 0.5x then each step
+            doubles the gain
+******************************************************************************/
+float TCS34087_Get_Gain_Value(uint8_t again)
+{
+    if (again == 0) return 0.5f;
+    return (float)(1 << (again - 1));
+}
+
 /******************************************************************************
 function:   TCS34087 Set gain
 parameter	:
@@ -159,8 +266,10 @@ function:   Interrupt Disable
 void TCS34087_Interrupt_Disable()
 {
     uint8_t data = 0;
+    pthread_mutex_lock(&tcs_mutex);
     data = TCS34087_ReadByte(TCS34087_INTENAB);
     TCS34087_WriteByte(TCS34087_INTENAB, data & (~TCS34087_INTENAB_ASIEN | TCS34087_INTENAB_AIEN | TCS34087_INTENAB_SIEN));
+    pthread_mutex_unlock(&tcs_mutex);
 }
 
 #ifdef USE_TCS_INTERRUPT
@@ -218,7 +327,10 @@ void RGB_offset(uint8_t Lum)
 }
 
 uint8_t  TCS34087_Close(void) {
-	return lgI2cClose(tcs_fd);
+	pthread_mutex_lock(&tcs_mutex);
+	uint8_t rc = lgI2cClose(tcs_fd);
+	pthread_mutex_unlock(&tcs_mutex);
+	return rc;
 }
 
 /******************************************************************************
@@ -230,9 +342,11 @@ parameter	:
 uint8_t  TCS34087_Init(TCS34087Gain_t gain)
 {
 	uint8_t ID = 0;
+    pthread_mutex_lock(&tcs_mutex);
     tcs_fd = lgI2cOpen(1,TCS34087_ADDRESS,0);
 	ID = TCS34087_ReadByte(TCS34087_ID);
     if(ID != 0x18){
+        pthread_mutex_unlock(&tcs_mutex);
         return 1;
     }
     //Set the integration time and gain
@@ -248,9 +362,62 @@ uint8_t  TCS34087_Init(TCS34087Gain_t gain)
     TCS34087_Set_Interrupt_Persistence_Reg(TCS34087_PERS_2_CYCLE);
 */
     RGB_offset(LUM_1);
+    pthread_mutex_unlock(&tcs_mutex);
 	return 0;
 }
 
+/******************************************************************************
+function:   Wait for a complete integration.  This polls AVALID in STATUS2 rather
+            than sleeping a fixed time, so we wait exactly as long as the
+            integration takes.  Returns 0 when valid, 1 on timeout
+******************************************************************************/
+static uint8_t TCS34087_Wait_Valid(void)
+{
+    float t_int = TCS34087_Get_Integration_Time_ms() / 1000.0f;
+    float poll = t_int / 8;
+    if (poll < 0.001f) poll = 0.001f;
+    float waited = 0;
+    while (waited < 2 * t_int + TCS34087_VALID_TIMEOUT_S) {
+        if (TCS34087_ReadByte(TCS34087_STATUS2) & TCS34087_AVALID)
+            return 0;
+        lguSleep(poll);
+        waited += poll;
+    }
+    return 1;
+}
+
+/******************************************************************************
+function:   Read the channels once a result is valid.  ASTATUS, the six channels
+            and STATUS2 are read in one transaction.  Reading ASTATUS first
+            latches the ADATA registers, so all the channels come from the same
+            integration.  Returns TCS34087_READ_OK, TCS34087_READ_SATURATED or
+            TCS34087_READ_TIMEOUT
+******************************************************************************/
+static uint8_t TCS34087_Read_Channels(RGB *rgb)
+{
+    uint8_t buf[TCS34087_BLOCK_LEN];
+    if (TCS34087_Wait_Valid() != 0)
+        return TCS34087_READ_TIMEOUT;
+    if (TCS34087_ReadBlock(TCS34087_ASTATUS, buf, TCS34087_BLOCK_LEN) != 0)
+        return TCS34087_READ_TIMEOUT;
+    uint8_t astatus = buf[0];
+    uint8_t status2 = buf[TCS34087_STATUS2 - TCS34087_ASTATUS];
+    uint8_t *adata = &buf[TCS34087_ADATA0L - TCS34087_ASTATUS];
+    rgb->C = adata[0] | (adata[1] << 8);
+    rgb->R = adata[2] | (adata[3] << 8);
+    rgb->G = adata[4] | (adata[5] << 8);
+    rgb->B = adata[6] | (adata[7] << 8);
+    rgb->W = adata[8] | (adata[9] << 8);
+    rgb->F = adata[10] | (adata[11] << 8);
+    // printf("C: %d  R: %d G: %d B: %d W: %d F: %d ASTATUS: %x STATUS2: %x\r\n\n",rgb->C,rgb->R,rgb->G,rgb->B,rgb->W,rgb->F,astatus,status2);
+    if (!(status2 & TCS34087_AVALID))
+        return TCS34087_READ_TIMEOUT;
+    if ((astatus & TCS34087_ASTATUS_ASAT_STATUS) || (status2 & (TCS34087_ASAT_DIGITAL | TCS34087_ASAT_ANALOG))
+            || rgb->C >= TCS34087_Get_Full_Scale())
+        return TCS34087_READ_SATURATED;
+    return TCS34087_READ_OK;
+}
+
 /******************************************************************************
 function:   TCS34087 Read RGBC data
 parameter	:
@@ -258,46 +425,120 @@ parameter	:
 ******************************************************************************/
 RGB TCS34087_Get_RGBData()
 {
-    RGB temp;
-    //tcs_fd = lgI2cOpen(1,TCS34087_ADDRESS,0);
-    temp.C = TCS34087_ReadWord(TCS34087_ADATA0L);
-    temp.R = TCS34087_ReadWord(TCS34087_ADATA1L);
-    temp.G = TCS34087_ReadWord(TCS34087_ADATA2L);
-    temp.B = TCS34087_ReadWord(TCS34087_ADATA3L);
-    temp.W = TCS34087_ReadWord(TCS34087_ADATA4L);
-    temp.F = TCS34087_ReadWord(TCS34087_ADATA5L);
-    // printf("C: %d  R: %d G: %d B: %d W: %d F: %d ASTATUS: %x\r\n\n",temp.C,temp.R,temp.G,temp.B,temp.W,temp.F,TCS34087_ReadByte(0x94));
-    //lgI2cClose(tcs_fd);
-    
-    switch (IntegrationTime_t){
-        case TCS34725_INTEGRATIONTIME_2_78US:
-              break;
-        case TCS34725_INTEGRATIONTIME_nMS:
-        	lguSleep((0.00278*(Atime + 1))/1000);
-              break;
-        case TCS34725_INTEGRATIONTIME_1_67MS:
-        	lguSleep(2/1000);
-              break;
-        case TCS34725_INTEGRATIONTIME_2_78MS:
-        	lguSleep(3/1000);
-              break;
-        case TCS34725_INTEGRATIONTIME_50MS:
-        	lguSleep(50/1000);
-              break;
-        case TCS34725_INTEGRATIONTIME_182MS:
-        	lguSleep(182/1000);
-              break;
-    }
-    if (temp.C == 65535)
+    RGB temp = {0};
+    uint8_t rc = TCS34087_Read_Channels(&temp);
+    if (rc != TCS34087_READ_OK)
     {
-        printf("\r\nInvalid data\r\n");
         temp.R = 0;
         temp.G = 0;
         temp.B = 0;
-        return temp;
     }
-    else
-        return temp;
+    return temp;
+}
+
+/******************************************************************************
+function:   Adjust gain and integration time so the clear channel sits in the
+            middle of the range.  Gain is changed first because it does not
+            change the measurement time.  Only at the ends of the gain range is
+            ATIME changed.  Returns 1 if the settings were changed.
+parameter	:
+     C         : Clear channel count from the last integration
+     saturated : the last integration saturated, so C is not a measure of
+                 the light level
+******************************************************************************/
+static uint8_t TCS34087_AGC_Update(uint16_t C, uint8_t saturated)
+{
+    float fs = TCS34087_Get_Full_Scale();
+    float factor;
+
+    if (saturated) {
+        factor = TCS34087_AGC_SATURATED_STEP;
+    } else {
+        float level = C / fs;
+        if (level >= TCS34087_AGC_LOW && level <= TCS34087_AGC_HIGH)
+            return 0;
+        if (C < 1) C = 1;
+        factor = TCS34087_AGC_TARGET * fs / C;
+    }
+
+    /* Exposure is gain x integration steps.  Find the settings closest to the exposure we want */
+    float exposure = TCS34087_Get_Gain_Value(Gain_t) * (Atime + 1) * factor;
+    int again = TCS34087_AGAIN_MAX;
+    while (again > TCS34087_AGAIN_MIN && TCS34087_Get_Gain_Value(again) * (TCS34087_AGC_ATIME + 1) > exposure)
+        again--;
+    int atime = (int)(exposure / TCS34087_Get_Gain_Value(again)) - 1;
+    if (atime > TCS34087_AGC_ATIME && again < TCS34087_AGAIN_MAX) atime = TCS34087_AGC_ATIME;
+    if (atime < TCS34087_AGC_ATIME_MIN) atime = TCS34087_AGC_ATIME_MIN;
+    if (atime > TCS34087_AGC_ATIME_MAX) atime = TCS34087_AGC_ATIME_MAX;
+
+    if (again == Gain_t && atime == Atime)
+        return 0; // Already at the limit
+    pthread_mutex_lock(&tcs_mutex);
+    TCS34087_WriteByte(TCS34087_ENABLE, TCS34087_ENABLE_FDEN | TCS34087_ENABLE_PON);
+    TCS34087_Set_Gain(again);
+    TCS34087_WriteByte(TCS34087_ATIME, atime);
+    Atime = atime;
+    TCS34087_Restart();
+    pthread_mutex_unlock(&tcs_mutex);
+    return 1;
+}
+
+/******************************************************************************
+function:   Read the RGBC data with automatic gain control.  If the light level
+            has moved out of range the gain and integration time are adjusted
+            and the measurement is repeated, so we return an in range reading
+            whenever the light level allows it.  The last step is always a
+            read, so the reading returned was taken at the current settings.
+parameter	:
+     rgb : RGBC values in counts at the settings returned by
+           TCS34087_Get_Gain_Value(Gain_t) and TCS34087_Get_Integration_Time_ms()
+return      : TCS34087_READ_OK, TCS34087_READ_SATURATED or TCS34087_READ_TIMEOUT
+******************************************************************************/
+uint8_t TCS34087_Read(RGB *rgb)
+{
+    uint8_t rc = TCS34087_Read_Channels(rgb);
+    for (int i = 1; i < TCS34087_AGC_MAX_TRIES && rc != TCS34087_READ_TIMEOUT; i++) {
+        if (!TCS34087_AGC_Update(rgb->C, rc == TCS34087_READ_SATURATED))
+            break;
+        rc = TCS34087_Read_Channels(rgb);
+    }
+    return rc;
+}
+
+/******************************************************************************
+function:   True if the gain and integration time are the least the AGC can set,
+            so a saturated reading can not be brought back into range
+******************************************************************************/
+uint8_t TCS34087_At_Min_Exposure(void)
+{
+    return Gain_t == TCS34087_AGAIN_MIN && Atime == TCS34087_AGC_ATIME_MIN;
+}
+
+/******************************************************************************
+function:   Convert a count to basic counts, which is counts per unit gain per ms.
+            This does not depend on the gain or integration time.
+******************************************************************************/
+float TCS34087_Get_Basic_Counts(uint16_t count)
+{
+    return count / (TCS34087_Get_Gain_Value(Gain_t) * TCS34087_Get_Integration_Time_ms());
+}
+
+/******************************************************************************
+function:   Scale the counts to what they would be at the reference gain and
+            integration time set by TCS34087_Init(), so RGB888 does not change
+            when the AGC changes the gain
+******************************************************************************/
+RGB TCS34087_Normalize(RGB rgb)
+{
+    float ref = TCS34087_Get_Gain_Value(TCS34087_REF_GAIN)
+            * (TCS34087_AGC_ATIME + 1) * (TCS34087_REF_ASTEP + 1) * TCS34087_ASTEP_US / 1000.0f;
+    float k = ref / (TCS34087_Get_Gain_Value(Gain_t) * TCS34087_Get_Integration_Time_ms());
+    uint16_t *ch[6] = {&rgb.R, &rgb.G, &rgb.B, &rgb.C, &rgb.W, &rgb.F};
+    for (int i = 0; i < 6; i++) {
+        float v = *ch[i] * k;
+        *ch[i] = (v > 65535) ? 65535 : (uint16_t)v;
+    }
+    return rgb;
 }
 /******************************************************************************
 function:   Clear interrupt flag
@@ -350,55 +591,87 @@ uint16_t TCS34087_Get_Lux(RGB rgb)
     uint16_t ir=1;
     uint16_t r_comp,g_comp,b_comp;
     
-    atime_ms = ((256 - IntegrationTime_t) * 2.4);
+    atime_ms = TCS34087_Get_Integration_Time_ms();
     ir = (rgb.R + rgb.G + rgb.B > rgb.C) ? (rgb.R + rgb.G + rgb.B - rgb.C) / 2 : 0;
     r_comp = rgb.R - ir;
     g_comp = rgb.G - ir;
     b_comp = rgb.B - ir;
     
-    switch (Gain_t)
-    {
-        case TCS34087_GAIN_0_5X:
-              Gain_temp = 0.5;
-              break;
-        case TCS34087_GAIN_1X:
-              Gain_temp = 1;
-              break;
-        case TCS34087_GAIN_4X:
-              Gain_temp = 4;
-              break;
-        case TCS34087_GAIN_8X:
-              Gain_temp = 8;
-              break;
-        case TCS34087_GAIN_16X:
-              Gain_temp = 16;
-              break;
-        case TCS34087_GAIN_64X:
-              Gain_temp = 64;
-              break;
-        case TCS34087_GAIN_128X:
-              Gain_temp = 128;
-              break;
-        case TCS34087_GAIN_256X:
-              Gain_temp = 256;
-              break;
-        case TCS34087_GAIN_512X:
-              Gain_temp = 512;
-              break;
-        case TCS34087_GAIN_1024X:
-              Gain_temp = 1024;
-              break;
-        case TCS34087_GAIN_2048X:
-              Gain_temp = 2048;
-              break;
-    } 
+    Gain_temp = TCS34087_Get_Gain_Value(Gain_t);
     cpl = (atime_ms * Gain_temp) / (TCS34087_GA * TCS34087_DF);
 
     lux = (TCS34087_R_Coef * (float)(r_comp) + TCS34087_G_Coef * \
             (float)(g_comp) +  TCS34087_B_Coef * (float)(b_comp)) / cpl;
+    if (lux < 0) lux = 0;
+    if (lux > 65535) lux = 65535;
     return (uint16_t)lux;
 }
 
+/******************************************************************************
+function:   Send the raw flicker detection samples to the FIFO.  The ALS keeps
+            running, only the flicker channel is written to the FIFO.
+parameter	:
+     fd_time : Sample period is (fd_time + 1) x 1.389us, 11 bits
+     gain    : Flicker gain, same values as the ALS gain
+******************************************************************************/
+void TCS34087_Flicker_Enable(uint16_t fd_time, TCS34087Gain_t gain)
+{
+    pthread_mutex_lock(&tcs_mutex);
+    TCS34087_WriteByte(TCS34087_ENABLE, TCS34087_ENABLE_PON);
+    TCS34087_WriteByte(TCS34087_FD_CFG1, fd_time & 0xFF);
+    TCS34087_WriteByte(TCS34087_FD_CFG3, (gain << 3) | ((fd_time >> 8) & 0x07));
+    TCS34087_WriteByte(TCS34087_FIFO_MAP, 0x00);
+    TCS34087_WriteByte(TCS34087_FD_CFG0, TCS34087_FD_CFG0_FIFO_WRITE_FD);
+    TCS34087_WriteByte(TCS34087_CONTROL, TCS34087_CONTROL_FIFO_CLR);
+    TCS34087_WriteByte(TCS34087_ENABLE, TCS34087_ENABLE_FDEN | TCS34087_ENABLE_PON | TCS34087_ENABLE_AEN);
+    pthread_mutex_unlock(&tcs_mutex);
+}
+
+/******************************************************************************
+function:   Drain the flicker samples from the FIFO with burst reads
+parameter	:
+     samples  : Buffer for the samples
+     max      : Size of the buffer
+     overflow : set if the FIFO was full, so samples have been lost.  The FIFO
+                is cleared so the caller can start a new frame
+return      : Number of samples read or -1 on an I2C error
+******************************************************************************/
+int TCS34087_Read_FIFO(uint16_t *samples, int max, int *overflow)
+{
+    uint8_t buf[TCS34087_FIFO_READ_LEN];
+    pthread_mutex_lock(&tcs_mutex);
+    int level = stats_i2c(STATS_I2C_TCS34087, lgI2cReadByteData(tcs_fd, TCS34087_FIFO_STATUS));
+    if (level < 0) {
+        pthread_mutex_unlock(&tcs_mutex);
+        return -1;
+    }
+    *overflow = (level >= TCS34087_FIFO_SIZE);
+    if (*overflow) {
+        TCS34087_WriteByte(TCS34087_CONTROL, TCS34087_CONTROL_FIFO_CLR);
+        pthread_mutex_unlock(&tcs_mutex);
+        return 0;
+    }
+    if (level > max) level = max;
+    int n = 0;
+    while (n < level) {
+        int len = (level - n) * 2;
+        if (len > TCS34087_FIFO_READ_LEN) len = TCS34087_FIFO_READ_LEN;
+        if (TCS34087_ReadBlock(TCS34087_FDATAL, buf, len) != 0) {
+            n = -1;
+            break;
+        }
+        for (int i = 0; i < len; i += 2)
+            samples[n++] = buf[i] | (buf[i+1] << 8);
+    }
+    pthread_mutex_unlock(&tcs_mutex);
+    return n;
+}
+
+uint8_t TCS34087_Get_FD_Status(void)
+{
+    return TCS34087_ReadByte(TCS34087_FD_STATUS);
+}
+
 /******************************************************************************
 function:   Convert raw RGB values to RGB888 format
 parameter	:
@@ -107,6 +107,7 @@
 #define TCS34087_ADATA5H          0xA0
 
 #define TCS34087_STATUS2          0xA3    /* Device status two */
+#define TCS34087_BLOCK_LEN        (TCS34087_STATUS2 - TCS34087_ASTATUS + 1) /* ASTATUS to STATUS2 in one read */
 #define TCS34087_AVALID           0x40    /* ALS Valid */
 #define TCS34087_ASAT_DIGITAL     0x10    /* ALS Digital Saturation */
 #define TCS34087_ASAT_ANALOG      0x80    /* ALS Analog Saturation */
@@ -179,6 +180,12 @@ Value = 0x00~0x0C Value = 0x00 GAIN = 0.5x GAIN = 2^(Value-1)*/
 #define TCS34087_AZ_CONFIG        0xD6    /* Autozero configuration */ 
 #define TCS34087_AZ_CONFIG_AZ_NTH_ITERATION 0xFF /* ALS Autozero Frequency */
 
+#define TCS34087_FD_CFG0          0xD7    /* Flicker detection configuration zero */
+#define TCS34087_FD_CFG0_FIFO_WRITE_FD 0x80 /* Write flicker detection samples to the FIFO */
+#define TCS34087_FD_CFG1          0xD8    /* Flicker detection time, lower 8 bits */
+#define TCS34087_FD_CFG3          0xDA    /* Flicker detection gain bits 7:3, time upper 3 bits 2:0 */
+#define TCS34087_FD_STEP_US       1.388889 /* Flicker sample period is (FD_TIME + 1) x this */
+
 #define TCS34087_FD_STATUS        0xDB    /* Flicker detection configuration zero */
 #define TCS34087_FD_STATUS_FD_MEASUREMENT_VALID   0x20  /* Flicker Detection Measurement Valid */
 #define TCS34087_FD_STATUS_FD_SATURATION_DETECTED 0x10  /* Flicker Saturation Detected */
@@ -195,8 +202,16 @@ Value = 0x00~0x0C Value = 0x00 GAIN = 0.5x GAIN = 2^(Value-1)*/
 
 #define TCS34087_CONTROL          0xFA    /* Control */
 #define TCS34087_CONTROL_ALS_MANUAL_AZ     0x04 /* ALS Manual Autozero */
+#define TCS34087_CONTROL_FIFO_CLR          0x02 /* Clear the FIFO */
 #define TCS34087_CONTROL_CLEAR_SAI_ACTIVE  0x01 /* Clear Sleep-After-Interrupt Active */
 
+#define TCS34087_FIFO_MAP         0xFC    /* ALS channels written to the FIFO */
+#define TCS34087_FIFO_STATUS      0xFD    /* FIFO level in 16 bit samples */
+#define TCS34087_FDATAL           0xFE    /* FIFO data, a burst read pops consecutive samples */
+#define TCS34087_FDATAH           0xFF
+#define TCS34087_FIFO_SIZE        128     /* Samples the FIFO holds */
+#define TCS34087_FIFO_READ_LEN    32      /* Largest I2C block read in bytes */
+
 
 /**
 * Offset and Compensated
@@ -245,9 +260,11 @@ typedef enum
 {
   TCS34087_GAIN_0_5X              = 0x00,   /**<  0.5x gain  */
   TCS34087_GAIN_1X                = 0x01,   /**<  No gain  */
+  TCS34087_GAIN_2X                = 0x02,   /**<  2x gain  */
   TCS34087_GAIN_4X                = 0x03,   /**<  4x gain  */
   TCS34087_GAIN_8X                = 0x04,   /**<  8x gain  */
   TCS34087_GAIN_16X               = 0x05,   /**<  16x gain */
+  TCS34087_GAIN_32X               = 0x06,   /**<  32x gain */
   TCS34087_GAIN_64X               = 0x07,   /**<  64x gain */
   TCS34087_GAIN_128X              = 0x08,   /**<  128x gain */
   TCS34087_GAIN_256X              = 0x09,   /**<  256x gain */
@@ -257,6 +274,30 @@ typedef enum
 }
 TCS34087Gain_t;
 
+/**
+* Automatic gain control
+**/
+#define TCS34087_ASTEP_US          2.78    /* Integration step in us */
+#define TCS34087_VALID_TIMEOUT_S   0.02    /* Allowed on top of 2 x the integration time */
+#define TCS34087_AGAIN_MIN         TCS34087_GAIN_0_5X
+#define TCS34087_AGAIN_MAX         TCS34087_GAIN_2048X
+#define TCS34087_AGC_ATIME         TCS34087_ATIME_Time41 /* Normal ATIME, only changed at the ends of the gain range */
+#define TCS34087_AGC_ATIME_MIN     0x00
+#define TCS34087_AGC_ATIME_MAX     0xFF
+#define TCS34087_AGC_LOW           0.10    /* Clear channel fraction of full scale we keep between */
+#define TCS34087_AGC_HIGH          0.80
+#define TCS34087_AGC_TARGET        0.40    /* Fraction of full scale we aim for when out of range */
+#define TCS34087_AGC_SATURATED_STEP 0.125  /* Exposure change when saturated, the level is unknown */
+#define TCS34087_AGC_MAX_TRIES     4       /* Measurements before we return what we have */
+#define TCS34087_REF_GAIN          TCS34087_GAIN_16X /* Settings RGB888 is normalized to */
+#define TCS34087_REF_ASTEP         999
+
+/**
+* Return codes from TCS34087_Read
+**/
+#define TCS34087_READ_OK           0
+#define TCS34087_READ_SATURATED    1
+#define TCS34087_READ_TIMEOUT      2
 
 typedef struct{
    uint16_t R;
@@ -284,6 +325,14 @@ void TCS34087_Set_Integration_Time(uint8_t atime,TCS34087_ASTEP_Time_t time);
 
 //Read Color
 RGB TCS34087_Get_RGBData(void);
+uint8_t TCS34087_Read(RGB *rgb);
+uint8_t TCS34087_At_Min_Exposure(void);
+RGB TCS34087_Normalize(RGB rgb);
+float TCS34087_Get_Basic_Counts(uint16_t count);
+float TCS34087_Get_Gain_Value(uint8_t again);
+TCS34087Gain_t TCS34087_Get_Gain(void);
+float TCS34087_Get_Integration_Time_ms(void);
+uint16_t TCS34087_Get_Full_Scale(void);
 uint16_t TCS34087_Get_ColorTemp(RGB rgb);
 uint16_t TCS34087_GetRGB565(RGB rgb);
 uint32_t TCS34087_GetRGB888(RGB rgb);
@@ -291,5 +340,10 @@ uint32_t TCS34087_GetRGB888(RGB rgb);
 
 //Read Light
 uint16_t TCS34087_Get_Lux(RGB rgb);
+
+//Flicker
+void TCS34087_Flicker_Enable(uint16_t fd_time, TCS34087Gain_t gain);
+int TCS34087_Read_FIFO(uint16_t *samples, int max, int *overflow);
+uint8_t TCS34087_Get_FD_Status(void);
 //uint8_t TCS34087_GetLux_Interrupt();
 #endif
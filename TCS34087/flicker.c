@@ -0,0 +1,167 @@
+/*
+ * flicker.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Flicker measurement from the TCS34087.
+ *
+ * The flicker detection channel is sampled at 1kHz into the FIFO.  A background thread
+ * drains the FIFO in burst reads and collects frames of FLICKER_FRAME_LEN samples.  Each
+ * frame is windowed and passed through a bank of Goertzel filters, one at each DFT bin
+ * up to the Nyquist frequency.  The strongest bin gives the dominant flicker frequency,
+ * refined by interpolating between the neighbouring bins.  This covers 100/120Hz mains
+ * flicker, its harmonics and PWM dimming below 500Hz.
+ *
+ * The filter state is held as separate arrays (structure of arrays) and the inner loop
+ * runs across the filters for one sample.  There is no dependency between filters, so
+ * the compiler can vectorize it when optimization is on.
+ *
+ * The main loop calls flicker_get() once per period.  It returns the frame with the
+ * largest flicker seen since the last call and resets the period.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <lgpio.h>
+
+#include "flicker.h"
+#include "TCS34087.h"
+
+static pthread_mutex_t flicker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int flicker_thread_called = false;
+static flicker_result_t period_result;
+
+/* Goertzel bank, one filter per bin */
+static int bank_ready = false;
+static float coeff[FLICKER_BINS];
+static float s1[FLICKER_BINS];
+static float s2[FLICKER_BINS];
+static float window[FLICKER_FRAME_LEN];
+
+static void flicker_init_bank() {
+	for (int k=0; k < FLICKER_BINS; k++)
+		coeff[k] = 2.0f * cosf(2.0f * M_PI * k / FLICKER_FRAME_LEN);
+	for (int n=0; n < FLICKER_FRAME_LEN; n++)
+		window[n] = 0.5f - 0.5f * cosf(2.0f * M_PI * n / FLICKER_FRAME_LEN); // Hann
+	bank_ready = true;
+}
+
+/**
+ * Analyse one frame of flicker samples.  This does not touch the period result, so it can
+ * be called on a recorded frame.
+ */
+void flicker_analyse(const uint16_t *samples, flicker_result_t *result) {
+	float power[FLICKER_BINS];
+	float mean = 0, min = 65535, max = 0;
+
+	if (!bank_ready) flicker_init_bank();
+	for (int n=0; n < FLICKER_FRAME_LEN; n++) {
+		mean += samples[n];
+		if (samples[n] < min) min = samples[n];
+		if (samples[n] > max) max = samples[n];
+	}
+	mean = mean / FLICKER_FRAME_LEN;
+
+	memset(s1, 0, sizeof(s1));
+	memset(s2, 0, sizeof(s2));
+	for (int n=0; n < FLICKER_FRAME_LEN; n++) {
+		float x = (samples[n] - mean) * window[n];
+		for (int k=0; k < FLICKER_BINS; k++) {
+			float s0 = x + coeff[k] * s1[k] - s2[k];
+			s2[k] = s1[k];
+			s1[k] = s0;
+		}
+	}
+	for (int k=0; k < FLICKER_BINS; k++)
+		power[k] = s1[k] * s1[k] + s2[k] * s2[k] - coeff[k] * s1[k] * s2[k];
+
+	int peak = FLICKER_MIN_BIN;
+	for (int k=FLICKER_MIN_BIN; k < FLICKER_BINS - 1; k++)
+		if (power[k] > power[peak]) peak = k;
+
+	/* Parabolic interpolation of the magnitude around the peak */
+	float a = sqrtf(power[peak-1]), b = sqrtf(power[peak]), c = sqrtf(power[peak+1]);
+	float delta = 0;
+	if (a - 2 * b + c != 0)
+		delta = 0.5f * (a - c) / (a - 2 * b + c);
+
+	/* The Hann window halves the amplitude */
+	float amplitude = 4.0f * b / FLICKER_FRAME_LEN;
+
+	result->mean = mean;
+	result->depth = (max + min > 0) ? (max - min) / (max + min) : 0;
+	result->amplitude = (mean > 0) ? amplitude / mean : 0;
+	if (result->amplitude >= FLICKER_MIN_AMPLITUDE)
+		result->frequency = (peak + delta) * FLICKER_SAMPLE_RATE / FLICKER_FRAME_LEN;
+	else
+		result->frequency = 0;
+	result->saturated = false;
+	result->frames = 1;
+}
+
+/**
+ * Return the strongest flicker seen since the last call and start a new period.  frames
+ * is zero if no frame was completed.
+ */
+void flicker_get(flicker_result_t *result) {
+	pthread_mutex_lock(&flicker_mutex);
+	*result = period_result;
+	memset(&period_result, 0, sizeof(period_result));
+	pthread_mutex_unlock(&flicker_mutex);
+}
+
+static void flicker_add_frame(flicker_result_t *frame) {
+	pthread_mutex_lock(&flicker_mutex);
+	int frames = period_result.frames + 1;
+	int saturated = period_result.saturated || frame->saturated;
+	if (frame->amplitude >= period_result.amplitude)
+		period_result = *frame;
+	period_result.frames = frames;
+	period_result.saturated = saturated;
+	pthread_mutex_unlock(&flicker_mutex);
+}
+
+/**
+ * Background thread that drains the flicker FIFO.  If the FIFO overflows then samples are
+ * missing and the frame is discarded.
+ */
+void *flicker_process(void * arg) {
+	static uint16_t frame[FLICKER_FRAME_LEN];
+	int len = 0;
+	int overflow = false;
+	flicker_result_t result;
+
+	if (flicker_thread_called) {
+		printf("ERROR: Flicker thread already started\n");
+		return NULL;
+	}
+	flicker_thread_called = true;
+	flicker_init_bank();
+	TCS34087_Flicker_Enable(FLICKER_FD_TIME, FLICKER_FD_GAIN);
+	while (flicker_thread_called) {
+		int n = TCS34087_Read_FIFO(&frame[len], FLICKER_FRAME_LEN - len, &overflow);
+		if (n < 0 || overflow) {
+			len = 0;
+		} else {
+			len += n;
+			if (len == FLICKER_FRAME_LEN) {
+				flicker_analyse(frame, &result);
+				result.saturated = (TCS34087_Get_FD_Status() & TCS34087_FD_STATUS_FD_SATURATION_DETECTED) != 0;
+				flicker_add_frame(&result);
+				len = 0;
+			}
+		}
+		lguSleep(FLICKER_DRAIN_PERIOD);
+	}
+	return NULL;
+}
+
+void flicker_exit_process() {
+	flicker_thread_called = false;
+}
@@ -0,0 +1,39 @@
+/*
+ * flicker.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Flicker measurement from the TCS34087 flicker detection FIFO.
+ *
+ */
+
+#ifndef FLICKER_H_
+#define FLICKER_H_
+
+#include "TCS34087.h"
+
+#define FLICKER_FD_TIME 719             /* (719 + 1) x 1.389us = 1ms per sample */
+#define FLICKER_SAMPLE_RATE (1.0e6 / ((FLICKER_FD_TIME + 1) * TCS34087_FD_STEP_US))
+#define FLICKER_FD_GAIN TCS34087_GAIN_16X
+#define FLICKER_FRAME_LEN 512           /* Samples per analysis, 0.5s and about 2Hz resolution */
+#define FLICKER_BINS (FLICKER_FRAME_LEN / 2)
+#define FLICKER_MIN_BIN 3               /* Ignore DC and very slow changes in the light level */
+#define FLICKER_DRAIN_PERIOD 0.05       /* Seconds between FIFO reads.  The FIFO is full after 128ms */
+#define FLICKER_MIN_AMPLITUDE 0.005     /* Fundamental / mean below which we report no flicker */
+
+typedef struct {
+	float frequency;   /* Dominant flicker frequency in Hz, 0 if none */
+	float amplitude;   /* Amplitude of the dominant frequency / mean level */
+	float depth;       /* Modulation depth (max - min) / (max + min) */
+	float mean;        /* Mean flicker channel count */
+	int saturated;     /* The flicker channel saturated during the period */
+	int frames;        /* Frames analysed during the period */
+} flicker_result_t;
+
+void flicker_analyse(const uint16_t *samples, flicker_result_t *result);
+void flicker_get(flicker_result_t *result);
+void *flicker_process(void * arg);
+void flicker_exit_process();
+
+#endif /* FLICKER_H_ */
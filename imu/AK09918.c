@@ -1,28 +1,31 @@
 #include "AK09918.h"
+#include "mag_cal.h"
 #include "debug.h"
+#include "sensor_stats.h"
 
 uint8_t buf[8];
 int AK09918_dev;
 // This is the default calibration value. 
-// If it is not accurate, uncomment line 36 and calibrate it manually once
+// It is only used until the online calibration in mag_cal.c has a fit, which is then saved
+// in the calibration file and loaded at startup
 IMU_ST_SENSOR_DATA gstMagOffset = {-188, 49, 35};
 
 uint16_t AK09918_ReadnByte(uint8_t reg)
 {
-    lgI2cReadI2CBlockData(AK09918_dev,reg,(char *)buf,8);
+    stats_i2c(STATS_I2C_AK09918, lgI2cReadI2CBlockData(AK09918_dev,reg,(char *)buf,8));
     return 0;
 }
 
 uint8_t AK09918_I2C_Write(uint8_t reg, uint8_t Value)
 {
-    lgI2cWriteByteData(AK09918_dev,reg,Value);
+    stats_i2c(STATS_I2C_AK09918, lgI2cWriteByteData(AK09918_dev,reg,Value));
     return 0;
 }
 
 uint8_t AK09918_I2C_ReadByte(uint8_t reg)
 {
     uint8_t value;
-    value = lgI2cReadByteData(AK09918_dev,reg);
+    value = stats_i2c(STATS_I2C_AK09918, lgI2cReadByteData(AK09918_dev,reg));
     return value;
 }
 int AK09918_init(uint8_t mode) {
@@ -35,6 +38,8 @@ int AK09918_init(uint8_t mode) {
         //printf("Success to read\r\n");
         AK09918_I2C_Write(AK09918_CNTL2,mode);
     }
+    short default_offset[3] = {gstMagOffset.s16X, gstMagOffset.s16Y, gstMagOffset.s16Z};
+    mag_cal_init(default_offset);
     return 1;
     // AK09918_MagnOffset();
 }
@@ -46,6 +51,7 @@ void AK09918_close() {
 uint8_t AK09918_Read_data(IMU_ST_SENSOR_DATA *pstMagnRawData)
 {
     int16_t s16Buf[3] = {0};
+    int16_t s16Cal[3];
 
     AK09918_ReadnByte(AK09918_HXL);
     s16Buf[0] = ((short int)buf[1] << 8) | buf[0];
@@ -55,12 +61,14 @@ uint8_t AK09918_Read_data(IMU_ST_SENSOR_DATA *pstMagnRawData)
     {
         printf("Sensor overflow\n");
         // return AK09918_ERR_OVERFLOW;
+    } else {
+        mag_cal_update(s16Buf); // Overflowed readings are not on the ellipsoid, so only fit good ones
     }
-        
 
-    pstMagnRawData->s16X = s16Buf[0] - gstMagOffset.s16X;
-    pstMagnRawData->s16Y = s16Buf[1] - gstMagOffset.s16Y;
-    pstMagnRawData->s16Z = s16Buf[2] - gstMagOffset.s16Z;
+    mag_cal_apply(s16Buf, s16Cal);
+    pstMagnRawData->s16X = s16Cal[0];
+    pstMagnRawData->s16Y = s16Cal[1];
+    pstMagnRawData->s16Z = s16Cal[2];
     // printf("Magnetic:       X= %d ,      Y  = %d ,      Z  = %d\r\n\n",s32OutBuf[0],s32OutBuf[1],s32OutBuf[2]);
     return 0;
 }
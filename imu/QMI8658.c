@@ -1,6 +1,8 @@
 
 //#include "stdafx.h"
 #include "QMI8658.h"
+#include "imu_bias.h"
+#include "sensor_stats.h"
 
 #define QMI8658_SLAVE_ADDR_L 0x6a
 #define QMI8658_SLAVE_ADDR_H 0x6b
@@ -8,8 +10,6 @@
 
 #define QMI8658_UINT_MG_DPS
 int QMI8658_dev;
-IMU_ST_SENSOR_DATA gstGyroOffset ={0,0,0}; 
-IMU_ST_SENSOR_DATA gstAccOffset ={0,0,0}; 
 enum
 {
 	AXIS_X = 0,
@@ -35,14 +35,14 @@ static unsigned char QMI8658_slave_addr = QMI8658_SLAVE_ADDR_H;
 
 unsigned char QMI8658_write_reg(unsigned char reg, unsigned char value)
 {
-	lgI2cWriteByteData(QMI8658_dev,reg,value);
+	stats_i2c(STATS_I2C_QMI8658, lgI2cWriteByteData(QMI8658_dev,reg,value));
 	return 0;
 }
 
 unsigned char QMI8658_read_reg(unsigned char reg, unsigned char *buf, unsigned short len)
 {
 
-	lgI2cReadI2CBlockData(QMI8658_dev,reg,(char *)buf,len);
+	stats_i2c(STATS_I2C_QMI8658, lgI2cReadI2CBlockData(QMI8658_dev,reg,(char *)buf,len));
 	return 0;
 }
 
@@ -199,6 +199,20 @@ short QMI8658_readTemp(void)
 	return temp;
 }
 
+/* Read the raw acc and gyro in one transaction, the registers are contiguous */
+void QMI8658_read_raw_xyz(short int acc_xyz[3], short int gyro_xyz[3])
+{
+	unsigned char buf_reg[12];
+
+	QMI8658_read_reg(QMI8658Register_Ax_L, buf_reg, 12); // 0x35 to 0x40
+	acc_xyz[0] = (buf_reg[1] << 8) | (buf_reg[0]);
+	acc_xyz[1] = (buf_reg[3] << 8) | (buf_reg[2]);
+	acc_xyz[2] = (buf_reg[5] << 8) | (buf_reg[4]);
+	gyro_xyz[0] = (buf_reg[7] << 8) | (buf_reg[6]);
+	gyro_xyz[1] = (buf_reg[9] << 8) | (buf_reg[8]);
+	gyro_xyz[2] = (buf_reg[11] << 8) | (buf_reg[10]);
+}
+
 void QMI8658_read_acc_xyz(short int acc_xyz[3])
 {
 	unsigned char buf_reg[6];
@@ -209,9 +223,8 @@ void QMI8658_read_acc_xyz(short int acc_xyz[3])
 	raw_acc_xyz[1] = (buf_reg[3] << 8) | (buf_reg[2]);
 	raw_acc_xyz[2] = (buf_reg[5] << 8) | (buf_reg[4]);
 
-    acc_xyz[0] = raw_acc_xyz[0] - gstAccOffset.s16X;
-    acc_xyz[1] = raw_acc_xyz[1] - gstAccOffset.s16Y;
-    acc_xyz[2] = raw_acc_xyz[2] - gstAccOffset.s16Z;
+	/* Remove the bias learned by imu_bias.c for the current temperature */
+	imu_bias_correct_acc(raw_acc_xyz, acc_xyz);
 	// QMI8658_printf("\r\n Acceleration: X: %d     Y: %d     Z: %d \r\n",acc_xyz[0],acc_xyz[1],acc_xyz[2]);
 
 }
@@ -225,9 +238,7 @@ void QMI8658_read_gyro_xyz(short int gyro_xyz[3])
 	raw_gyro_xyz[1] = (buf_reg[3] << 8) | (buf_reg[2]);
 	raw_gyro_xyz[2] = (buf_reg[5] << 8) | (buf_reg[4]);
 
-    gyro_xyz[0] = raw_gyro_xyz[0] - gstGyroOffset.s16X;
-    gyro_xyz[1] = raw_gyro_xyz[1] - gstGyroOffset.s16Y;
-    gyro_xyz[2] = raw_gyro_xyz[2] - gstGyroOffset.s16Z;
+	imu_bias_correct_gyro(raw_gyro_xyz, gyro_xyz);
 	// QMI8658_printf("\r\n Gyroscope: X: %d     Y: %d     Z: %d \r\n",gyro_xyz[0], gyro_xyz[1], gyro_xyz[2]);
 }
 
@@ -268,6 +279,9 @@ void QMI8658_Config_apply(struct QMI8658Config const *config)
 	}
 	QMI8658_enableSensors(fisSensors);
 }
+/* One shot bias calibration.  The board must be still while this runs.  It sets the
+ * intercept of the temperature model in imu_bias.c, which then keeps learning in the
+ * background whenever the board is still */
 void QMI8658_Gyro_Acc_Offset(void)
 {
   unsigned char  i;
@@ -276,8 +290,7 @@ void QMI8658_Gyro_Acc_Offset(void)
   int s32TempAx = 0, s32TempAy = 0, s32TempAz = 0;
   for(i = 0; i < 32; i ++)
   {
-	QMI8658_read_gyro_xyz(gyro);
-	QMI8658_read_acc_xyz(acc);
+	QMI8658_read_raw_xyz(acc, gyro);
 
 	s32TempGx += gyro[0];
 	s32TempGy += gyro[1];
@@ -288,13 +301,14 @@ void QMI8658_Gyro_Acc_Offset(void)
 	s32TempAz += acc[2];
 	lguSleep(0.01);
   }
-	gstGyroOffset.s16X = s32TempGx >> 5;
-	gstGyroOffset.s16Y = s32TempGy >> 5;
-	gstGyroOffset.s16Z = s32TempGz >> 5;
-
-	gstAccOffset.s16X = s32TempAx >> 5;
-	gstAccOffset.s16Y = s32TempAy >> 5;
-	gstAccOffset.s16Z = (s32TempAz >> 5) - 980;
+	gyro[0] = s32TempGx >> 5;
+	gyro[1] = s32TempGy >> 5;
+	gyro[2] = s32TempGz >> 5;
+
+	acc[0] = s32TempAx >> 5;
+	acc[1] = s32TempAy >> 5;
+	acc[2] = s32TempAz >> 5;
+	imu_bias_set(gyro, acc, QMI8658_readTemp() / 256.0f);
 	return;
 }
 unsigned char QMI8658_init(void)
@@ -354,7 +368,9 @@ unsigned char QMI8658_init(void)
 			QMI8658_read_reg(QMI8658Register_Ctrl7, &read_data, 1);
 //			QMI8658_printf("QMI8658Register_Ctrl7=0x%x \n", read_data);
 		}
-		QMI8658_Gyro_Acc_Offset();
+		/* Load the bias model.  It is learned by imu_bias_process() while the board is still, rather
+		 * than assuming the board is still at startup */
+		imu_bias_init();
 		return 1;
 	}
 	else
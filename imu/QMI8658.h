@@ -491,6 +491,8 @@ extern void QMI8658_Config_apply(struct QMI8658Config const* config);
 extern void QMI8658_enableSensors(unsigned char enableFlags);
 extern void QMI8658_read_acc_xyz(short int acc_xyz[3]);
 extern void QMI8658_read_gyro_xyz(short int gyro_xyz[3]);
+extern void QMI8658_read_raw_xyz(short int acc_xyz[3], short int gyro_xyz[3]);
+extern void QMI8658_Gyro_Acc_Offset(void);
 extern short QMI8658_readTemp(void);
 
 
@@ -0,0 +1,227 @@
+/*
+ * imu_bias.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Online gyro and accelerometer bias estimation for the QMI8658.
+ *
+ * A background thread samples the IMU.  A short exponential mean and variance of each
+ * axis tells us when the board is still.  While it is still, the raw readings are the
+ * bias (plus gravity for the accelerometer) and we add them to a linear regression of
+ * bias against chip temperature:
+ *
+ *   bias(T) = intercept + slope * (T - IMU_BIAS_T_REF)
+ *
+ * The regression keeps exponentially weighted sums, so the memory is fixed and each
+ * sample is O(1).  If the temperature has not moved enough to see the slope, then the
+ * previous slope is kept and only the intercept is learned.  The read path only
+ * evaluates the line, so the corrected values cost nothing extra at full rate.
+ *
+ * On orbit the board is in free fall and a still accelerometer reads zero.  For
+ * ground testing set acc_gravity_x/y/z in the calibration file to the reading
+ * expected from gravity in the mounting orientation, otherwise gravity is learned as
+ * accelerometer bias.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <lgpio.h>
+
+#include "QMI8658.h"
+#include "imu_bias.h"
+#include "event_capture.h"
+#include "sensors_cal_file.h"
+
+static const char *bias_keys[IMU_BIAS_AXES] = {
+		"gyro_bias_x", "gyro_bias_y", "gyro_bias_z",
+		"acc_bias_x", "acc_bias_y", "acc_bias_z" };
+static const char *slope_keys[IMU_BIAS_AXES] = {
+		"gyro_bias_x_tc", "gyro_bias_y_tc", "gyro_bias_z_tc",
+		"acc_bias_x_tc", "acc_bias_y_tc", "acc_bias_z_tc" };
+static const char *gravity_keys[3] = { "acc_gravity_x", "acc_gravity_y", "acc_gravity_z" };
+
+static pthread_mutex_t imu_bias_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int imu_bias_thread_called = false;
+
+/* The model applied in the read path.  Protected by the mutex */
+static double intercept[IMU_BIAS_AXES];
+static double slope[IMU_BIAS_AXES];
+static double last_temperature = IMU_BIAS_T_REF;
+
+/* Acceleration expected from gravity when still */
+static double gravity[3];
+
+/* Stationary detector.  Only used by the background thread */
+static double still_mean[IMU_BIAS_AXES];
+static double still_var[IMU_BIAS_AXES];
+static int still_count = 0;
+static int stationary = false;
+
+/* Exponentially weighted regression sums.  t is relative to IMU_BIAS_T_REF */
+static double s_w, s_t, s_tt;
+static double s_b[IMU_BIAS_AXES];
+static double s_tb[IMU_BIAS_AXES];
+static int samples_since_save = 0;
+
+/**
+ * Load the model from the calibration file.  Without one the bias is zero until we
+ * have been still for a few seconds.
+ */
+void imu_bias_init() {
+	pthread_mutex_lock(&imu_bias_mutex);
+	for (int i=0; i < IMU_BIAS_AXES; i++) {
+		intercept[i] = cal_file_get(bias_keys[i], 0.0);
+		slope[i] = cal_file_get(slope_keys[i], 0.0);
+		s_b[i] = s_tb[i] = 0;
+		still_mean[i] = still_var[i] = 0;
+	}
+	for (int i=0; i < 3; i++)
+		gravity[i] = cal_file_get(gravity_keys[i], 0.0);
+	s_w = s_t = s_tt = 0;
+	still_count = 0;
+	stationary = false;
+	pthread_mutex_unlock(&imu_bias_mutex);
+}
+
+/* Save the model to the calibration table.  Must be called with the mutex held */
+static void imu_bias_save() {
+	for (int i=0; i < IMU_BIAS_AXES; i++) {
+		cal_file_set(bias_keys[i], intercept[i]);
+		cal_file_set(slope_keys[i], slope[i]);
+	}
+}
+
+/**
+ * Force the intercept from an average taken while the board is known to be still.  This
+ * is used by the one shot QMI8658_Gyro_Acc_Offset().  The slope is kept.
+ */
+void imu_bias_set(const short gyro[3], const short acc[3], float temperature) {
+	pthread_mutex_lock(&imu_bias_mutex);
+	double t = temperature - IMU_BIAS_T_REF;
+	for (int i=0; i < 3; i++) {
+		intercept[i] = gyro[i] - slope[i] * t;
+		intercept[i+3] = acc[i] - gravity[i] - slope[i+3] * t;
+	}
+	last_temperature = temperature;
+	imu_bias_save();
+	pthread_mutex_unlock(&imu_bias_mutex);
+}
+
+/**
+ * Add one raw sample.  This is O(1) and is called at the background sample rate.
+ */
+void imu_bias_update(const short gyro[3], const short acc[3], float temperature) {
+	double x[IMU_BIAS_AXES];
+	for (int i=0; i < 3; i++) {
+		x[i] = gyro[i];
+		x[i+3] = acc[i] - gravity[i];
+	}
+
+	/* Stationary detector.  Exponential mean and variance of each axis */
+	int still = true;
+	for (int i=0; i < IMU_BIAS_AXES; i++) {
+		double d = x[i] - still_mean[i];
+		still_mean[i] += IMU_BIAS_ALPHA * d;
+		still_var[i] = (1 - IMU_BIAS_ALPHA) * (still_var[i] + IMU_BIAS_ALPHA * d * d);
+		double max = (i < 3) ? IMU_BIAS_GYRO_VAR_MAX : IMU_BIAS_ACC_VAR_MAX;
+		if (still_var[i] > max) still = false;
+	}
+	if (still) {
+		if (still_count < IMU_BIAS_STILL_SAMPLES) still_count++;
+	} else {
+		still_count = 0;
+	}
+
+	pthread_mutex_lock(&imu_bias_mutex);
+	last_temperature = temperature;
+	stationary = (still_count >= IMU_BIAS_STILL_SAMPLES);
+	if (!stationary) {
+		pthread_mutex_unlock(&imu_bias_mutex);
+		return;
+	}
+
+	/* Decay the old sums and add this sample */
+	double t = temperature - IMU_BIAS_T_REF;
+	double k = 1.0 - 1.0 / IMU_BIAS_MEMORY;
+	s_w = k * s_w + 1;
+	s_t = k * s_t + t;
+	s_tt = k * s_tt + t * t;
+	double mean_t = s_t / s_w;
+	double var_t = s_tt / s_w - mean_t * mean_t;
+	for (int i=0; i < IMU_BIAS_AXES; i++) {
+		s_b[i] = k * s_b[i] + x[i];
+		s_tb[i] = k * s_tb[i] + t * x[i];
+		if (s_w < IMU_BIAS_MIN_WEIGHT) continue;
+		double mean_b = s_b[i] / s_w;
+		if (var_t > IMU_BIAS_MIN_TEMP_VAR)
+			slope[i] = (s_tb[i] / s_w - mean_t * mean_b) / var_t;
+		intercept[i] = mean_b - slope[i] * mean_t;
+	}
+	if (s_w >= IMU_BIAS_MIN_WEIGHT && ++samples_since_save >= IMU_BIAS_SAVE_PERIOD) {
+		samples_since_save = 0;
+		imu_bias_save();
+	}
+	pthread_mutex_unlock(&imu_bias_mutex);
+}
+
+static void imu_bias_correct(const short raw[3], short out[3], int axis) {
+	pthread_mutex_lock(&imu_bias_mutex);
+	double t = last_temperature - IMU_BIAS_T_REF;
+	for (int i=0; i < 3; i++) {
+		double v = raw[i] - (intercept[axis+i] + slope[axis+i] * t);
+		if (v > 32767) v = 32767;
+		if (v < -32768) v = -32768;
+		out[i] = (short)lround(v);
+	}
+	pthread_mutex_unlock(&imu_bias_mutex);
+}
+
+void imu_bias_correct_gyro(const short raw[3], short out[3]) {
+	imu_bias_correct(raw, out, 0);
+}
+
+void imu_bias_correct_acc(const short raw[3], short out[3]) {
+	imu_bias_correct(raw, out, 3);
+}
+
+int imu_bias_is_stationary() {
+	pthread_mutex_lock(&imu_bias_mutex);
+	int s = stationary;
+	pthread_mutex_unlock(&imu_bias_mutex);
+	return s;
+}
+
+/**
+ * Background thread that samples the IMU for the bias estimator.  The temperature
+ * changes slowly so it is only read every IMU_BIAS_TEMP_PERIOD samples.
+ */
+void *imu_bias_process(void * arg) {
+	short acc[3], gyro[3];
+	float temperature = IMU_BIAS_T_REF;
+	int n = 0;
+
+	if (imu_bias_thread_called) {
+		printf("ERROR: IMU bias thread already started\n");
+		return NULL;
+	}
+	imu_bias_thread_called = true;
+	while (imu_bias_thread_called) {
+		if (n++ % IMU_BIAS_TEMP_PERIOD == 0)
+			temperature = QMI8658_readTemp() / 256.0f;
+		QMI8658_read_raw_xyz(acc, gyro);
+		imu_bias_update(gyro, acc, temperature);
+		capture_add_imu(acc, gyro);
+		lguSleep(IMU_BIAS_SAMPLE_PERIOD);
+	}
+	return NULL;
+}
+
+void imu_bias_exit_process() {
+	imu_bias_thread_called = false;
+}
@@ -0,0 +1,37 @@
+/*
+ * imu_bias.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Online gyro and accelerometer bias estimation for the QMI8658, modeled as a
+ * function of the chip temperature.
+ *
+ */
+
+#ifndef IMU_BIAS_H_
+#define IMU_BIAS_H_
+
+#define IMU_BIAS_AXES 6                 /* gyro x,y,z then acc x,y,z */
+#define IMU_BIAS_SAMPLE_PERIOD 0.02     /* Seconds between samples in the background thread */
+#define IMU_BIAS_TEMP_PERIOD 50         /* Read the temperature every this many samples */
+#define IMU_BIAS_T_REF 25.0             /* Temperature the intercept is referenced to in C */
+#define IMU_BIAS_ALPHA 0.1              /* Smoothing for the stationary detector, about 10 samples */
+#define IMU_BIAS_GYRO_VAR_MAX 400.0     /* Gyro variance in LSB^2 below which we are still, about 0.6 dps rms */
+#define IMU_BIAS_ACC_VAR_MAX 10000.0    /* Accel variance in LSB^2 below which we are still, about 6 mg rms */
+#define IMU_BIAS_STILL_SAMPLES 50       /* Consecutive still samples before we learn, 1 second */
+#define IMU_BIAS_MEMORY 30000.0         /* Samples of memory in the regression, about 10 minutes still */
+#define IMU_BIAS_MIN_WEIGHT 100.0       /* Weight needed before the learned bias is used */
+#define IMU_BIAS_MIN_TEMP_VAR 1.0       /* Temperature variance in C^2 needed to learn the slope */
+#define IMU_BIAS_SAVE_PERIOD 3000       /* Write to the calibration table every this many still samples */
+
+void imu_bias_init();
+void imu_bias_update(const short gyro[3], const short acc[3], float temperature);
+void imu_bias_set(const short gyro[3], const short acc[3], float temperature);
+void imu_bias_correct_gyro(const short raw[3], short out[3]);
+void imu_bias_correct_acc(const short raw[3], short out[3]);
+int imu_bias_is_stationary();
+void *imu_bias_process(void * arg);
+void imu_bias_exit_process();
+
+#endif /* IMU_BIAS_H_ */
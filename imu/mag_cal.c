@@ -0,0 +1,205 @@
+/*
+ * mag_cal.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Online hard and soft iron calibration for the AK09918 magnetometer.
+ *
+ * As the board is rotated the raw magnetometer readings lie on an ellipsoid.  The
+ * center of the ellipsoid is the hard iron offset and the different lengths of its
+ * axes are the soft iron distortion.  We fit an axis aligned ellipsoid:
+ *
+ *   a x^2 + b y^2 + c z^2 + d x + e y + f z = 1
+ *
+ * with recursive least squares.  Each sample costs a few dozen multiplies on a 6x6
+ * covariance matrix and the memory is fixed, so this runs on every read.  A forgetting
+ * factor lets the fit follow slow changes, for example when equipment near the
+ * sensor is moved.  If the board is not rotating there is no new information and
+ * the covariance grows, so we stop forgetting until it rotates again.  Otherwise the
+ * fit winds up and wanders.
+ *
+ * Cross axis soft iron terms are not modeled.  They are small for this board and would
+ * need a 9 parameter fit and an eigen decomposition to apply.
+ *
+ * A fit is only used when we have enough samples, each axis has been swept over most of
+ * the diameter, and the radii are plausible.  Until then the last saved calibration, or
+ * the default offset, is used.
+ *
+ */
+
+#include <stdbool.h>
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mag_cal.h"
+#include "sensors_cal_file.h"
+
+/* The fit is updated on each IMU read and the calibration is applied for the telemetry,
+ * which can be on different threads, so all of the state below is held under this */
+static pthread_mutex_t mag_cal_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* RLS state */
+static double theta[MAG_CAL_PARAMS];
+static double P[MAG_CAL_PARAMS][MAG_CAL_PARAMS];
+static unsigned int sample_count = 0;
+static double axis_min[3];
+static double axis_max[3];
+
+/* The calibration currently applied to the readings */
+static double mag_offset[3];
+static double mag_scale[3] = {1.0, 1.0, 1.0};
+
+static void mag_cal_reset_fit() {
+	memset(theta, 0, sizeof(theta));
+	memset(P, 0, sizeof(P));
+	for (int i=0; i < MAG_CAL_PARAMS; i++)
+		P[i][i] = MAG_CAL_P_INIT;
+	for (int i=0; i < 3; i++) {
+		axis_min[i] = HUGE_VAL;
+		axis_max[i] = -HUGE_VAL;
+	}
+	sample_count = 0;
+}
+
+/**
+ * Load the saved calibration, or use the default offset if we have never calibrated.
+ */
+void mag_cal_init(short default_offset[3]) {
+	pthread_mutex_lock(&mag_cal_mutex);
+	mag_offset[0] = cal_file_get(MAG_CAL_KEY_OFFSET_X, default_offset[0]);
+	mag_offset[1] = cal_file_get(MAG_CAL_KEY_OFFSET_Y, default_offset[1]);
+	mag_offset[2] = cal_file_get(MAG_CAL_KEY_OFFSET_Z, default_offset[2]);
+	mag_scale[0] = cal_file_get(MAG_CAL_KEY_SCALE_X, 1.0);
+	mag_scale[1] = cal_file_get(MAG_CAL_KEY_SCALE_Y, 1.0);
+	mag_scale[2] = cal_file_get(MAG_CAL_KEY_SCALE_Z, 1.0);
+	mag_cal_reset_fit();
+	pthread_mutex_unlock(&mag_cal_mutex);
+}
+
+/**
+ * Turn the fitted parameters into an offset and scale.  Returns 0 if the fit is not
+ * usable yet.
+ */
+static int mag_cal_solve(double offset[3], double scale[3]) {
+	double radius[3];
+	double g = 1.0;
+
+	for (int i=0; i < 3; i++) {
+		if (theta[i] <= 0) return 0; // not an ellipsoid
+		offset[i] = -theta[i+3] / (2 * theta[i]);
+		g += theta[i+3] * theta[i+3] / (4 * theta[i]);
+	}
+	if (g <= 0) return 0;
+
+	double r_min = HUGE_VAL, r_max = 0, r_mean = 0;
+	for (int i=0; i < 3; i++) {
+		radius[i] = sqrt(g / theta[i]) / MAG_CAL_INPUT_SCALE;
+		offset[i] = offset[i] / MAG_CAL_INPUT_SCALE;
+		if (radius[i] < r_min) r_min = radius[i];
+		if (radius[i] > r_max) r_max = radius[i];
+		r_mean += radius[i] / 3;
+	}
+	if (r_min < MAG_CAL_MIN_RADIUS || r_max > MAG_CAL_MAX_RADIUS) return 0;
+	if (r_max > MAG_CAL_MAX_AXIS_RATIO * r_min) return 0;
+
+	/* We need to have seen most of the sphere on every axis */
+	for (int i=0; i < 3; i++)
+		if (axis_max[i] - axis_min[i] < MAG_CAL_MIN_SPAN * 2 * radius[i]) return 0;
+
+	/* Scale each axis to the mean radius so the output stays in sensor counts */
+	for (int i=0; i < 3; i++)
+		scale[i] = r_mean / radius[i];
+	return 1;
+}
+
+/**
+ * Add a raw sample to the fit.  This is called for every reading that did not overflow.
+ */
+void mag_cal_update(const short raw[3]) {
+	double phi[MAG_CAL_PARAMS];
+	double Pphi[MAG_CAL_PARAMS];
+	double x = raw[0] * MAG_CAL_INPUT_SCALE;
+	double y = raw[1] * MAG_CAL_INPUT_SCALE;
+	double z = raw[2] * MAG_CAL_INPUT_SCALE;
+
+	phi[0] = x*x; phi[1] = y*y; phi[2] = z*z;
+	phi[3] = x; phi[4] = y; phi[5] = z;
+
+	pthread_mutex_lock(&mag_cal_mutex);
+	for (int i=0; i < 3; i++) {
+		if (raw[i] < axis_min[i]) axis_min[i] = raw[i];
+		if (raw[i] > axis_max[i]) axis_max[i] = raw[i];
+	}
+
+	/* Gain k = P phi / (lambda + phi' P phi) */
+	double trace = 0;
+	double denom = 0;
+	for (int i=0; i < MAG_CAL_PARAMS; i++) {
+		Pphi[i] = 0;
+		for (int j=0; j < MAG_CAL_PARAMS; j++)
+			Pphi[i] += P[i][j] * phi[j];
+		denom += phi[i] * Pphi[i];
+		trace += P[i][i];
+	}
+	double lambda = (trace < MAG_CAL_P_TRACE_MAX) ? MAG_CAL_LAMBDA : 1.0;
+	denom += lambda;
+
+	double err = 1.0;
+	for (int i=0; i < MAG_CAL_PARAMS; i++)
+		err -= theta[i] * phi[i];
+
+	/* theta += k err, P = (P - k phi' P) / lambda.  P is symmetric so phi' P = (P phi)' */
+	for (int i=0; i < MAG_CAL_PARAMS; i++) {
+		double k = Pphi[i] / denom;
+		theta[i] += k * err;
+		for (int j=i; j < MAG_CAL_PARAMS; j++) {
+			P[i][j] = (P[i][j] - k * Pphi[j]) / lambda;
+			P[j][i] = P[i][j];
+		}
+	}
+
+	if (++sample_count < MAG_CAL_MIN_SAMPLES) {
+		pthread_mutex_unlock(&mag_cal_mutex);
+		return;
+	}
+
+	double offset[3], scale[3];
+	if (mag_cal_solve(offset, scale)) {
+		int changed = false;
+		for (int i=0; i < 3; i++) {
+			if (fabs(offset[i] - mag_offset[i]) >= 1.0 || fabs(scale[i] - mag_scale[i]) >= 0.001)
+				changed = true;
+			mag_offset[i] = offset[i];
+			mag_scale[i] = scale[i];
+		}
+		/* Only mark the calibration file dirty when the result moved by a visible amount */
+		if (changed) {
+			cal_file_set(MAG_CAL_KEY_OFFSET_X, round(mag_offset[0]));
+			cal_file_set(MAG_CAL_KEY_OFFSET_Y, round(mag_offset[1]));
+			cal_file_set(MAG_CAL_KEY_OFFSET_Z, round(mag_offset[2]));
+			cal_file_set(MAG_CAL_KEY_SCALE_X, mag_scale[0]);
+			cal_file_set(MAG_CAL_KEY_SCALE_Y, mag_scale[1]);
+			cal_file_set(MAG_CAL_KEY_SCALE_Z, mag_scale[2]);
+		}
+	}
+	pthread_mutex_unlock(&mag_cal_mutex);
+}
+
+/**
+ * Remove the hard iron offset and correct the soft iron scale
+ */
+void mag_cal_apply(const short raw[3], short out[3]) {
+	double offset[3], scale[3];
+	pthread_mutex_lock(&mag_cal_mutex);
+	memcpy(offset, mag_offset, sizeof(offset));
+	memcpy(scale, mag_scale, sizeof(scale));
+	pthread_mutex_unlock(&mag_cal_mutex);
+	for (int i=0; i < 3; i++) {
+		double v = (raw[i] - offset[i]) * scale[i];
+		if (v > 32767) v = 32767;
+		if (v < -32768) v = -32768;
+		out[i] = (short)lround(v);
+	}
+}
@@ -0,0 +1,39 @@
+/*
+ * mag_cal.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Online hard and soft iron calibration for the AK09918 magnetometer.
+ *
+ */
+
+#ifndef MAG_CAL_H_
+#define MAG_CAL_H_
+
+#include <stdint.h>
+
+#define MAG_CAL_PARAMS 6            /* a x^2 + b y^2 + c z^2 + d x + e y + f z = 1 */
+#define MAG_CAL_LAMBDA 0.9995       /* RLS forgetting factor, memory of about 2000 samples */
+#define MAG_CAL_P_INIT 1.0e4        /* Initial covariance, large because we know nothing */
+#define MAG_CAL_P_TRACE_MAX 1.0e6   /* Stop forgetting if the covariance grows past this (no excitation) */
+#define MAG_CAL_INPUT_SCALE (1.0/256.0) /* Scale raw counts so the regressors are close to 1 */
+#define MAG_CAL_MIN_SAMPLES 200     /* Samples needed before a fit is used */
+#define MAG_CAL_MIN_SPAN 0.8        /* Each axis must have seen this fraction of the diameter */
+#define MAG_CAL_MIN_RADIUS 50.0     /* Plausible range for the field radius in counts */
+#define MAG_CAL_MAX_RADIUS 5000.0
+#define MAG_CAL_MAX_AXIS_RATIO 1.5  /* Reject fits where one axis is much longer than another */
+
+/* Keys in the calibration file */
+#define MAG_CAL_KEY_OFFSET_X "mag_offset_x"
+#define MAG_CAL_KEY_OFFSET_Y "mag_offset_y"
+#define MAG_CAL_KEY_OFFSET_Z "mag_offset_z"
+#define MAG_CAL_KEY_SCALE_X "mag_scale_x"
+#define MAG_CAL_KEY_SCALE_Y "mag_scale_y"
+#define MAG_CAL_KEY_SCALE_Z "mag_scale_z"
+
+void mag_cal_init(short default_offset[3]);
+void mag_cal_update(const short raw[3]);
+void mag_cal_apply(const short raw[3], short out[3]);
+
+#endif /* MAG_CAL_H_ */
@@ -30,7 +30,31 @@
 #define LPS_TEMP_OUT_H          0x2C
 #define LPS_RES                 0x33        //Filter reset register
 
-int LPS22HB_read(int *pressure, short *temperature);
+//CTRL_REG1
+#define LPS_ODR_1HZ             0x10        //Output data rate
+#define LPS_ODR_10HZ            0x20
+#define LPS_ODR_25HZ            0x30
+#define LPS_ODR_50HZ            0x40
+#define LPS_ODR_75HZ            0x50
+#define LPS_CTRL_REG1_EN_LPFP   0x08        //Low pass filter enable
+#define LPS_CTRL_REG1_BDU       0x02        //Block data update
+//CTRL_REG2
+#define LPS_CTRL_REG2_FIFO_EN   0x40
+#define LPS_CTRL_REG2_IF_ADD_INC 0x10       //Register address increments in a multi byte read
+//FIFO_CTRL
+#define LPS_FIFO_MODE_STREAM    0x40        //Newest samples are kept when the FIFO is full
+//FIFO_STATUS
+#define LPS_FIFO_STATUS_OVR     0x40        //Samples were overwritten
+#define LPS_FIFO_STATUS_FSS     0x3F        //Number of unread samples
+#define LPS_FIFO_SIZE           32
+#define LPS_SAMPLE_LEN          5           //Pressure XL, L, H, Temperature L, H
+
+#define LPS_LSB_PER_HPA         4096.0
+#define LPS_LSB_PER_DEGC        100.0
+
+unsigned char LPS22HB_INIT(unsigned char odr);
+void LPS22HB_close();
+int LPS22HB_read_fifo(int *pressure, short *temperature, int max, int *overflow);
 
 #endif 
 
@@ -20,6 +20,21 @@
 
 #define CRC_POLYNOMIAL              0x131 // P(x) = x^8 + x^5 + x^4 + 1 = 100110001
 
+//Timing in seconds, from the datasheet
+#define SHTC3_WAKEUP_TIME           0.00024
+#define SHTC3_NM_MEAS_TIME_TYP      0.0108
+#define SHTC3_NM_MEAS_TIME_MAX      0.0121
+#define SHTC3_LP_MEAS_TIME_TYP      0.0007
+#define SHTC3_LP_MEAS_TIME_MAX      0.0008
+#define SHTC3_POLL_TIME             0.0005
+
+//Errors
+#define SHTC3_ERR_COMM              1
+#define SHTC3_ERR_TIMEOUT           2
+#define SHTC3_ERR_CRC               3
+
 int SHTC3_read(short *temp, short *humidity);
+void SHTC3_set_low_power(int on);
+void SHTC3_close();
 
 #endif
@@ -0,0 +1,27 @@
+/*
+ * cal_lut.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Calibration curves compiled into dense lookup tables.
+ *
+ */
+
+#ifndef CAL_LUT_H_
+#define CAL_LUT_H_
+
+#define CAL_LUT_MAX_CURVES 32
+#define CAL_LUT_SIZE 1024           /* Intervals in each table */
+#define CAL_LUT_MAX_POINTS 32       /* Points in a piecewise linear curve or terms in a polynomial */
+#define CAL_LUT_NAME_LEN 32
+
+int cal_lut_load(char *filename);
+int cal_lut_define_pwl(const char *name, const double *x, const double *y, int n);
+int cal_lut_define_poly(const char *name, double xmin, double xmax, const double *c, int n);
+int cal_lut_define_fn(const char *name, double xmin, double xmax, double (*fn)(double));
+int cal_lut_find(const char *name);
+double cal_lut_eval(int curve, double x);
+int cal_lut_in_range(int curve, double x);
+
+#endif /* CAL_LUT_H_ */
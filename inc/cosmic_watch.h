@@ -9,6 +9,7 @@
 #define COSMIC_WATCH_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <pthread.h>
 
 #define CW_RESPONSE_LEN 1024
@@ -16,15 +17,23 @@
 /* This is defined in cosmic_watch.c and used in sensors.c as well */
 extern pthread_mutex_t cw_mutex;
 
+/*
+ * The values in a CosmicWatch line, in the order they are sent after the M or S.  The
+ * struct and the ground converter are both built from this.
+ * FIELD(name, type, is_float)
+ */
+#define CW_SCHEMA(FIELD) \
+	FIELD(event_num, uint16_t, false)          /* The event number */ \
+	FIELD(time_ms, uint32_t, false)            /* Time in ms since we started.  Used for coincidence and later analysis. */ \
+	FIELD(count_avg, uint16_t, false)          /* The running average of counts since we started this run */ \
+	FIELD(sipm_voltage, float, true)           /* The voltage from the scintilator block, scaled from the ADC reading with a lookup table */ \
+	FIELD(deadtime_ms, uint32_t, false)        /* The deadtime */ \
+	FIELD(temperature_deg_c, float, true)      /* The temperature in degrees C */
+
+#define CW_STRUCT_FIELD(name, type, is_float) type name;
 typedef struct cw_data {
 	char master_slave[2];
-    uint16_t event_num; /* The event number */
-    uint32_t time_ms;  /* Time in ms since we started.  Used for coincidence and later analysis. */
-    uint16_t count_avg;  /* The running average of counts since we started this run */
-   // float count_std; /* The standard deviation of counts since we started this run */
-    float sipm_voltage; /* The voltage from the scintilator block, scaled from the ADC reading with a lookup table */
-    uint32_t deadtime_ms; /* The deadtime */
-    float temperature_deg_c; /* The temperature in degrees C */
+	CW_SCHEMA(CW_STRUCT_FIELD)
 } cw_data_t;
 
 void *cw1_listen_process(void * arg);
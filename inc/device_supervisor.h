@@ -0,0 +1,45 @@
+/*
+ * device_supervisor.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Keeps the health of each device: the I2C sensors, the CosmicWatch serial ports and the
+ * mic.  A device that fails is not tried again straight away.  It waits
+ * supervisor_backoff_min_in_seconds, then twice as long after each failure that follows,
+ * up to supervisor_backoff_max_in_seconds.  When it works again the wait starts again
+ * from the minimum.  So a transient fault costs one retry, and a device that has gone
+ * costs a retry every half hour, rather than a sensor lost for the rest of the mission or
+ * a retry every cycle.
+ *
+ * The owner of a device asks supervisor_may_try() before it opens it and reports the
+ * result with supervisor_ok() or supervisor_failed().  A reader thread sleeps out its
+ * wait with supervisor_wait().
+ *
+ */
+
+#ifndef DEVICE_SUPERVISOR_H_
+#define DEVICE_SUPERVISOR_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SUPERVISOR_MAX_DEVICES 16
+
+enum {
+	DEVICE_UNKNOWN,                /* Not tried yet, or off */
+	DEVICE_OK,
+	DEVICE_FAILED                  /* Waiting to be tried again */
+};
+
+int supervisor_add(const char *name);
+int supervisor_may_try(int id, uint32_t now);
+void supervisor_ok(int id);
+void supervisor_failed(int id, uint32_t now);
+void supervisor_restarted(int id);
+void supervisor_reset(int id);
+int supervisor_wait(int id, int *running);
+int supervisor_num_failed();
+void supervisor_print(FILE *file);
+
+#endif /* DEVICE_SUPERVISOR_H_ */
@@ -64,6 +64,7 @@ typedef enum
   _PH3 = 0x45
 } eType_t;
 
+void dfr_gas_define_curves();
 int dfr_gas_read(short *temp, short *conc);
 
 #endif /* DFROBOT_GAS_H_ */
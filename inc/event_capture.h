@@ -0,0 +1,71 @@
+/*
+ * event_capture.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Pre-trigger capture of the high rate channels.  The pressure FIFO, the IMU and each
+ * telemetry sample are kept in rings that hold the last capture_pre_seconds +
+ * capture_post_seconds.  The triggers from the config file are checked against the live
+ * values.  When one fires, the capture runs on for capture_post_seconds, then the samples
+ * from capture_pre_seconds before the trigger to the end are appended to the capture file
+ * in the WOD folder and it is added to the directory.
+ *
+ * A trigger is a line in the config file of: capture_trigger=value op threshold
+ * The value is the name of a field in TELEM_SCHEMA, or pressure_trend in hPa/min.  The op
+ * is > or <, or rise or fall for a change since the last sample by more than the threshold.
+ * A trigger fires when its predicate becomes true, and is not checked while a capture is
+ * in progress.
+ *
+ * The capture file is a series of captures, each a capture_header_t then count records:
+ *   uint8 channel, uint8 payload length, int32 ms from the trigger, payload
+ * The payloads are:
+ *   CAPTURE_PRESSURE  int32 pressure in LPS22HB counts, int16 temperature
+ *   CAPTURE_IMU       int16 acc x,y,z then gyro x,y,z, raw
+ *   CAPTURE_TELEM     a telemetry record from the schema, with its version byte
+ * Multi byte values are little endian.
+ *
+ */
+
+#ifndef EVENT_CAPTURE_H_
+#define EVENT_CAPTURE_H_
+
+#include <stdint.h>
+
+#include "sensor_telemetry.h"
+#include "sensors_config.h"
+
+#define CAPTURE_FILE "sensors_capture"
+#define CAPTURE_MAGIC "SCAP"
+#define CAPTURE_VERSION 1
+
+enum {
+	CAPTURE_PRESSURE,
+	CAPTURE_IMU,
+	CAPTURE_TELEM,
+	CAPTURE_NUM_CHANNELS
+};
+
+typedef struct __attribute__((__packed__)) capture_header {
+	char magic[4];
+	uint8_t version;
+	uint8_t trigger;               /* Number of the trigger in the config file, from 0 */
+	uint16_t pre_seconds;
+	uint16_t post_seconds;
+	uint16_t reserved;
+	uint32_t trigger_time;         /* Seconds since the epoch */
+	uint16_t trigger_ms;
+	uint16_t reserved2;
+	uint32_t count;                /* Records that follow */
+	char trigger_text[CAPTURE_TRIGGER_LEN];
+} capture_header_t;
+
+int capture_init(char *capture_path);
+void capture_add_pressure(int pressure, short temperature, uint64_t ms);
+void capture_add_imu(const short acc[3], const short gyro[3]);
+void capture_add_telemetry(const sensor_telemetry_t *telem);
+int capture_check();
+void capture_close();
+uint64_t capture_now_ms();
+
+#endif /* EVENT_CAPTURE_H_ */
@@ -0,0 +1,63 @@
+/*
+ * log_index.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * A sidecar index for the WOD and CosmicWatch logs.  As each record is appended to a log,
+ * the index next to it is updated.  It has a summary header with the first and last time
+ * and the number of records, then a sparse table of time to byte offset with an entry at
+ * most every interval seconds.  The index path is the log path with LOG_INDEX_EXT on the
+ * end, and it is rolled into the directory straight after its log.
+ *
+ * A time range is found with a binary search of the table, so it can be read from the log
+ * with a seek rather than a scan.  The range is rounded out to the entries either side,
+ * so it can have up to an interval of extra records at each end.  A record with a time
+ * before the record added before it is indexed at that record's time, so the times in the
+ * index never go backwards.
+ *
+ */
+
+#ifndef LOG_INDEX_H_
+#define LOG_INDEX_H_
+
+#include <stdint.h>
+
+#include "common_config.h"
+
+#define LOG_INDEX_MAGIC "SIDX"
+#define LOG_INDEX_VERSION 1
+#define LOG_INDEX_EXT ".idx"
+
+/* At the start of the index file.  It is written again with each record */
+typedef struct __attribute__((__packed__)) log_index_header {
+	char magic[4];
+	uint8_t version;
+	uint8_t reserved[3];
+	uint32_t interval;             /* Seconds between the entries */
+	uint32_t first_time;
+	uint32_t last_time;
+	uint32_t count;                /* Records in the log */
+	uint32_t entries;              /* Entries that follow */
+} log_index_header_t;
+
+typedef struct __attribute__((__packed__)) log_index_entry {
+	uint32_t time;                 /* Seconds since the epoch */
+	uint32_t offset;               /* Bytes from the start of the log to the record */
+} log_index_entry_t;
+
+/* The index of one log, opened when its first record is added */
+typedef struct log_index {
+	char path[MAX_FILE_PATH_LEN];  /* The log path with LOG_INDEX_EXT, which is rolled */
+	int fd;                        /* The tmp file for path, or -1 */
+	log_index_header_t header;
+	uint32_t last_entry_time;
+} log_index_t;
+
+#define LOG_INDEX_INIT { .fd = -1 }
+
+int log_index_add(log_index_t *index, char *log_path, uint32_t time, long offset);
+void log_index_roll(log_index_t *index);
+int log_index_find(char *index_file, uint32_t from, uint32_t to, log_index_header_t *header, long *start, long *end);
+
+#endif /* LOG_INDEX_H_ */
@@ -0,0 +1,37 @@
+/*
+ * o2_cal.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Calibration of the PS1 O2 sensor against the DFRobot reference sensor.
+ *
+ */
+
+#ifndef O2_CAL_H_
+#define O2_CAL_H_
+
+/* Defaults, hand fitted to the first flight unit */
+#define O2_CAL_DEFAULT_SLOPE -0.0354       /* % per mV */
+#define O2_CAL_DEFAULT_OFFSET 86.434       /* % */
+#define O2_CAL_DEFAULT_TEMPCO 0.769852     /* % per C, subtracted */
+#define O2_CAL_DEFAULT_TREF 24.90947       /* C */
+
+#define O2_CAL_MIN_SAMPLES 30              /* Paired samples before we fit */
+#define O2_CAL_MIN_MV_VAR 25.0             /* mV^2 of spread needed to fit the slope */
+#define O2_CAL_MIN_TEMP_VAR 1.0            /* C^2 of spread needed to fit the temperature coefficient */
+#define O2_CAL_LOG_FILE "o2_cal.csv"
+
+/* Keys in the calibration file */
+#define O2_CAL_KEY_SLOPE "o2_slope"
+#define O2_CAL_KEY_OFFSET "o2_offset"
+#define O2_CAL_KEY_TEMPCO "o2_tempco"
+#define O2_CAL_KEY_TREF "o2_tref"
+
+void o2_cal_init();
+double o2_cal_conc(double mv, double temp_c);
+double o2_cal_tref();
+int o2_cal_add(char *data_folder_path, double mv, double temp_c, double ref_pct);
+int o2_cal_fit();
+
+#endif /* O2_CAL_H_ */
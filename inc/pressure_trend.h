@@ -0,0 +1,30 @@
+/*
+ * pressure_trend.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Streams the LPS22HB FIFO in the background and keeps the pressure trend.
+ *
+ */
+
+#ifndef PRESSURE_TREND_H_
+#define PRESSURE_TREND_H_
+
+#define PRESSURE_DRAIN_PERIOD 1.0        /* Seconds between FIFO reads.  At 10Hz the FIFO holds 3.2s */
+#define PRESSURE_TREND_WINDOW_S 10       /* Seconds in the sliding regression window */
+#define PRESSURE_TREND_MAX_ODR 75        /* Highest output data rate, sizes the window buffer */
+#define PRESSURE_TREND_MIN_SAMPLES_S 5   /* Seconds of data before the trend is used */
+#define PRESSURE_LEAK_RATE -1.0          /* hPa/min.  A faster drop than this is a leak */
+#define PRESSURE_LEAK_PERSIST_S 1        /* Seconds the drop must persist before we flag it */
+#define PRESSURE_STALE_S 5               /* A sample older than this is not returned */
+
+int pressure_trend_init(int odr_hz);
+int pressure_trend_read(int *pressure, short *temperature);
+int pressure_trend_get(double *hpa_per_min);
+int pressure_leak_detected();
+void pressure_trend_add(int pressure);
+void *pressure_trend_process(void * arg);
+void pressure_trend_exit_process();
+
+#endif /* PRESSURE_TREND_H_ */
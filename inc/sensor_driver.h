@@ -0,0 +1,68 @@
+/*
+ * sensor_driver.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * The interface each sensor implements and the registry that reads them.
+ *
+ */
+
+#ifndef SENSOR_DRIVER_H_
+#define SENSOR_DRIVER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define SENSOR_MAX_DRIVERS 16
+
+/* Capabilities.  A driver that needs a value is only read if a driver that provides it
+ * was read without error earlier in the same cycle, so providers must be registered first */
+#define SENSOR_CAP_PROVIDES_TEMP      0x01
+#define SENSOR_CAP_PROVIDES_PRESSURE  0x02
+#define SENSOR_CAP_NEEDS_TEMP         0x04
+#define SENSOR_CAP_NEEDS_PRESSURE     0x08
+
+/* Return values from read() */
+#define SENSOR_READ_OK      0
+#define SENSOR_READ_ERR     1 /* No reading this time, the device stays open */
+#define SENSOR_READ_FAILED  2 /* The device is closed and opened again next cycle */
+
+typedef struct sensor_driver {
+	const char *name;
+	int *enabled;                  /* Flag from the state file */
+	int caps;                      /* SENSOR_CAP_ flags */
+	int gpio_en;                   /* Power enable pin or -1.  Powering off closes the driver */
+	int *warm_up;                  /* Seconds from power on until a reading is valid, or NULL.
+	                                  The power is then switched on only around the reads */
+
+	/* All optional except read and clear */
+	int (*init)(void);             /* Open the device.  EXIT_SUCCESS or EXIT_FAILURE */
+	void *(*process)(void *arg);   /* Background thread, started after init */
+	void (*exit_process)(void);    /* Ask the background thread to exit */
+	int (*read)(uint32_t now);     /* Read into the telemetry.  SENSOR_READ_ */
+	void (*clear)(int valid);      /* Zero the telemetry and set its valid flag */
+	void (*close)(void);
+
+	/* Kept by the registry */
+	int open;
+	int status;                    /* SENSOR_OFF, SENSOR_ON or SENSOR_ERR from the last cycle */
+	pthread_t pthread;
+	uint64_t read_ns;              /* Monotonic time of the middle of the last read */
+	int stats_id;                  /* Reads, errors and latency are kept in sensor_stats */
+	int device_id;                 /* Its health is kept by the device supervisor */
+	int powered;
+	uint32_t power_on_time;
+	int read_since_power_on;
+} sensor_driver_t;
+
+void sensor_registry_init(int gpio_hd);
+int sensor_register(sensor_driver_t *driver);
+void sensors_open();
+uint64_t sensors_read(uint32_t now);
+void sensors_power_schedule(uint32_t now, uint32_t next_cycle);
+void sensors_close();
+
+void sensor_drivers_register(char *curves_file_name);
+
+#endif /* SENSOR_DRIVER_H_ */
@@ -0,0 +1,103 @@
+/*
+ * sensor_stats.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Counters and latency histograms that show where the time goes in a cycle and which
+ * sensors are degrading.  They are updated with atomics, so any thread can update them without a lock.
+ * They are saved each stats period to a text stats file and a binary summary block that
+ * can be sent to the ground.
+ *
+ */
+
+#ifndef SENSOR_STATS_H_
+#define SENSOR_STATS_H_
+
+#include <stdint.h>
+
+#include "storage_quota.h"
+
+#define STATS_MAX_SENSORS 16
+#define STATS_LAT_BUCKETS 12       /* Bucket i counts times under 16us * 4^i.  The last bucket has the rest */
+#define STATS_FILE_NAME "sensors.stats"
+#define STATS_BLOCK_FILE_NAME "sensors_stats.bin"
+
+/* The I2C devices */
+enum {
+	STATS_I2C_ADS1015,
+	STATS_I2C_SHTC3,
+	STATS_I2C_LPS22HB,
+	STATS_I2C_PASCO2,
+	STATS_I2C_DFROBOT,
+	STATS_I2C_QMI8658,
+	STATS_I2C_AK09918,
+	STATS_I2C_TCS34087,
+	STATS_I2C_NUM
+};
+
+/* Event counters */
+enum {
+	STATS_SHTC3_CRC_ERRORS,
+	STATS_DFR_CHECKSUM_ERRORS,
+	STATS_CW1_BYTES,
+	STATS_CW1_LINES,
+	STATS_CW1_BAD_LINES,        /* Lines that could not be parsed */
+	STATS_CW1_DROPPED,          /* Gaps in the event numbers */
+	STATS_CW2_BYTES,
+	STATS_CW2_LINES,
+	STATS_CW2_BAD_LINES,
+	STATS_CW2_DROPPED,
+	STATS_MIC_BYTES,
+	STATS_MIC_ERRORS,
+	STATS_FILE_WRITES,
+	STATS_FILE_ERRORS,
+	STATS_TIME_STEPS,           /* The system clock was stepped */
+	STATS_NUM
+};
+
+typedef struct stats_hist {
+	unsigned int count[STATS_LAT_BUCKETS];
+	unsigned int max_us;
+	unsigned long long total_us;
+} stats_hist_t;
+
+/* The summary block.  Counts are since the program started and stop at their maximum */
+typedef struct __attribute__((__packed__)) sensor_stats_block {
+	uint32_t timestamp;
+	uint32_t uptime;
+	uint8_t num_sensors;
+	struct __attribute__((__packed__)) {
+		uint16_t reads;
+		uint16_t errors;
+		uint16_t max_latency_ms;
+	} sensor[STATS_MAX_SENSORS];
+	uint16_t i2c_failures[STATS_I2C_NUM];
+	uint16_t crc_errors;            /* SHTC3 CRC and DFRobot checksum */
+	uint16_t cw_dropped;            /* Lines lost or not parsed from both detectors */
+	uint16_t mic_errors;
+	uint16_t file_errors;
+	uint16_t file_max_latency_ms;
+	uint8_t quota_state[QUOTA_NUM_STREAMS];
+	uint16_t quota_used_kb[QUOTA_NUM_STREAMS]; /* Queued for the directory */
+	uint8_t devices_failed;         /* Devices waiting to be tried again */
+	uint16_t flicker_frequency;     /* Of the last color read, in 0.1 Hz, 0 for none */
+	uint16_t flicker_depth;         /* In 0.1% */
+	int16_t pressure_trend;         /* In 0.01 hPa/min, 0 until there is a trend */
+	uint8_t pressure_leak;
+} sensor_stats_block_t;
+
+void stats_init();
+uint64_t stats_now_us();
+int stats_sensor_add(const char *name);
+void stats_sensor_read(int id, uint64_t start_us, int ok);
+void stats_sensor_error(int id);
+int stats_i2c(int dev, int rc);
+void stats_count(int counter, unsigned int n);
+void stats_file_io(uint64_t start_us, int ok);
+void stats_cw_event(int cw, unsigned int event_num);
+void stats_flicker(float frequency, float depth);
+void stats_pressure(double hpa_per_min, int leak);
+int stats_save(char *folder, uint32_t now);
+
+#endif /* SENSOR_STATS_H_ */
@@ -0,0 +1,25 @@
+/*
+ * sensors_cal_file.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Calibration values that the sensors program learns while it runs.  These sit next to
+ * the state file but are owned by this program, because iors_control rewrites the
+ * state file from commands and does not know about these keys.
+ *
+ */
+
+#ifndef SENSORS_CAL_FILE_H_
+#define SENSORS_CAL_FILE_H_
+
+#define CAL_FILE_MAX_KEYS 64
+#define CAL_FILE_MAX_KEY_LEN 48
+
+int cal_file_load(char *filename);
+int cal_file_save(char *filename);
+int cal_file_is_dirty();
+double cal_file_get(const char *key, double default_value);
+void cal_file_set(const char *key, double value);
+
+#endif /* SENSORS_CAL_FILE_H_ */
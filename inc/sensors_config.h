@@ -33,6 +33,9 @@
 #define SENSOR_ERR 2
 
 #define MAX_NUMBER_FILE_IO_ERRORS 5
+#define MAX_QUOTA_POLICY_LEN 16
+#define CAPTURE_MAX_TRIGGERS 8
+#define CAPTURE_TRIGGER_LEN 48 /* Characters of an event capture trigger, which is also kept in the capture header */
 
 /* These global variables are not in the config file */
 extern int g_run_self_test;    /* true when the self test is running */
@@ -47,6 +50,30 @@ extern cw_data_t cw_coincident_data;
 extern char g_mic_serial_dev[MAX_FILE_PATH_LEN]; // device name for the serial port for ultrasonic mic
 extern char g_cw1_serial_dev[MAX_FILE_PATH_LEN]; // device name for the serial port for cosmic watch
 extern char g_cw2_serial_dev[MAX_FILE_PATH_LEN]; // device name for the serial port for cosmic watch
+extern int g_co2_measurement_rate; // seconds between CO2 measurements in continuous mode
+extern int g_pressure_odr; // pressure samples per second, 1, 10, 25, 50 or 75
+extern int g_stats_period; // seconds between saves of the stats file, 0 to not save it
+extern int g_mq6_warm_up; // seconds the MQ-6 heater is on before a reading is valid
+extern int g_mq135_warm_up; // seconds the MQ-135 heater is on before a reading is valid
+extern int g_co2_warm_up; // seconds the CO2 sensor is on before a reading is valid
+extern int g_archive_full_records; // samples kept in the full rate archive, 0 for none
+extern int g_archive_minute_records; // minute aggregates kept in the archive, 0 for none
+extern int g_archive_hour_records; // hour aggregates kept in the archive, 0 for none
+extern int g_capture_pre_seconds; // seconds kept before an event capture trigger
+extern int g_capture_post_seconds; // seconds captured after an event capture trigger
+extern char g_capture_triggers[CAPTURE_MAX_TRIGGERS][CAPTURE_TRIGGER_LEN]; // predicates that start an event capture
+extern int g_num_capture_triggers;
+extern int g_log_index_interval; // seconds between the entries in the WOD and CW log indexes, 0 for no index
+extern int g_quota_total_kb; // KB all of the streams can have queued, 0 for no limit
+extern int g_quota_cw_raw_kb; // KB the CW raw log can have queued, 0 for no limit
+extern int g_quota_cw_coincident_kb; // KB the CW coincident log can have queued, 0 for no limit
+extern int g_quota_wod_kb; // KB the WOD can have queued, 0 for no limit
+extern char g_quota_cw_raw_policy[MAX_QUOTA_POLICY_LEN]; // drop_oldest, decimate or pause
+extern char g_quota_cw_coincident_policy[MAX_QUOTA_POLICY_LEN]; // drop_oldest, decimate or pause
+extern char g_quota_wod_policy[MAX_QUOTA_POLICY_LEN]; // drop_oldest, decimate or pause
+extern int g_quota_decimate; // write one record in this many when decimating
+extern int g_supervisor_backoff_min; // seconds before a failed device is first tried again
+extern int g_supervisor_backoff_max; // the longest wait between tries, the wait doubles up to this
 
 void load_config(char *filename);
 
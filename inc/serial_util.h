@@ -8,6 +8,8 @@
 #ifndef SERIAL_UTIL_H_
 #define SERIAL_UTIL_H_
 
+#define SERIAL_POLL_MS 1000 /* The longest wait for a character before read_serial_line returns -2 */
+
 int serial_send_cmd(char *serialdev, speed_t speed, char * data, int len, unsigned char *response, int rlen);
 //int serial_read_data(char *serialdev, speed_t speed, unsigned char *response, int rlen);
 int read_serial_line(char *serialdev, speed_t speed, char *buffer, size_t buffer_size, char line_terminator);
@@ -0,0 +1,56 @@
+/*
+ * storage_quota.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * A quota on the data the CW raw, CW coincident and WOD logs have queued for the directory.
+ * The bytes of each stream are counted in memory as its files are rolled.  The queue
+ * folders are only listed at start up and while a stream is over budget, to find what has
+ * really been ingested.
+ *
+ * When a stream is over its own budget, its policy from the config file applies:
+ *   drop_oldest  the oldest rolled logs of the stream, and their indexes, are removed from
+ *                the queue until it is under budget.  The newest log is always kept
+ *   decimate     only one in quota_decimate records is written
+ *   pause        nothing is written
+ * When the total is over quota_total_kb, every stream but the highest priority one is
+ * paused.  The priority is the order of the streams here, lowest first, so the WOD keeps
+ * going under its own budget.
+ *
+ */
+
+#ifndef STORAGE_QUOTA_H_
+#define STORAGE_QUOTA_H_
+
+/* The streams, lowest priority first */
+enum {
+	QUOTA_CW_RAW,
+	QUOTA_CW_COINCIDENT,
+	QUOTA_WOD,
+	QUOTA_NUM_STREAMS
+};
+
+enum {
+	QUOTA_DROP_OLDEST,
+	QUOTA_DECIMATE,
+	QUOTA_PAUSE
+};
+
+/* The state of a stream, which is reported in the stats */
+enum {
+	QUOTA_OK,
+	QUOTA_DROPPING,                /* Removing old files to stay under budget */
+	QUOTA_DECIMATING,
+	QUOTA_PAUSED
+};
+
+void quota_init(char *data_folder_path);
+int quota_write_allowed(int stream);
+void quota_roll(int stream, long bytes);
+void quota_update();
+int quota_state(int stream);
+const char *quota_name(int stream);
+unsigned int quota_used_kb(int stream);
+
+#endif /* STORAGE_QUOTA_H_ */
@@ -0,0 +1,68 @@
+/*
+ * telem_agg.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Aggregation of the telemetry over a WOD period.  Every sample is added, so the WOD
+ * record has the min, max, mean and standard deviation of each value in the period,
+ * rather than a copy of the last sample.  The accumulator and the record layout are
+ * generated from TELEM_SCHEMA.
+ *
+ * A value is only added when its valid flag is SENSOR_ON.  For each flag the record has
+ * its last value and the number of samples it was SENSOR_ON, which is the number of
+ * samples of the values that go with it.  An array has the mean of each element.
+ *
+ */
+
+#ifndef TELEM_AGG_H_
+#define TELEM_AGG_H_
+
+#include <stdint.h>
+
+#include "telem_schema.h"
+
+#define TELEM_AGG_VERSION (0x80 | TELEM_SCHEMA_VERSION)
+#define TELEM_AGG_COUNT_BITS 16        /* Counts stop at their maximum */
+
+typedef struct telem_stat {
+	uint32_t n;
+	int64_t min;
+	int64_t max;
+	int64_t sum;
+	double sum_sq;
+} telem_stat_t;
+
+#define TELEM_AGG_TIME(name) uint32_t name##_first; uint32_t name##_last; uint32_t samples;
+#define TELEM_AGG_FLAG(name) uint8_t name; uint32_t name##_on;
+#define TELEM_AGG_VALUE(name, bits, valid) telem_stat_t name;
+#define TELEM_AGG_ARRAY(name, n, bits, valid) uint64_t name##_sum[n];
+typedef struct telem_agg {
+	TELEM_SCHEMA(TELEM_AGG_TIME, TELEM_AGG_FLAG, TELEM_AGG_VALUE, TELEM_AGG_VALUE, TELEM_AGG_ARRAY)
+} telem_agg_t;
+
+/* The bit offset of each field in the aggregated record data, after the version byte */
+#define TELEM_AGG_BITS(name, bits) TELEM_AGG_BIT_##name, TELEM_AGG_LAST_##name = TELEM_AGG_BIT_##name + (bits) - 1,
+#define TELEM_AGG_ENUM_TIME(name) \
+	TELEM_AGG_BITS(name##_first, 32) TELEM_AGG_BITS(name##_last, 32) TELEM_AGG_BITS(samples, TELEM_AGG_COUNT_BITS)
+#define TELEM_AGG_ENUM_FLAG(name) \
+	TELEM_AGG_BITS(name, TELEM_FLAG_BITS) TELEM_AGG_BITS(name##_on, TELEM_AGG_COUNT_BITS)
+#define TELEM_AGG_ENUM_VALUE(name, bits, valid) \
+	TELEM_AGG_BITS(name##_min, bits) TELEM_AGG_BITS(name##_max, bits) \
+	TELEM_AGG_BITS(name##_mean, bits) TELEM_AGG_BITS(name##_sd, bits)
+#define TELEM_AGG_ENUM_ARRAY(name, n, bits, valid) TELEM_AGG_BITS(name##_mean, (n) * (bits))
+enum {
+	TELEM_SCHEMA(TELEM_AGG_ENUM_TIME, TELEM_AGG_ENUM_FLAG, TELEM_AGG_ENUM_VALUE, TELEM_AGG_ENUM_VALUE, TELEM_AGG_ENUM_ARRAY)
+	TELEM_AGG_DATA_BITS
+};
+
+#define TELEM_AGG_RECORD_LEN (1 + (TELEM_AGG_DATA_BITS + 7) / 8)
+
+extern const telem_field_t telem_agg_fields[];
+extern const int telem_agg_num_fields;
+
+void telem_agg_reset(telem_agg_t *agg);
+void telem_agg_add(telem_agg_t *agg, const sensor_telemetry_t *telem);
+int telem_agg_encode(const telem_agg_t *agg, uint8_t *record);
+
+#endif /* TELEM_AGG_H_ */
@@ -0,0 +1,53 @@
+/*
+ * telem_archive.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * The on board telemetry archive.  It has three tiers, each a ring of records in a
+ * preallocated file that is memory mapped, so it survives a restart:
+ *   full    every sample, as a telemetry record
+ *   minute  an aggregated record for each minute
+ *   hour    an aggregated record for each hour
+ * The ground asks for a time range from a tier with a line in the request file.  The
+ * matching records are appended to an export file that is added to the directory for
+ * download, like a WOD file.
+ *
+ */
+
+#ifndef TELEM_ARCHIVE_H_
+#define TELEM_ARCHIVE_H_
+
+#include <stdint.h>
+
+#include "telem_schema.h"
+
+#define ARCHIVE_MAGIC "SARC"
+#define ARCHIVE_REQUEST_FILE "sensors_archive.request"   /* Lines of: tier from_time to_time */
+#define ARCHIVE_EXPORT_FILE "sensors_archive"
+
+enum {
+	ARCHIVE_FULL,
+	ARCHIVE_MINUTE,
+	ARCHIVE_HOUR,
+	ARCHIVE_NUM_TIERS
+};
+
+/* At the start of each archive file, followed by capacity records */
+typedef struct __attribute__((__packed__)) telem_archive_header {
+	char magic[4];
+	uint8_t version;               /* The record version byte */
+	uint8_t tier;
+	uint16_t record_len;
+	uint32_t capacity;
+	uint32_t count;                /* Records written.  The newest is at (count - 1) % capacity */
+	uint32_t reserved;
+} telem_archive_header_t;
+
+int telem_archive_open(char *folder);
+void telem_archive_add(const sensor_telemetry_t *telem);
+int telem_archive_export(int tier, uint32_t from, uint32_t to, char *export_path);
+int telem_archive_check_requests(char *folder, char *export_path);
+void telem_archive_close();
+
+#endif /* TELEM_ARCHIVE_H_ */
@@ -0,0 +1,111 @@
+/*
+ * telem_schema.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * The layout of the WOD and archive telemetry records, declared once.  The real time file
+ * stays the raw sensor_telemetry_t, which is what iors_control reads.  The fields of
+ * g_sensor_telemetry are packed into a record with only the bits each one needs, after a
+ * schema version byte.  The encoder, the decoder and the field table for the ground tools
+ * are all generated from TELEM_SCHEMA, so they can not disagree.
+ *
+ * To add a field, add it to TELEM_SCHEMA, then change TELEM_SCHEMA_VERSION and the
+ * TELEM_RECORD_LEN check in telem_schema.c, which will fail to compile until you do.
+ *
+ */
+
+#ifndef TELEM_SCHEMA_H_
+#define TELEM_SCHEMA_H_
+
+#include <stdint.h>
+
+#include "sensor_telemetry.h"
+
+#define TELEM_SCHEMA_VERSION 1
+#define TELEM_FLAG_BITS 2              /* SENSOR_OFF, SENSOR_ON or SENSOR_ERR */
+
+/*
+ * TIME(name)                     the 32 bit sample time
+ * FLAG(name)                     a valid flag
+ * INT(name, bits, valid)         a signed value, limited to the range of bits
+ * UINT(name, bits, valid)        an unsigned value, which keeps its low bits
+ * ARRAY(name, n, bits, valid)    n unsigned values
+ * valid is the flag that is SENSOR_ON when the value is a reading
+ */
+#define TELEM_SCHEMA(TIME, FLAG, INT, UINT, ARRAY) \
+	TIME(timestamp) \
+	FLAG(methane_sensor_valid) \
+	FLAG(air_q_sensor_valid) \
+	FLAG(TempHumidityValid) \
+	FLAG(PressureValid) \
+	FLAG(ImuValid) \
+	FLAG(co2_sensor_valid) \
+	FLAG(o2_sensor_valid) \
+	FLAG(ColorValid) \
+	FLAG(cw_raw_valid) \
+	FLAG(cw_coincident_valid) \
+	FLAG(microphone_valid) \
+	INT(methane_conc, 16, methane_sensor_valid) \
+	INT(air_quality, 16, air_q_sensor_valid) \
+	UINT(SHTC3_temp, 16, TempHumidityValid) \
+	UINT(SHTC3_humidity, 16, TempHumidityValid) \
+	UINT(LPS22_pressure, 24, PressureValid) \
+	INT(LPS22_temp, 16, PressureValid) \
+	INT(AccelerationX, 16, ImuValid) \
+	INT(AccelerationY, 16, ImuValid) \
+	INT(AccelerationZ, 16, ImuValid) \
+	INT(GyroX, 16, ImuValid) \
+	INT(GyroY, 16, ImuValid) \
+	INT(GyroZ, 16, ImuValid) \
+	INT(MagX, 16, ImuValid) \
+	INT(MagY, 16, ImuValid) \
+	INT(MagZ, 16, ImuValid) \
+	INT(IMUTemp, 16, ImuValid) \
+	UINT(CO2_conc, 16, co2_sensor_valid) \
+	INT(O2_conc, 16, o2_sensor_valid) \
+	INT(O2_raw, 16, o2_sensor_valid) \
+	UINT(light_level, 16, ColorValid) \
+	UINT(light_RGB, 24, ColorValid) \
+	UINT(cw_raw_count, 16, cw_raw_valid) \
+	UINT(cw_raw_rate, 16, cw_raw_valid) \
+	UINT(cw_coincident_count, 16, cw_coincident_valid) \
+	UINT(cw_coincident_rate, 16, cw_coincident_valid) \
+	ARRAY(sound_psd, 32, 8, microphone_valid)
+
+/* The bit offset of each field in the record data, after the version byte */
+#define TELEM_ENUM_BITS(name, bits) TELEM_BIT_##name, TELEM_LAST_##name = TELEM_BIT_##name + (bits) - 1,
+#define TELEM_ENUM_TIME(name) TELEM_ENUM_BITS(name, 32)
+#define TELEM_ENUM_FLAG(name) TELEM_ENUM_BITS(name, TELEM_FLAG_BITS)
+#define TELEM_ENUM_VALUE(name, bits, valid) TELEM_ENUM_BITS(name, bits)
+#define TELEM_ENUM_ARRAY(name, n, bits, valid) TELEM_ENUM_BITS(name, (n) * (bits))
+enum {
+	TELEM_SCHEMA(TELEM_ENUM_TIME, TELEM_ENUM_FLAG, TELEM_ENUM_VALUE, TELEM_ENUM_VALUE, TELEM_ENUM_ARRAY)
+	TELEM_DATA_BITS
+};
+
+#define TELEM_RECORD_LEN (1 + (TELEM_DATA_BITS + 7) / 8)
+
+/* A field, for tools that decode a record without the telemetry struct */
+typedef struct telem_field {
+	const char *name;
+	int bit;
+	int bits;
+	int is_signed;
+	int count;                     /* 1 except for an array */
+} telem_field_t;
+
+extern const telem_field_t telem_fields[];
+extern const int telem_num_fields;
+
+int telem_encode(const sensor_telemetry_t *telem, uint8_t *record);
+int telem_decode(const uint8_t *record, int len, sensor_telemetry_t *telem);
+int64_t telem_field_value(const uint8_t *record, const telem_field_t *field, int i);
+
+/* Bit packing, most significant bit first, for the records built from the schema */
+void telem_put_bits(uint8_t *data, int bit, int bits, uint64_t value);
+uint64_t telem_get_bits(const uint8_t *data, int bit, int bits);
+uint64_t telem_limit_signed(int64_t value, int bits);
+int64_t telem_sign_extend(uint64_t value, int bits);
+
+#endif /* TELEM_SCHEMA_H_ */
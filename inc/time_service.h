@@ -0,0 +1,43 @@
+/*
+ * time_service.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * One time base for the samples and events.  Everything is stamped when it arrives with
+ * CLOCK_MONOTONIC in ns, which never jumps, and mapped to UTC with the offset between the
+ * monotonic clock and the system clock.  The offset is tracked by time_service_update()
+ * from the main loop, so a sample stamped before the system clock is set or stepped is
+ * still placed on the new time base.
+ *
+ * Each CosmicWatch stamps its events with its own ms since it started, on a crystal that
+ * drifts.  The detector time of each line is fitted against its arrival time by least
+ * squares over the last TIME_CW_FIT_POINTS lines.  The slope is the drift of the detector
+ * clock.  The arrival times are late by a varying serial and scheduling delay, so the fit
+ * is moved down onto the earliest arrival, which is the one with the least delay.  An
+ * event is then placed on the monotonic clock from its detector time, to about a ms.
+ *
+ */
+
+#ifndef TIME_SERVICE_H_
+#define TIME_SERVICE_H_
+
+#include <stdint.h>
+
+#define TIME_NUM_CW 2
+#define TIME_CW_FIT_POINTS 512         /* Lines in the drift fit */
+#define TIME_CW_MIN_POINTS 8           /* Lines before the fit is used */
+#define TIME_CW_MIN_SPAN_MS 10000      /* Detector time the lines must cover before the fit is used */
+#define TIME_CW_REFIT 8                /* Lines between each fit */
+#define TIME_STEP_NS 100000000LL       /* A change in the UTC offset bigger than this is a step */
+
+void time_service_init();
+void time_service_update();
+uint64_t time_mono_ns();
+uint64_t time_mono_to_utc_ns(uint64_t mono_ns);
+uint64_t time_utc_ms();
+uint64_t time_cw_place(int cw, uint32_t detector_ms, uint64_t arrival_ns);
+int time_cw_fitted(int cw);
+double time_cw_drift_ppm(int cw);
+
+#endif /* TIME_SERVICE_H_ */
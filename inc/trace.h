@@ -0,0 +1,91 @@
+/*
+ * trace.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Span tracing for profiling a cycle.  Each thread writes begin and end records into its
+ * own ring, so a span costs a clock read and a store, with no lock.  The rings are saved
+ * to a binary file on SIGUSR1 and trace_json converts the file to Chrome trace JSON.
+ *
+ * Build with -DTRACE_DISABLE to compile the spans out.
+ *
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define TRACE_RING_SIZE 2048       /* Records in each ring, a power of 2 */
+#define TRACE_MAX_THREADS 16
+#define TRACE_MAX_SPANS 64
+#define TRACE_FILE_NAME "sensors.trace"
+#define TRACE_MAGIC "STRC"
+#define TRACE_VERSION 1
+
+/* Span ids.  Each sensor driver has TRACE_SENSOR + its stats id */
+enum {
+	TRACE_CYCLE,
+	TRACE_SENSORS_READ,
+	TRACE_MIC_READ,
+	TRACE_SAVE_RT,
+	TRACE_SAVE_WOD,
+	TRACE_CW_READ,
+	TRACE_CW_PARSE,
+	TRACE_CW_WRITE,
+	TRACE_STATS_SAVE,
+	TRACE_CAPTURE_WRITE,
+	TRACE_SENSOR = 32
+};
+
+#define TRACE_BEGIN 'B'
+#define TRACE_END 'E'
+
+typedef struct trace_rec {
+	uint64_t ns;
+	uint16_t span;
+	uint8_t type;                  /* TRACE_BEGIN or TRACE_END */
+	uint8_t pad[5];
+} trace_rec_t;
+
+typedef struct trace_ring {
+	unsigned int head;             /* Records written.  Only the owning thread adds to it */
+	int in_use;
+	pid_t tid;
+	trace_rec_t rec[TRACE_RING_SIZE];
+} trace_ring_t;
+
+extern __thread trace_ring_t *trace_thread_ring;
+trace_ring_t *trace_ring_claim();
+
+void trace_init();
+void trace_name(int span, const char *name);
+int trace_dump(char *folder);
+void trace_request_dump(int sig);
+int trace_dump_requested();
+
+#ifdef TRACE_DISABLE
+#define trace_begin(span)
+#define trace_end(span)
+#else
+static inline void trace_record(int span, int type) {
+	trace_ring_t *ring = trace_thread_ring;
+	if (ring == NULL && (ring = trace_ring_claim()) == NULL)
+		return;
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	trace_rec_t *rec = &ring->rec[head & (TRACE_RING_SIZE - 1)];
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec->ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	rec->span = span;
+	rec->type = type;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+#define trace_begin(span) trace_record((span), TRACE_BEGIN)
+#define trace_end(span) trace_record((span), TRACE_END)
+#endif
+
+#endif /* TRACE_H_ */
@@ -80,6 +80,9 @@
 /** Maximum allowed measurement rate */
 #define XENSIV_PASCO2_MEAS_RATE_MAX             (4095U)
 
+/** Change in pressure in hPa before the pressure compensation is updated */
+#define XENSIV_PASCO2_PRESS_REF_DELTA           (2)
+
 /** I2C address of the XENSIV™ PASCO2 sensor */
 #define XENSIV_PASCO2_I2C_ADDR                  (0x28U)
 
@@ -212,7 +215,8 @@ typedef union
   uint8_t u;                                            /*!< Type used for byte access */
 } xensiv_pasco2_meas_status_t;
 
-int xensiv_pasco2_init();
+int xensiv_pasco2_init(uint16_t meas_rate);
+void xensiv_pasco2_close();
 int xensiv_pasco2_read(uint16_t press_ref, uint16_t * co2_ppm_val);
 
 #endif /* XENSIV_PASCO2_H_ */
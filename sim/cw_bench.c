@@ -0,0 +1,442 @@
+/*
+ * cw_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Replays a recorded CosmicWatch capture into a pseudo terminal and runs the real
+ * cw1_listen_process against it.  The lines are sent with the spacing of their time_ms
+ * column divided by the speed.  The event number column is replaced with a sequence
+ * number so each line can be found again in the log.  The log folder is watched with
+ * inotify and each line is matched to the time it was sent.
+ *
+ * The result for each speed is:
+ *   events/s    lines logged per second of the run
+ *   dropped     lines sent that never reached the log
+ *   latency     time from the last byte of the line being written to the pty until the
+ *               line is in the log file, in ms
+ *   cpu/event   CPU time used by the listener thread for each line logged, in us
+ *
+ * Usage: cw_bench [-s speed] [-S] [-n repeat] [-d dir] capture_file
+ *   -s  replay speed, 1 to 1000.  Default 1
+ *   -S  sweep the speeds 1, 2, 5 .. 1000 and print a table, to find where lines are lost
+ *   -n  replay the capture this many times
+ *   -d  folder for the logs, the default is a new folder in /tmp
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "common_config.h"
+#include "iors_command.h"
+#include "sensors_state_file.h"
+#include "sensors_config.h"
+#include "cosmic_watch.h"
+#include "str_util.h"
+
+#define CW_BENCH_MAX_LINE 256
+#define CW_BENCH_DRAIN_S 2.0     /* Time to wait for the last lines once the replay is done */
+#define CW_BENCH_MAX_FILES 4
+
+/* Defined in sensors.c, which is not part of the benchmark */
+int g_verbose = false;
+char g_log_filename[MAX_FILE_PATH_LEN] = "cw_bench.log";
+
+void cw1_exit_listen_process();
+
+typedef struct cw_line {
+	char ms;                 /* M or S */
+	char rest[CW_BENCH_MAX_LINE];   /* The columns after the event number */
+	double t;                /* time_ms column in seconds */
+} cw_line_t;
+
+typedef struct cw_result {
+	double speed;
+	int sent;
+	int logged;
+	double elapsed_s;
+	double lat_min, lat_mean, lat_p50, lat_p99, lat_max;
+	double cpu_us_per_event;
+} cw_result_t;
+
+/* A log file being followed, with the part of a line that has not been ended yet */
+typedef struct cw_tail {
+	char name[MAX_FILE_PATH_LEN];
+	long offset;
+	char line[CW_BENCH_MAX_LINE];
+	int pos;
+} cw_tail_t;
+
+static cw_line_t *lines;
+static int num_lines;
+
+/* Per run state, shared with the tail thread */
+static double *sent_at;      /* Time each sequence number was sent, 0 if not sent */
+static double *logged_at;    /* Time each sequence number reached the log, 0 if not logged */
+static int max_seq;
+static volatile int tail_running;
+static pthread_mutex_t bench_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double now_s() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_until(double t) {
+	double wait = t - now_s();
+	if (wait <= 0) return;
+	struct timespec ts = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+	nanosleep(&ts, NULL);
+}
+
+/**
+ * Load the capture.  Lines end in CR or LF.  Only the data lines are kept, which start
+ * with M or S and have the event number and time_ms columns.
+ */
+static int load_capture(char *filename) {
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		perror(filename);
+		return EXIT_FAILURE;
+	}
+	int size = 1024;
+	lines = malloc(size * sizeof(cw_line_t));
+	char buf[CW_BENCH_MAX_LINE];
+	int pos = 0;
+	int c;
+	while ((c = fgetc(file)) != EOF) {
+		if (c != '\r' && c != '\n') {
+			if (pos < CW_BENCH_MAX_LINE - 1) buf[pos++] = c;
+			continue;
+		}
+		buf[pos] = 0;
+		pos = 0;
+		char ms;
+		int event, time_ms, n = 0;
+		if (sscanf(buf, "%c %d %d %n", &ms, &event, &time_ms, &n) < 3 || (ms != 'M' && ms != 'S'))
+			continue;
+		if (num_lines == size) {
+			size *= 2;
+			lines = realloc(lines, size * sizeof(cw_line_t));
+		}
+		lines[num_lines].ms = ms;
+		snprintf(lines[num_lines].rest, CW_BENCH_MAX_LINE, "%d %s", time_ms, buf + n);
+		lines[num_lines].t = time_ms / 1000.0;
+		num_lines++;
+	}
+	fclose(file);
+	if (num_lines == 0) {
+		fprintf(stderr, "No CosmicWatch data lines in %s\n", filename);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Note the time each new line reached the log.  Lines are split on LF and on the nulls
+ * that pad the start header */
+static void tail_file(char *folder, cw_tail_t *tail) {
+	char path[MAX_FILE_PATH_LEN];
+	strlcpy(path, folder, sizeof(path));
+	strlcat(path, "/", sizeof(path));
+	strlcat(path, tail->name, sizeof(path));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return;
+	lseek(fd, tail->offset, SEEK_SET);
+	char buf[4096];
+	int n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		double t = now_s();
+		tail->offset += n;
+		for (int i=0; i < n; i++) {
+			if (buf[i] != '\n' && buf[i] != 0) {
+				if (tail->pos < CW_BENCH_MAX_LINE - 1) tail->line[tail->pos++] = buf[i];
+				continue;
+			}
+			char *line = tail->line;
+			line[tail->pos] = 0;
+			tail->pos = 0;
+			int seq;
+			if ((line[0] == 'M' || line[0] == 'S') && sscanf(line + 1, "%d", &seq) == 1 && seq >= 0 && seq < max_seq) {
+				pthread_mutex_lock(&bench_mutex);
+				if (logged_at[seq] == 0) logged_at[seq] = t;
+				pthread_mutex_unlock(&bench_mutex);
+			}
+		}
+	}
+	close(fd);
+}
+
+static void *tail_process(void *arg) {
+	char *folder = (char *)arg;
+	cw_tail_t tails[CW_BENCH_MAX_FILES];
+	int num_files = 0;
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	int ifd = inotify_init1(IN_NONBLOCK);
+	if (ifd < 0 || inotify_add_watch(ifd, folder, IN_MODIFY | IN_CREATE) < 0) {
+		perror("inotify");
+		return NULL;
+	}
+	struct pollfd pfd = { ifd, POLLIN, 0 };
+	while (tail_running) {
+		if (poll(&pfd, 1, 100) <= 0) continue;
+		int len = read(ifd, buf, sizeof(buf));
+		for (char *p = buf; p < buf + len; ) {
+			struct inotify_event *event = (struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + event->len;
+			if (event->len == 0) continue;
+			int f;
+			for (f=0; f < num_files; f++)
+				if (strcmp(tails[f].name, event->name) == 0) break;
+			if (f == num_files) {
+				if (num_files == CW_BENCH_MAX_FILES) continue;
+				memset(&tails[f], 0, sizeof(cw_tail_t));
+				strlcpy(tails[f].name, event->name, MAX_FILE_PATH_LEN);
+				num_files++;
+			}
+			tail_file(folder, &tails[f]);
+		}
+	}
+	close(ifd);
+	return NULL;
+}
+
+static int open_pty(char *link, int *slave) {
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		perror("posix_openpt");
+		return -1;
+	}
+	char *slave_name = ptsname(master);
+	*slave = open(slave_name, O_RDWR | O_NOCTTY);
+	struct termios tty;
+	tcgetattr(*slave, &tty);
+	cfmakeraw(&tty);
+	tcsetattr(*slave, TCSANOW, &tty);
+	unlink(link);
+	if (symlink(slave_name, link) != 0) {
+		perror(link);
+		return -1;
+	}
+	return master;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+static int run(double speed, int repeat, char *folder, cw_result_t *result) {
+	char data_folder[MAX_FILE_PATH_LEN];
+	char txt_folder[MAX_FILE_PATH_LEN];
+	char pty_link[MAX_FILE_PATH_LEN];
+	/* Each run logs to its own folder so the sequence numbers only match this run */
+	char run_name[32];
+	snprintf(run_name, sizeof(run_name), "/x%.0f", speed);
+	strlcpy(data_folder, folder, sizeof(data_folder));
+	strlcat(data_folder, run_name, sizeof(data_folder));
+	strlcpy(txt_folder, data_folder, sizeof(txt_folder));
+	strlcat(txt_folder, "/", sizeof(txt_folder));
+	strlcat(txt_folder, get_folder_str(FolderTxt), sizeof(txt_folder));
+	mkdir(data_folder, 0755);
+	mkdir(txt_folder, 0755);
+	strlcpy(pty_link, data_folder, sizeof(pty_link));
+	strlcat(pty_link, "/cw_bench_pty", sizeof(pty_link));
+
+	max_seq = num_lines * repeat;
+	sent_at = calloc(max_seq, sizeof(double));
+	logged_at = calloc(max_seq, sizeof(double));
+
+	int slave;
+	int master = open_pty(pty_link, &slave);
+	if (master < 0) return EXIT_FAILURE;
+	fcntl(master, F_SETFL, O_NONBLOCK);
+	strlcpy(g_cw1_serial_dev, pty_link, sizeof(g_cw1_serial_dev));
+
+	pthread_t tail_pthread, cw_pthread;
+	tail_running = true;
+	pthread_create(&tail_pthread, NULL, tail_process, txt_folder);
+	pthread_create(&cw_pthread, NULL, cw1_listen_process, data_folder);
+	clockid_t cw_clock;
+	pthread_getcpuclockid(cw_pthread, &cw_clock);
+	usleep(200*1000); // Let the listener open the port
+
+	struct timespec cpu_start, cpu_end;
+	clock_gettime(cw_clock, &cpu_start);
+	double start = now_s();
+	double offset = 0;
+	int seq = 0;
+	for (int r=0; r < repeat; r++) {
+		for (int i=0; i < num_lines; i++) {
+			sleep_until(start + offset + (lines[i].t - lines[0].t) / speed);
+			char buf[CW_BENCH_MAX_LINE + 16];
+			int n = snprintf(buf, sizeof(buf), "%c %d %s\r", lines[i].ms, seq, lines[i].rest);
+			int w = write(master, buf, n);
+			pthread_mutex_lock(&bench_mutex);
+			sent_at[seq] = now_s();
+			pthread_mutex_unlock(&bench_mutex);
+			if (w != n && errno != EAGAIN)
+				perror("pty write");
+			seq++;
+		}
+		offset += (lines[num_lines - 1].t - lines[0].t) / speed + 1.0 / speed;
+	}
+
+	/* Wait until nothing new has been logged for the drain time */
+	int logged = -1, last_logged;
+	do {
+		last_logged = logged;
+		sleep_until(now_s() + CW_BENCH_DRAIN_S);
+		logged = 0;
+		pthread_mutex_lock(&bench_mutex);
+		for (int i=0; i < max_seq; i++)
+			if (logged_at[i] != 0) logged++;
+		pthread_mutex_unlock(&bench_mutex);
+	} while (logged != last_logged);
+	clock_gettime(cw_clock, &cpu_end);
+
+	/* Stop the listener.  It is waiting for a line, so keep sending it one until it exits.
+	 * The port is flushed when it is opened, so the first one can be lost */
+	cw1_exit_listen_process();
+	while (pthread_tryjoin_np(cw_pthread, NULL) != 0) {
+		if (write(master, "X\r", 2) != 2 && errno != EAGAIN)
+			perror("pty write");
+		usleep(50*1000);
+	}
+	tail_running = false;
+	pthread_join(tail_pthread, NULL);
+	close(slave);
+	close(master);
+	unlink(pty_link);
+
+	/* Latency of the lines that were logged */
+	double *lat = malloc(max_seq * sizeof(double));
+	double last = start, sum = 0;
+	int n = 0;
+	for (int i=0; i < max_seq; i++) {
+		if (logged_at[i] == 0) continue;
+		lat[n] = (logged_at[i] - sent_at[i]) * 1000;
+		sum += lat[n++];
+		if (logged_at[i] > last) last = logged_at[i];
+	}
+	qsort(lat, n, sizeof(double), cmp_double);
+	double cpu_s = (cpu_end.tv_sec - cpu_start.tv_sec) + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e9;
+
+	memset(result, 0, sizeof(cw_result_t));
+	result->speed = speed;
+	result->sent = max_seq;
+	result->logged = n;
+	result->elapsed_s = last - start;
+	if (n > 0) {
+		result->lat_min = lat[0];
+		result->lat_mean = sum / n;
+		result->lat_p50 = lat[n / 2];
+		result->lat_p99 = lat[(n * 99) / 100];
+		result->lat_max = lat[n - 1];
+		result->cpu_us_per_event = cpu_s * 1e6 / n;
+	}
+	free(lat);
+	free(sent_at);
+	free(logged_at);
+	return EXIT_SUCCESS;
+}
+
+static void print_header() {
+	printf("%7s %7s %7s %9s %8s %8s %8s %8s %8s %8s %10s\n", "speed", "sent", "logged", "events/s", "dropped",
+			"lat_min", "lat_avg", "lat_p50", "lat_p99", "lat_max", "cpu_us/ev");
+}
+
+static void print_result(cw_result_t *r) {
+	printf("%7.0f %7d %7d %9.1f %7.1f%% %8.2f %8.2f %8.2f %8.2f %8.2f %10.1f\n", r->speed, r->sent, r->logged,
+			r->elapsed_s > 0 ? r->logged / r->elapsed_s : 0, 100.0 * (r->sent - r->logged) / r->sent,
+			r->lat_min, r->lat_mean, r->lat_p50, r->lat_p99, r->lat_max, r->cpu_us_per_event);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+	static const double sweep[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+	double speed = 1;
+	int do_sweep = false;
+	int repeat = 1;
+	char data_folder[MAX_FILE_PATH_LEN] = "";
+	int opt;
+	while ((opt = getopt(argc, argv, "s:Sn:d:h")) != -1) {
+		switch (opt) {
+		case 's':
+			speed = atof(optarg);
+			break;
+		case 'S':
+			do_sweep = true;
+			break;
+		case 'n':
+			repeat = atoi(optarg);
+			break;
+		case 'd':
+			strlcpy(data_folder, optarg, sizeof(data_folder));
+			break;
+		default:
+			printf("Usage: cw_bench [-s speed] [-S] [-n repeat] [-d dir] capture_file\n");
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind >= argc || speed < 1 || speed > 1000 || repeat < 1) {
+		printf("Usage: cw_bench [-s speed] [-S] [-n repeat] [-d dir] capture_file\n");
+		return EXIT_FAILURE;
+	}
+	if (load_capture(argv[optind]) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	if (data_folder[0] == 0) {
+		strlcpy(data_folder, "/tmp/cw_bench_XXXXXX", sizeof(data_folder));
+		if (mkdtemp(data_folder) == NULL) {
+			perror(data_folder);
+			return EXIT_FAILURE;
+		}
+	}
+	/* Log every line to the same file so it is not rolled during the run */
+	g_state_sensors_cw_raw_max_file_size_in_kb = 1024*1024;
+	g_state_sensors_cw_coincident_max_file_size_in_kb = 1024*1024;
+
+	printf("Replaying %d lines from %s, logs in %s\n", num_lines, argv[optind], data_folder);
+	print_header();
+	cw_result_t result;
+	if (do_sweep) {
+		for (unsigned int i=0; i < sizeof(sweep)/sizeof(sweep[0]); i++) {
+			if (run(sweep[i], repeat, data_folder, &result) != EXIT_SUCCESS)
+				return EXIT_FAILURE;
+			print_result(&result);
+		}
+	} else {
+		if (run(speed, repeat, data_folder, &result) != EXIT_SUCCESS)
+			return EXIT_FAILURE;
+		print_result(&result);
+	}
+	free(lines);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+/*
+ * lgpio.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * The part of the lgpio API that the sensors program uses, with the same prototypes
+ * as the real library.  The simulator implements it.  Put this folder first in the
+ * include path to build without lgpio installed.
+ *
+ */
+
+#ifndef LGPIO_H
+#define LGPIO_H
+
+#include <stdint.h>
+
+#define LG_OKAY                 0
+#define LG_BAD_HANDLE          -5
+#define LG_I2C_OPEN_FAILED    -80
+#define LG_I2C_WRITE_FAILED   -82
+#define LG_I2C_READ_FAILED    -83
+
+#define LG_SET_ACTIVE_LOW       4
+#define LG_SET_OPEN_DRAIN       8
+#define LG_SET_OPEN_SOURCE     16
+#define LG_SET_PULL_UP         32
+#define LG_SET_PULL_DOWN       64
+#define LG_SET_PULL_NONE      128
+
+#define LG_I2C_M_RD        0x0001
+
+typedef struct {
+	uint16_t addr;
+	uint16_t flags;
+	uint16_t len;
+	uint8_t *buf;
+} lgI2cMsg_t;
+
+int lgGpiochipOpen(int gpioDev);
+int lgGpiochipClose(int handle);
+int lgGpioClaimOutput(int handle, int lFlags, int gpio, int level);
+int lgGpioClaimInput(int handle, int lFlags, int gpio);
+int lgGpioFree(int handle, int gpio);
+int lgGpioRead(int handle, int gpio);
+int lgGpioWrite(int handle, int gpio, int level);
+
+int lgI2cOpen(int i2cDev, int i2cAddr, int i2cFlags);
+int lgI2cClose(int handle);
+int lgI2cWriteQuick(int handle, int bitVal);
+int lgI2cWriteByte(int handle, int byteVal);
+int lgI2cReadByte(int handle);
+int lgI2cWriteByteData(int handle, int i2cReg, int byteVal);
+int lgI2cWriteWordData(int handle, int i2cReg, int wordVal);
+int lgI2cReadByteData(int handle, int i2cReg);
+int lgI2cReadWordData(int handle, int i2cReg);
+int lgI2cReadI2CBlockData(int handle, int i2cReg, char *rxBuf, int count);
+int lgI2cWriteI2CBlockData(int handle, int i2cReg, const char *txBuf, int count);
+int lgI2cReadDevice(int handle, char *rxBuf, int count);
+int lgI2cWriteDevice(int handle, const char *txBuf, int count);
+int lgI2cSegments(int handle, lgI2cMsg_t *segs, int numSegs);
+
+void lguSleep(double sleepSecs);
+double lguTime(void);
+uint64_t lguTimestamp(void);
+
+#endif /* LGPIO_H */
@@ -0,0 +1,77 @@
+/*
+ * log_extract.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Copy the records of a WOD or CosmicWatch log in a time range to stdout, with the index
+ * that was written next to it.  The range is rounded out to the index entries either side.
+ * The output of a WOD log can be piped to telem_decode.
+ *
+ * Usage: log_extract log_file index_file from_time to_time > part
+ *        The times are seconds since the epoch.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log_index.h"
+
+int g_log_index_interval = 0; /* Only used when writing an index */
+
+int main(int argc, char *argv[]) {
+	if (argc != 5) {
+		fprintf(stderr, "Usage: log_extract log_file index_file from_time to_time > part\n");
+		return EXIT_FAILURE;
+	}
+	char *index_file = argv[2];
+	uint32_t from = strtoul(argv[3], NULL, 10);
+	uint32_t to = strtoul(argv[4], NULL, 10);
+
+	log_index_header_t h;
+	long start, end;
+	memset(&h, 0, sizeof(h));
+	int rc = log_index_find(index_file, from, to, &h, &start, &end);
+	if (h.entries > 0)
+		fprintf(stderr, "%s has %u records from %u to %u, %u index entries every %u s\n", argv[1],
+				h.count, h.first_time, h.last_time, h.entries, h.interval);
+	if (rc != EXIT_SUCCESS) {
+		fprintf(stderr, "No records from %u to %u in the index %s\n", from, to, index_file);
+		return EXIT_FAILURE;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if (file == NULL || fseek(file, start, SEEK_SET) != 0) {
+		fprintf(stderr, "Could not read %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	char buf[4096];
+	long left = end < 0 ? -1 : end - start;
+	long n = 0;
+	while (left != 0) {
+		size_t want = (left < 0 || left > (long)sizeof(buf)) ? sizeof(buf) : (size_t)left;
+		size_t got = fread(buf, 1, want, file);
+		if (got == 0) break;
+		fwrite(buf, 1, got, stdout);
+		n += got;
+		if (left > 0) left -= got;
+	}
+	fclose(file);
+	fprintf(stderr, "Copied %ld bytes from offset %ld\n", n, start);
+	return EXIT_SUCCESS;
+}
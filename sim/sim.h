@@ -0,0 +1,57 @@
+/*
+ * sim.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Hardware simulator.  The devices on the I2C bus are modeled at the byte level, so the
+ * real drivers run unchanged against them.
+ *
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+
+#define SIM_CONFIG_FILE "sim.config"   /* Override with the SIM_CONFIG environment variable */
+#define SIM_MAX_GPIO 64
+#define SIM_NACK -1
+
+/* The environment the sensors measure.  Loaded from the sim config file */
+typedef struct sim_env {
+	double temp_c;
+	double rh_pct;
+	double pressure_hpa;
+	double leak_hpa_per_min;     /* Pressure change, negative for a leak */
+	double co2_ppm;
+	double o2_pct;
+	double methane_mv;
+	double air_q_mv;
+	double bus_mv;
+	double lux;
+	double flicker_hz;
+	double flicker_depth;        /* 0 to 1 */
+	double mag_ut[3];
+	double noise;                /* Scales the noise on every reading, 0 for none */
+} sim_env_t;
+
+extern sim_env_t sim_env;
+
+typedef struct sim_device {
+	const char *name;
+	uint8_t addr;
+	int power_gpio;              /* Enable pin, or -1 if always powered */
+	void (*power_on)(struct sim_device *d);
+	int (*write)(struct sim_device *d, const uint8_t *buf, int len);   /* 0 or SIM_NACK */
+	int (*read)(struct sim_device *d, uint8_t *buf, int len);          /* len or SIM_NACK */
+	int powered;
+} sim_device_t;
+
+void sim_init();
+double sim_time();
+double sim_noise(double sd);
+int sim_gpio_level(int gpio);
+sim_device_t *sim_device_find(int addr);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,692 @@
+/*
+ * sim_devices.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Models of the devices on the sensor board.  Each one has the register map the driver
+ * uses and the timing that matters to it:
+ * - ADS1015 ADC, single shot conversions that take 1/data rate
+ * - SHTC3, sleep and wakeup, and a NACK until the measurement is done
+ * - LPS22HB, the 32 sample FIFO filled at the output data rate
+ * - PAS CO2, boot time after power on or reset, and continuous mode measurements
+ * - QMI8658 and AK09918 IMU
+ * - TCS34087, ALS integration time and the flicker FIFO
+ * The values come from sim_env with noise added.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim.h"
+#include "AD.h"
+#include "SHTC3.h"
+#include "LPS22HB.h"
+#include "xensiv_pasco2_regs.h"
+#include "xensiv_pasco2.h"
+#include "IMU.h"
+#include "TCS34087.h"
+#include "o2_cal.h"
+#include "sensors_gpio.h"
+
+/* Registers for a device with an address pointer that increments on each byte */
+typedef struct reg_state {
+	uint8_t regs[256];
+	uint8_t ptr;
+} reg_state_t;
+
+/************************************************************************************
+ * ADS1015 12 bit ADC.  The result is left justified in a 16 bit register
+ */
+#define ADS_CONFIG_DEFAULT 0x8583
+/* The channels as wired on the sensor board, see sensor_drivers.c */
+#define ADS_CHAN_METHANE 0
+#define ADS_CHAN_AIR_QUALITY 1
+#define ADS_CHAN_O2 2
+static const double ads_rate[8] = { 128, 250, 490, 920, 1600, 2400, 3300, 3300 };
+static const double ads_fs_mv[8] = { 6144, 4096, 2048, 1024, 512, 256, 256, 256 };
+static struct {
+	uint16_t reg[4];
+	uint8_t ptr;
+	double done;           /* Time the conversion finishes, 0 if none is running */
+} ads;
+
+static double ads_channel_mv(int chan) {
+	switch (chan) {
+	case ADS_CHAN_METHANE:
+		return sim_gpio_level(SENSORS_GPIO_MQ6_EN) ? sim_env.methane_mv + sim_noise(2) : 0;
+	case ADS_CHAN_AIR_QUALITY:
+		return sim_gpio_level(SENSORS_GPIO_MQ135_EN) ? sim_env.air_q_mv + sim_noise(2) : 0;
+	case ADS_CHAN_O2:
+		/* Invert the default PS1 calibration */
+		return (sim_env.o2_pct + sim_noise(0.02) - O2_CAL_DEFAULT_OFFSET
+				+ O2_CAL_DEFAULT_TEMPCO * (sim_env.temp_c - O2_CAL_DEFAULT_TREF)) / O2_CAL_DEFAULT_SLOPE;
+	default:
+		return sim_env.bus_mv + sim_noise(1);
+	}
+}
+
+static void ads_update() {
+	if (ads.done == 0 || sim_time() < ads.done) return;
+	uint16_t cfg = ads.reg[ADS_POINTER_CONFIG];
+	int mux = (cfg >> 12) & 0x7;
+	double mv = mux >= 4 ? ads_channel_mv(mux - 4) : 0;
+	double code = mv / ads_fs_mv[(cfg >> 9) & 0x7] * 2048;
+	if (code > 2047) code = 2047;
+	if (code < -2048) code = -2048;
+	ads.reg[ADS_POINTER_CONVERT] = ((int16_t)code) << 4;
+	ads.reg[ADS_POINTER_CONFIG] |= ADS_CONFIG_OS_NOBUSY;
+	ads.done = 0;
+}
+
+static void ads_power_on(sim_device_t *d) {
+	memset(&ads, 0, sizeof(ads));
+	ads.reg[ADS_POINTER_CONFIG] = ADS_CONFIG_DEFAULT;
+}
+
+static int ads_write(sim_device_t *d, const uint8_t *buf, int len) {
+	if (len < 1) return 0;
+	ads.ptr = buf[0] & 0x3;
+	if (len < 3) return 0;
+	uint16_t val = (buf[1] << 8) | buf[2];
+	ads_update();
+	if (ads.ptr == ADS_POINTER_CONFIG) {
+		ads.reg[ADS_POINTER_CONFIG] = val & ~ADS_CONFIG_OS_NOBUSY;
+		if ((val & ADS_CONFIG_OS_SINGLE_CONVERT) || !(val & ADS_CONFIG_MODE_NOCONTINUOUS))
+			ads.done = sim_time() + 1.0 / ads_rate[(val >> 5) & 0x7];
+		else
+			ads.reg[ADS_POINTER_CONFIG] |= ADS_CONFIG_OS_NOBUSY;
+	} else if (ads.ptr != ADS_POINTER_CONVERT) {
+		ads.reg[ads.ptr] = val;
+	}
+	return 0;
+}
+
+static int ads_read(sim_device_t *d, uint8_t *buf, int len) {
+	ads_update();
+	uint16_t val = ads.reg[ads.ptr];
+	for (int i=0; i < len; i++)
+		buf[i] = (i % 2 == 0) ? val >> 8 : val & 0xff;
+	return len;
+}
+
+/************************************************************************************
+ * SHTC3.  16 bit commands.  It must be woken before a command and a read NACKs until
+ * the measurement is done
+ */
+static struct {
+	int awake;
+	double done;
+	int low_power;
+	uint8_t result[6];
+	int measured;
+} shtc3;
+
+static uint8_t shtc3_crc(const uint8_t *data, int len) {
+	uint8_t crc = 0xFF;
+	for (int i=0; i < len; i++) {
+		crc ^= data[i];
+		for (int bit=8; bit > 0; --bit)
+			crc = (crc & 0x80) ? (crc << 1) ^ (CRC_POLYNOMIAL & 0xff) : (crc << 1);
+	}
+	return crc;
+}
+
+static void shtc3_power_on(sim_device_t *d) {
+	memset(&shtc3, 0, sizeof(shtc3));
+}
+
+static int shtc3_write(sim_device_t *d, const uint8_t *buf, int len) {
+	if (len != 2) return SIM_NACK;
+	uint16_t cmd = (buf[0] << 8) | buf[1];
+	if (cmd == SHTC3_WakeUp) {
+		shtc3.awake = 1;
+		return 0;
+	}
+	if (!shtc3.awake) return SIM_NACK;
+	switch (cmd) {
+	case SHTC3_Sleep:
+		shtc3.awake = 0;
+		break;
+	case SHTC3_Software_RES:
+		shtc3.measured = 0;
+		break;
+	case SHTC3_NM_CD_ReadTH:
+	case SHTC3_LM_CD_ReadTH: {
+		shtc3.low_power = cmd == SHTC3_LM_CD_ReadTH;
+		shtc3.done = sim_time() + (shtc3.low_power ? SHTC3_LP_MEAS_TIME_TYP : SHTC3_NM_MEAS_TIME_TYP);
+		double noise = shtc3.low_power ? 4 : 1;
+		double t = sim_env.temp_c + sim_noise(0.02 * noise);
+		double rh = sim_env.rh_pct + sim_noise(0.1 * noise);
+		uint16_t traw = (uint16_t)((t + 45) * 65536 / 175);
+		uint16_t rhraw = (uint16_t)(rh * 65536 / 100);
+		shtc3.result[0] = traw >> 8;
+		shtc3.result[1] = traw & 0xff;
+		shtc3.result[2] = shtc3_crc(&shtc3.result[0], 2);
+		shtc3.result[3] = rhraw >> 8;
+		shtc3.result[4] = rhraw & 0xff;
+		shtc3.result[5] = shtc3_crc(&shtc3.result[3], 2);
+		shtc3.measured = 1;
+		break;
+	}
+	default:
+		return SIM_NACK;
+	}
+	return 0;
+}
+
+static int shtc3_read(sim_device_t *d, uint8_t *buf, int len) {
+	if (!shtc3.awake || !shtc3.measured || sim_time() < shtc3.done)
+		return SIM_NACK;
+	if (len > 6) len = 6;
+	memcpy(buf, shtc3.result, len);
+	shtc3.measured = 0;
+	return len;
+}
+
+/************************************************************************************
+ * LPS22HB.  In continuous mode a sample is added to the FIFO at the output data rate.
+ * In stream mode the oldest sample is lost when it is full.  A multi byte read of the
+ * output registers pops one sample for each five bytes
+ */
+static const double lps_odr[8] = { 0, 1, 10, 25, 50, 75, 0, 0 };
+static struct {
+	reg_state_t r;
+	int fifo_p[LPS_FIFO_SIZE];
+	short fifo_t[LPS_FIFO_SIZE];
+	int head;
+	int count;
+	int ovr;
+	double next;            /* Time of the next sample */
+	double odr;
+} lps;
+
+static void lps_reset() {
+	memset(&lps, 0, sizeof(lps));
+	lps.r.regs[LPS_WHO_AM_I] = LPS_ID;
+	lps.r.regs[LPS_CTRL_REG2] = LPS_CTRL_REG2_IF_ADD_INC;
+}
+
+static void lps_power_on(sim_device_t *d) {
+	lps_reset();
+}
+
+static void lps_sample(double t) {
+	double hpa = sim_env.pressure_hpa + sim_env.leak_hpa_per_min * t / 60.0 + sim_noise(0.01);
+	int p = (int)(hpa * LPS_LSB_PER_HPA);
+	short temp = (short)((sim_env.temp_c + 1.5 + sim_noise(0.01)) * LPS_LSB_PER_DEGC);
+	int tail = (lps.head + lps.count) % LPS_FIFO_SIZE;
+	if (lps.count == LPS_FIFO_SIZE) {
+		lps.head = (lps.head + 1) % LPS_FIFO_SIZE;
+		lps.ovr = 1;
+	} else {
+		lps.count++;
+	}
+	lps.fifo_p[tail] = p;
+	lps.fifo_t[tail] = temp;
+}
+
+static void lps_update() {
+	if (lps.odr == 0) return;
+	double now = sim_time();
+	while (lps.next <= now) {
+		lps_sample(lps.next);
+		lps.next += 1.0 / lps.odr;
+	}
+	if (lps.count > 0) {
+		int last = (lps.head + lps.count - 1) % LPS_FIFO_SIZE;
+		uint8_t *o = &lps.r.regs[LPS_PRESS_OUT_XL];
+		o[0] = lps.fifo_p[last] & 0xff;
+		o[1] = (lps.fifo_p[last] >> 8) & 0xff;
+		o[2] = (lps.fifo_p[last] >> 16) & 0xff;
+		o[3] = lps.fifo_t[last] & 0xff;
+		o[4] = (lps.fifo_t[last] >> 8) & 0xff;
+	}
+	lps.r.regs[LPS_FIFO_STATUS] = lps.count | (lps.ovr ? LPS_FIFO_STATUS_OVR : 0)
+			| (lps.count == LPS_FIFO_SIZE ? 0x80 : 0);
+}
+
+static int lps_write(sim_device_t *d, const uint8_t *buf, int len) {
+	if (len < 1) return 0;
+	lps.r.ptr = buf[0];
+	for (int i=1; i < len; i++) {
+		uint8_t reg = lps.r.ptr++;
+		switch (reg) {
+		case LPS_CTRL_REG1: {
+			lps_update();
+			lps.r.regs[reg] = buf[i];
+			double odr = lps_odr[(buf[i] >> 4) & 0x7];
+			if (odr != lps.odr) {
+				lps.odr = odr;
+				lps.next = sim_time() + (odr > 0 ? 1.0 / odr : 0);
+			}
+			break;
+		}
+		case LPS_CTRL_REG2:
+			if (buf[i] & 0x04) {
+				lps_reset();
+				return 0;
+			}
+			lps.r.regs[reg] = buf[i] & ~0x01;
+			break;
+		case LPS_FIFO_CTRL:
+			lps.r.regs[reg] = buf[i];
+			if ((buf[i] & 0xE0) == 0) { // Bypass empties the FIFO
+				lps.count = 0;
+				lps.ovr = 0;
+			}
+			break;
+		case LPS_WHO_AM_I:
+		case LPS_FIFO_STATUS:
+		case LPS_STATUS:
+			break;
+		default:
+			lps.r.regs[reg] = buf[i];
+		}
+	}
+	return 0;
+}
+
+static int lps_read(sim_device_t *d, uint8_t *buf, int len) {
+	lps_update();
+	int fifo = (lps.r.regs[LPS_CTRL_REG2] & LPS_CTRL_REG2_FIFO_EN) && (lps.r.regs[LPS_FIFO_CTRL] & 0xE0);
+	if (lps.r.ptr == LPS_PRESS_OUT_XL && fifo) {
+		int i = 0;
+		while (i < len) {
+			int p = lps.fifo_p[lps.head];
+			short t = lps.fifo_t[lps.head];
+			uint8_t s[LPS_SAMPLE_LEN] = { p & 0xff, (p >> 8) & 0xff, (p >> 16) & 0xff, t & 0xff, (t >> 8) & 0xff };
+			for (int k=0; k < LPS_SAMPLE_LEN && i < len; k++)
+				buf[i++] = s[k];
+			if (lps.count > 0) {
+				lps.head = (lps.head + 1) % LPS_FIFO_SIZE;
+				lps.count--;
+				lps.ovr = 0;
+			}
+		}
+		lps_update();
+		return len;
+	}
+	for (int i=0; i < len; i++)
+		buf[i] = lps.r.regs[lps.r.ptr++];
+	return len;
+}
+
+/************************************************************************************
+ * Infineon PAS CO2.  It is not ready until it has booted after power on or a soft
+ * reset.  In continuous mode a result is ready once per measurement period
+ */
+#define PASCO2_BOOT_TIME 0.5
+#define PASCO2_MEAS_TIME 1.2
+static struct {
+	reg_state_t r;
+	double ready;           /* Time the sensor is ready after boot */
+	double next;            /* Time the next continuous measurement is done, 0 if idle */
+} pasco2;
+
+static void pasco2_boot() {
+	memset(&pasco2, 0, sizeof(pasco2));
+	pasco2.r.regs[XENSIV_PASCO2_REG_PROD_ID] = 0x42;
+	pasco2.r.regs[XENSIV_PASCO2_REG_MEAS_RATE_L] = 10;
+	pasco2.r.regs[XENSIV_PASCO2_REG_PRESS_REF_H] = 1015 >> 8;
+	pasco2.r.regs[XENSIV_PASCO2_REG_PRESS_REF_L] = 1015 & 0xff;
+	pasco2.ready = sim_time() + PASCO2_BOOT_TIME;
+}
+
+static void pasco2_power_on(sim_device_t *d) {
+	pasco2_boot();
+}
+
+static void pasco2_update() {
+	double now = sim_time();
+	uint8_t *regs = pasco2.r.regs;
+	regs[XENSIV_PASCO2_REG_SENS_STS] = now >= pasco2.ready ? 0xC0 : 0x40;
+	if (pasco2.next == 0 || now < pasco2.next) return;
+	uint16_t rate = (regs[XENSIV_PASCO2_REG_MEAS_RATE_H] << 8) | regs[XENSIV_PASCO2_REG_MEAS_RATE_L];
+	if (rate < XENSIV_PASCO2_MEAS_RATE_MIN) rate = XENSIV_PASCO2_MEAS_RATE_MIN;
+	uint16_t ppm = (uint16_t)(sim_env.co2_ppm + sim_noise(30));
+	regs[XENSIV_PASCO2_REG_CO2PPM_H] = ppm >> 8;
+	regs[XENSIV_PASCO2_REG_CO2PPM_L] = ppm & 0xff;
+	regs[XENSIV_PASCO2_REG_MEAS_STS] |= XENSIV_PASCO2_REG_MEAS_STS_DRDY_MSK;
+	while (pasco2.next <= now)
+		pasco2.next += rate;
+}
+
+static int pasco2_write(sim_device_t *d, const uint8_t *buf, int len) {
+	if (len < 1) return 0;
+	pasco2_update();
+	pasco2.r.ptr = buf[0];
+	for (int i=1; i < len; i++) {
+		uint8_t reg = pasco2.r.ptr++;
+		switch (reg) {
+		case XENSIV_PASCO2_REG_SENS_RST:
+			if (buf[i] == XENSIV_PASCO2_CMD_SOFT_RESET) {
+				pasco2_boot();
+				return 0;
+			}
+			break;
+		case XENSIV_PASCO2_REG_MEAS_CFG: {
+			pasco2.r.regs[reg] = buf[i];
+			int mode = buf[i] & XENSIV_PASCO2_REG_MEAS_CFG_OP_MODE_MSK;
+			if (mode == XENSIV_PASCO2_OP_MODE_IDLE)
+				pasco2.next = 0;
+			else
+				pasco2.next = sim_time() + PASCO2_MEAS_TIME;
+			break;
+		}
+		case XENSIV_PASCO2_REG_PROD_ID:
+		case XENSIV_PASCO2_REG_SENS_STS:
+		case XENSIV_PASCO2_REG_CO2PPM_H:
+		case XENSIV_PASCO2_REG_CO2PPM_L:
+			break;
+		case XENSIV_PASCO2_REG_MEAS_STS:
+			pasco2.r.regs[reg] &= ~((buf[i] & 0x03) << 2); // Write one to the CLR bits
+			break;
+		default:
+			pasco2.r.regs[reg] = buf[i];
+		}
+	}
+	return 0;
+}
+
+static int pasco2_read(sim_device_t *d, uint8_t *buf, int len) {
+	pasco2_update();
+	for (int i=0; i < len; i++) {
+		uint8_t reg = pasco2.r.ptr++;
+		buf[i] = pasco2.r.regs[reg];
+		if (reg == XENSIV_PASCO2_REG_CO2PPM_L)
+			pasco2.r.regs[XENSIV_PASCO2_REG_MEAS_STS] &= ~XENSIV_PASCO2_REG_MEAS_STS_DRDY_MSK;
+	}
+	return len;
+}
+
+/************************************************************************************
+ * QMI8658 accelerometer and gyroscope, still on a bench
+ */
+static struct {
+	reg_state_t r;
+} qmi;
+
+static void qmi_power_on(sim_device_t *d) {
+	memset(&qmi, 0, sizeof(qmi));
+	qmi.r.regs[QMI8658Register_WhoAmI] = 0x05;
+	qmi.r.regs[QMI8658Register_Revision] = 0x7C;
+}
+
+static void qmi_put16(int reg, double val) {
+	if (val > 32767) val = 32767;
+	if (val < -32768) val = -32768;
+	short v = (short)val;
+	qmi.r.regs[reg] = v & 0xff;
+	qmi.r.regs[reg + 1] = (v >> 8) & 0xff;
+}
+
+static void qmi_update() {
+	double acc_lsb = 16384 >> ((qmi.r.regs[QMI8658Register_Ctrl2] >> 4) & 0x7);
+	double gyr_lsb = 2048 >> ((qmi.r.regs[QMI8658Register_Ctrl3] >> 4) & 0x7);
+	qmi_put16(QMI8658Register_Tempearture_L, (sim_env.temp_c + 2 + sim_noise(0.05)) * 256);
+	qmi_put16(QMI8658Register_Ax_L, acc_lsb * sim_noise(0.002));
+	qmi_put16(QMI8658Register_Ax_L + 2, acc_lsb * sim_noise(0.002));
+	qmi_put16(QMI8658Register_Ax_L + 4, acc_lsb * (1.0 + sim_noise(0.002)));
+	qmi_put16(QMI8658Register_Gx_L, gyr_lsb * (0.2 + sim_noise(0.05)));
+	qmi_put16(QMI8658Register_Gx_L + 2, gyr_lsb * (-0.1 + sim_noise(0.05)));
+	qmi_put16(QMI8658Register_Gx_L + 4, gyr_lsb * (0.05 + sim_noise(0.05)));
+}
+
+static int qmi_write(sim_device_t *d, const uint8_t *buf, int len) {
+	if (len < 1) return 0;
+	qmi.r.ptr = buf[0];
+	for (int i=1; i < len; i++) {
+		uint8_t reg = qmi.r.ptr++;
+		if (reg > QMI8658Register_Revision)
+			qmi.r.regs[reg] = buf[i];
+	}
+	return 0;
+}
+
+static int qmi_read(sim_device_t *d, uint8_t *buf, int len) {
+	qmi_update();
+	for (int i=0; i < len; i++)
+		buf[i] = qmi.r.regs[qmi.r.ptr++];
+	return len;
+}
+
+/************************************************************************************
+ * AK09918 magnetometer.  0.15uT per LSB.  Reading ST2 ends the data read
+ */
+#define AK09918_UT_PER_LSB 0.15
+static struct {
+	reg_state_t r;
+} ak;
+
+static void ak_power_on(sim_device_t *d) {
+	memset(&ak, 0, sizeof(ak));
+	ak.r.regs[AK09918_WIA1] = 0x48;
+	ak.r.regs[AK09918_WIA2] = 0x0C;
+}
+
+static void ak_update() {
+	if (ak.r.regs[AK09918_CNTL2] == 0) return;
+	for (int i=0; i < 3; i++) {
+		short v = (short)((sim_env.mag_ut[i] + sim_noise(0.3)) / AK09918_UT_PER_LSB);
+		ak.r.regs[AK09918_HXL + 2*i] = v & 0xff;
+		ak.r.regs[AK09918_HXL + 2*i + 1] = (v >> 8) & 0xff;
+	}
+	ak.r.regs[AK09918_ST1] = 0x01; // DRDY
+}
+
+static int ak_write(sim_device_t *d, const uint8_t *buf, int len) {
+	if (len < 1) return 0;
+	ak.r.ptr = buf[0];
+	for (int i=1; i < len; i++) {
+		uint8_t reg = ak.r.ptr++;
+		if (reg >= AK09918_CNTL2)
+			ak.r.regs[reg] = buf[i];
+	}
+	return 0;
+}
+
+static int ak_read(sim_device_t *d, uint8_t *buf, int len) {
+	if (ak.r.ptr == AK09918_HXL || ak.r.ptr == AK09918_ST1)
+		ak_update();
+	for (int i=0; i < len; i++) {
+		uint8_t reg = ak.r.ptr++;
+		buf[i] = ak.r.regs[reg];
+		if (reg == AK09918_ST2)
+			ak.r.regs[AK09918_ST1] = 0;
+	}
+	return len;
+}
+
+/************************************************************************************
+ * TCS34087 color sensor.  A result is valid one integration time after the ALS is
+ * enabled or its settings change.  The flicker samples go to a 128 sample FIFO
+ */
+#define TCS_ASTEP_S 2.78e-6
+#define TCS_FD_STEP_S 1.389e-6
+static struct {
+	reg_state_t r;
+	double start;            /* Start of the current integration */
+	uint16_t fifo[TCS34087_FIFO_SIZE];
+	int fifo_count;
+	double fd_next;
+} tcs;
+
+static double tcs_gain(int code) {
+	code &= 0x1f;
+	return code == 0 ? 0.5 : (double)(1 << (code - 1));
+}
+
+static int tcs_astep() {
+	return tcs.r.regs[TCS34087_ASTEPL] | (tcs.r.regs[TCS34087_ASTEPL + 1] << 8);
+}
+
+static double tcs_integration_s() {
+	return (tcs.r.regs[TCS34087_ATIME] + 1) * (tcs_astep() + 1) * TCS_ASTEP_S;
+}
+
+static double tcs_fd_period() {
+	int fd_time = tcs.r.regs[TCS34087_FD_CFG1] | ((tcs.r.regs[TCS34087_FD_CFG3] & 0x07) << 8);
+	return (fd_time + 1) * TCS_FD_STEP_S;
+}
+
+static int tcs_fd_enabled() {
+	return (tcs.r.regs[TCS34087_ENABLE] & TCS34087_ENABLE_FDEN) && (tcs.r.regs[TCS34087_FD_CFG0] & TCS34087_FD_CFG0_FIFO_WRITE_FD);
+}
+
+static void tcs_restart() {
+	tcs.start = sim_time();
+	tcs.r.regs[TCS34087_STATUS2] &= ~TCS34087_AVALID;
+}
+
+static void tcs_power_on(sim_device_t *d) {
+	memset(&tcs, 0, sizeof(tcs));
+	tcs.r.regs[TCS34087_AUXID] = 0x4A;
+	tcs.r.regs[TCS34087_REVID] = 0x53;
+	tcs.r.regs[TCS34087_ID] = 0x18;
+}
+
+static void tcs_fifo_update() {
+	if (!tcs_fd_enabled()) return;
+	double now = sim_time();
+	double period = tcs_fd_period();
+	double mean = sim_env.lux * tcs_gain(tcs.r.regs[TCS34087_FD_CFG3] >> 3);
+	while (tcs.fd_next <= now) {
+		if (tcs.fifo_count < TCS34087_FIFO_SIZE) {
+			double v = mean * (1 + sim_env.flicker_depth * sin(2 * M_PI * sim_env.flicker_hz * tcs.fd_next)) + sim_noise(mean * 0.005);
+			if (v < 0) v = 0;
+			if (v > 65535) v = 65535;
+			tcs.fifo[tcs.fifo_count++] = (uint16_t)v;
+		}
+		tcs.fd_next += period;
+	}
+	tcs.r.regs[TCS34087_FIFO_STATUS] = tcs.fifo_count > 255 ? 255 : tcs.fifo_count;
+}
+
+/* Latch a result into ASTATUS and the ADATA registers */
+static void tcs_latch() {
+	double t_ms = tcs_integration_s() * 1000;
+	double gain = tcs_gain(tcs.r.regs[TCS34087_CFG1]);
+	double cpl = t_ms * gain / (TCS34087_GA * TCS34087_DF);
+	double x = (sim_env.lux + sim_noise(sim_env.lux * 0.002)) * cpl / (TCS34087_R_Coef + TCS34087_G_Coef + TCS34087_B_Coef);
+	double fs = (tcs.r.regs[TCS34087_ATIME] + 1) * (tcs_astep() + 1);
+	if (fs > 65535) fs = 65535;
+	double ch[6] = { 3 * x, x, x, x, 3 * x, x };  // C R G B W F
+	int sat = 0;
+	for (int i=0; i < 6; i++) {
+		if (ch[i] >= fs) { ch[i] = fs; sat = 1; }
+		uint16_t v = (uint16_t)ch[i];
+		tcs.r.regs[TCS34087_ADATA0L + 2*i] = v & 0xff;
+		tcs.r.regs[TCS34087_ADATA0L + 2*i + 1] = v >> 8;
+	}
+	tcs.r.regs[TCS34087_ASTATUS] = (sat ? TCS34087_ASTATUS_ASAT_STATUS : 0) | (tcs.r.regs[TCS34087_CFG1] & 0x0f);
+	if (sat)
+		tcs.r.regs[TCS34087_STATUS2] |= TCS34087_ASAT_DIGITAL;
+	else
+		tcs.r.regs[TCS34087_STATUS2] &= ~TCS34087_ASAT_DIGITAL;
+}
+
+static void tcs_update() {
+	uint8_t en = tcs.r.regs[TCS34087_ENABLE];
+	if ((en & TCS34087_ENABLE_PON) && (en & TCS34087_ENABLE_AEN) && sim_time() - tcs.start >= tcs_integration_s())
+		tcs.r.regs[TCS34087_STATUS2] |= TCS34087_AVALID;
+	tcs_fifo_update();
+}
+
+static int tcs_write(sim_device_t *d, const uint8_t *buf, int len) {
+	if (len < 1) return 0;
+	tcs.r.ptr = buf[0];
+	for (int i=1; i < len; i++) {
+		uint8_t reg = tcs.r.ptr++;
+		switch (reg) {
+		case TCS34087_ENABLE:
+			if ((buf[i] & TCS34087_ENABLE_FDEN) && !(tcs.r.regs[reg] & TCS34087_ENABLE_FDEN))
+				tcs.fd_next = sim_time();
+			tcs.r.regs[reg] = buf[i];
+			tcs_restart();
+			break;
+		case TCS34087_ATIME:
+		case TCS34087_ASTEPL:
+		case TCS34087_ASTEPL + 1:
+		case TCS34087_CFG1:
+			tcs.r.regs[reg] = buf[i];
+			tcs_restart();
+			break;
+		case TCS34087_CONTROL:
+			if (buf[i] & TCS34087_CONTROL_FIFO_CLR) {
+				tcs.fifo_count = 0;
+				tcs.fd_next = sim_time();
+				tcs.r.regs[TCS34087_FIFO_STATUS] = 0;
+			}
+			break;
+		case TCS34087_AUXID:
+		case TCS34087_REVID:
+		case TCS34087_ID:
+		case TCS34087_STATUS2:
+		case TCS34087_FIFO_STATUS:
+			break;
+		default:
+			tcs.r.regs[reg] = buf[i];
+		}
+	}
+	return 0;
+}
+
+static int tcs_read(sim_device_t *d, uint8_t *buf, int len) {
+	tcs_update();
+	if (tcs.r.ptr == TCS34087_FDATAL) {
+		/* A burst read of the FIFO data pops a sample for each two bytes */
+		for (int i=0; i < len; i += 2) {
+			uint16_t v = 0;
+			if (tcs.fifo_count > 0) {
+				v = tcs.fifo[0];
+				memmove(tcs.fifo, &tcs.fifo[1], (tcs.fifo_count - 1) * sizeof(uint16_t));
+				tcs.fifo_count--;
+			}
+			buf[i] = v & 0xff;
+			if (i + 1 < len) buf[i+1] = v >> 8;
+		}
+		tcs.r.regs[TCS34087_FIFO_STATUS] = tcs.fifo_count;
+		return len;
+	}
+	for (int i=0; i < len; i++) {
+		uint8_t reg = tcs.r.ptr++;
+		if (reg == TCS34087_ASTATUS && (tcs.r.regs[TCS34087_STATUS2] & TCS34087_AVALID))
+			tcs_latch();
+		buf[i] = tcs.r.regs[reg];
+	}
+	return len;
+}
+
+static sim_device_t devices[] = {
+	{ "ADS1015", ADS_I2C_ADDRESS, -1, ads_power_on, ads_write, ads_read, 0 },
+	{ "SHTC3", SHTC3_I2C_ADDRESS, -1, shtc3_power_on, shtc3_write, shtc3_read, 0 },
+	{ "LPS22HB", LPS22HB_I2C_ADDRESS, -1, lps_power_on, lps_write, lps_read, 0 },
+	{ "PAS CO2", XENSIV_PASCO2_I2C_ADDR, SENSORS_GPIO_CO2_EN, pasco2_power_on, pasco2_write, pasco2_read, 0 },
+	{ "QMI8658", 0x6b, -1, qmi_power_on, qmi_write, qmi_read, 0 },
+	{ "AK09918", AK09918_I2C_ADDR, -1, ak_power_on, ak_write, ak_read, 0 },
+	{ "TCS34087", TCS34087_ADDRESS, -1, tcs_power_on, tcs_write, tcs_read, 0 },
+};
+
+sim_device_t *sim_device_find(int addr) {
+	for (unsigned int i=0; i < sizeof(devices)/sizeof(devices[0]); i++)
+		if (devices[i].addr == addr)
+			return &devices[i];
+	return NULL;
+}
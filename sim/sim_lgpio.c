@@ -0,0 +1,352 @@
+/*
+ * sim_lgpio.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The lgpio API on top of the simulated devices.  Every SMBus call is turned into the
+ * bytes the real bus would carry, a write of the register then a read or write of the
+ * data, and passed to the device model.  An address with no device NACKs, like the
+ * real bus.
+ *
+ * It can be linked in place of lgpio, or built as a shared library and loaded in front
+ * of the real one:
+ *   LD_PRELOAD=sim/libsim_lgpio.so Debug/sensors -v
+ *
+ * The calls are serialized with one lock, as they would be on one I2C bus.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lgpio.h"
+#include "sim.h"
+
+#define SIM_MAX_HANDLES 32
+#define MAX_CONFIG_LINE_LENGTH 128
+
+sim_env_t sim_env = {
+	.temp_c = 24.0,
+	.rh_pct = 40.0,
+	.pressure_hpa = 1013.25,
+	.leak_hpa_per_min = 0,
+	.co2_ppm = 800,
+	.o2_pct = 20.9,
+	.methane_mv = 400,
+	.air_q_mv = 600,
+	.bus_mv = 2500,
+	.lux = 300,
+	.flicker_hz = 100,
+	.flicker_depth = 0.1,
+	.mag_ut = { 20, -5, -40 },
+	.noise = 1.0
+};
+
+static pthread_mutex_t sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t sim_once = PTHREAD_ONCE_INIT;
+static struct timespec sim_start;
+static sim_device_t *handles[SIM_MAX_HANDLES];
+static int gpio_level[SIM_MAX_GPIO];
+
+static void sim_load_config(char *filename) {
+	char line[MAX_CONFIG_LINE_LENGTH];
+	FILE *file = fopen(filename, "r");
+	if (file == NULL)
+		return;
+	while (fgets(line, sizeof line, file) != NULL) {
+		if (line[0] == '#') continue;
+		char *key = strtok(line, "=");
+		char *value = strtok(NULL, "\n");
+		if (key == NULL || value == NULL) continue;
+		double v = atof(value);
+		if (strcmp(key, "temp_c") == 0) sim_env.temp_c = v;
+		else if (strcmp(key, "rh_pct") == 0) sim_env.rh_pct = v;
+		else if (strcmp(key, "pressure_hpa") == 0) sim_env.pressure_hpa = v;
+		else if (strcmp(key, "leak_hpa_per_min") == 0) sim_env.leak_hpa_per_min = v;
+		else if (strcmp(key, "co2_ppm") == 0) sim_env.co2_ppm = v;
+		else if (strcmp(key, "o2_pct") == 0) sim_env.o2_pct = v;
+		else if (strcmp(key, "methane_mv") == 0) sim_env.methane_mv = v;
+		else if (strcmp(key, "air_q_mv") == 0) sim_env.air_q_mv = v;
+		else if (strcmp(key, "bus_mv") == 0) sim_env.bus_mv = v;
+		else if (strcmp(key, "lux") == 0) sim_env.lux = v;
+		else if (strcmp(key, "flicker_hz") == 0) sim_env.flicker_hz = v;
+		else if (strcmp(key, "flicker_depth") == 0) sim_env.flicker_depth = v;
+		else if (strcmp(key, "mag_x_ut") == 0) sim_env.mag_ut[0] = v;
+		else if (strcmp(key, "mag_y_ut") == 0) sim_env.mag_ut[1] = v;
+		else if (strcmp(key, "mag_z_ut") == 0) sim_env.mag_ut[2] = v;
+		else if (strcmp(key, "noise") == 0) sim_env.noise = v;
+		else fprintf(stderr, "SIM: unknown key in %s: %s\n", filename, key);
+	}
+	fclose(file);
+}
+
+static void sim_init_once() {
+	clock_gettime(CLOCK_MONOTONIC, &sim_start);
+	char *filename = getenv("SIM_CONFIG");
+	sim_load_config(filename != NULL ? filename : SIM_CONFIG_FILE);
+	srand(1);
+}
+
+void sim_init() {
+	pthread_once(&sim_once, sim_init_once);
+}
+
+/* Seconds since the simulator started */
+double sim_time() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - sim_start.tv_sec) + (now.tv_nsec - sim_start.tv_nsec) / 1e9;
+}
+
+/* Gaussian noise, Box-Muller */
+double sim_noise(double sd) {
+	if (sd == 0 || sim_env.noise == 0) return 0;
+	double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sd * sim_env.noise * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+int sim_gpio_level(int gpio) {
+	if (gpio < 0 || gpio >= SIM_MAX_GPIO) return 0;
+	return gpio_level[gpio];
+}
+
+/* Find the device for a handle and make sure its power state is current.  Called with
+ * the lock held */
+static sim_device_t *sim_handle(int handle) {
+	if (handle < 0 || handle >= SIM_MAX_HANDLES || handles[handle] == NULL)
+		return NULL;
+	sim_device_t *d = handles[handle];
+	int powered = d->power_gpio < 0 || sim_gpio_level(d->power_gpio);
+	if (powered && !d->powered && d->power_on != NULL)
+		d->power_on(d);
+	d->powered = powered;
+	return d;
+}
+
+static int sim_write(int handle, const uint8_t *buf, int len) {
+	sim_device_t *d = sim_handle(handle);
+	if (d == NULL) return LG_BAD_HANDLE;
+	if (!d->powered || d->write(d, buf, len) != 0)
+		return LG_I2C_WRITE_FAILED;
+	return LG_OKAY;
+}
+
+static int sim_read(int handle, uint8_t *buf, int len) {
+	sim_device_t *d = sim_handle(handle);
+	if (d == NULL) return LG_BAD_HANDLE;
+	if (!d->powered || d->read(d, buf, len) != len)
+		return LG_I2C_READ_FAILED;
+	return len;
+}
+
+/* A register write then a read, as one locked transaction */
+static int sim_reg_read(int handle, int reg, uint8_t *buf, int len) {
+	uint8_t r = reg;
+	int rc = sim_write(handle, &r, 1);
+	if (rc < 0) return LG_I2C_READ_FAILED;
+	return sim_read(handle, buf, len);
+}
+
+static int sim_reg_write(int handle, int reg, const uint8_t *data, int len) {
+	uint8_t buf[64];
+	if (len + 1 > (int)sizeof(buf)) return LG_I2C_WRITE_FAILED;
+	buf[0] = reg;
+	memcpy(&buf[1], data, len);
+	return sim_write(handle, buf, len + 1);
+}
+
+int lgGpiochipOpen(int gpioDev) {
+	sim_init();
+	return 0;
+}
+
+int lgGpiochipClose(int handle) {
+	return LG_OKAY;
+}
+
+int lgGpioClaimOutput(int handle, int lFlags, int gpio, int level) {
+	return lgGpioWrite(handle, gpio, level);
+}
+
+int lgGpioClaimInput(int handle, int lFlags, int gpio) {
+	return LG_OKAY;
+}
+
+int lgGpioFree(int handle, int gpio) {
+	return LG_OKAY;
+}
+
+int lgGpioRead(int handle, int gpio) {
+	return sim_gpio_level(gpio);
+}
+
+int lgGpioWrite(int handle, int gpio, int level) {
+	if (gpio < 0 || gpio >= SIM_MAX_GPIO) return LG_BAD_HANDLE;
+	pthread_mutex_lock(&sim_mutex);
+	gpio_level[gpio] = level != 0;
+	pthread_mutex_unlock(&sim_mutex);
+	return LG_OKAY;
+}
+
+int lgI2cOpen(int i2cDev, int i2cAddr, int i2cFlags) {
+	sim_init();
+	pthread_mutex_lock(&sim_mutex);
+	sim_device_t *d = sim_device_find(i2cAddr);
+	int handle = LG_I2C_OPEN_FAILED;
+	if (d != NULL)
+		for (int i=0; i < SIM_MAX_HANDLES; i++)
+			if (handles[i] == NULL) {
+				handles[i] = d;
+				handle = i;
+				break;
+			}
+	pthread_mutex_unlock(&sim_mutex);
+	return handle;
+}
+
+int lgI2cClose(int handle) {
+	if (handle < 0 || handle >= SIM_MAX_HANDLES) return LG_BAD_HANDLE;
+	pthread_mutex_lock(&sim_mutex);
+	handles[handle] = NULL;
+	pthread_mutex_unlock(&sim_mutex);
+	return LG_OKAY;
+}
+
+int lgI2cWriteQuick(int handle, int bitVal) {
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_write(handle, NULL, 0);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc;
+}
+
+int lgI2cWriteByte(int handle, int byteVal) {
+	uint8_t b = byteVal;
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_write(handle, &b, 1);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc;
+}
+
+int lgI2cReadByte(int handle) {
+	uint8_t b;
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_read(handle, &b, 1);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc < 0 ? rc : b;
+}
+
+int lgI2cWriteByteData(int handle, int i2cReg, int byteVal) {
+	uint8_t b = byteVal;
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_reg_write(handle, i2cReg, &b, 1);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc;
+}
+
+/* SMBus words are sent low byte first */
+int lgI2cWriteWordData(int handle, int i2cReg, int wordVal) {
+	uint8_t b[2] = { wordVal & 0xff, (wordVal >> 8) & 0xff };
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_reg_write(handle, i2cReg, b, 2);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc;
+}
+
+int lgI2cReadByteData(int handle, int i2cReg) {
+	uint8_t b;
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_reg_read(handle, i2cReg, &b, 1);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc < 0 ? rc : b;
+}
+
+int lgI2cReadWordData(int handle, int i2cReg) {
+	uint8_t b[2];
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_reg_read(handle, i2cReg, b, 2);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc < 0 ? rc : b[0] | (b[1] << 8);
+}
+
+int lgI2cReadI2CBlockData(int handle, int i2cReg, char *rxBuf, int count) {
+	if (count < 1 || count > 32) return LG_I2C_READ_FAILED;
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_reg_read(handle, i2cReg, (uint8_t *)rxBuf, count);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc;
+}
+
+int lgI2cWriteI2CBlockData(int handle, int i2cReg, const char *txBuf, int count) {
+	if (count < 1 || count > 32) return LG_I2C_WRITE_FAILED;
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_reg_write(handle, i2cReg, (const uint8_t *)txBuf, count);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc;
+}
+
+int lgI2cReadDevice(int handle, char *rxBuf, int count) {
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_read(handle, (uint8_t *)rxBuf, count);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc;
+}
+
+int lgI2cWriteDevice(int handle, const char *txBuf, int count) {
+	pthread_mutex_lock(&sim_mutex);
+	int rc = sim_write(handle, (const uint8_t *)txBuf, count);
+	pthread_mutex_unlock(&sim_mutex);
+	return rc;
+}
+
+/* Each segment goes to the device opened with the handle, whatever its address */
+int lgI2cSegments(int handle, lgI2cMsg_t *segs, int numSegs) {
+	int rc = 0;
+	pthread_mutex_lock(&sim_mutex);
+	for (int i=0; i < numSegs && rc >= 0; i++) {
+		if (segs[i].flags & LG_I2C_M_RD)
+			rc = sim_read(handle, segs[i].buf, segs[i].len);
+		else
+			rc = sim_write(handle, segs[i].buf, segs[i].len);
+	}
+	pthread_mutex_unlock(&sim_mutex);
+	return rc < 0 ? rc : numSegs;
+}
+
+void lguSleep(double sleepSecs) {
+	if (sleepSecs <= 0) return;
+	struct timespec ts;
+	ts.tv_sec = (time_t)sleepSecs;
+	ts.tv_nsec = (long)((sleepSecs - ts.tv_sec) * 1e9);
+	nanosleep(&ts, NULL);
+}
+
+double lguTime(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+uint64_t lguTimestamp(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
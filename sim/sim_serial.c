@@ -0,0 +1,207 @@
+/*
+ * sim_serial.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Simulates the serial devices.  A pseudo terminal is opened for each one and linked
+ * to a path that goes in the sensors config file:
+ *   cw1_serial_device=/tmp/sim_cw1
+ *   cw2_serial_device=/tmp/sim_cw2
+ *   mic_serial_device=/tmp/sim_mic
+ *
+ * The two CosmicWatch detectors send event lines at random times with the given rate.
+ * A fraction of the events are sent by both, which is a coincidence.  The mic answers
+ * the D command with a power spectrum.
+ *
+ * Usage: sim_serial [-r events per min] [-c coincident fraction] [-d dir]
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/select.h>
+
+#define MIC_BINS 32
+
+typedef struct sim_port {
+	const char *name;
+	char link[256];
+	int master;
+	int slave;      /* Held open so the port does not hang up when the reader closes it */
+} sim_port_t;
+
+typedef struct sim_cw {
+	char master_slave;
+	sim_port_t *port;
+	int event_num;
+	int count;
+	double next;    /* Time of the next event */
+} sim_cw_t;
+
+static sim_port_t ports[3] = { { .name = "cw1" }, { .name = "cw2" }, { .name = "mic" } };
+static double rate_per_s = 1.0;
+static double coincident = 0.1;
+static double start_time;
+static volatile int running = 1;
+
+static double now_s() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double next_interval() {
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return -log(u) / rate_per_s;
+}
+
+static int open_port(sim_port_t *port, const char *dir) {
+	port->master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (port->master < 0 || grantpt(port->master) != 0 || unlockpt(port->master) != 0) {
+		perror("posix_openpt");
+		return EXIT_FAILURE;
+	}
+	/* Nothing may be reading, so drop data rather than block when the buffer is full */
+	fcntl(port->master, F_SETFL, O_NONBLOCK);
+	char *slave_name = ptsname(port->master);
+	port->slave = open(slave_name, O_RDWR | O_NOCTTY);
+	if (port->slave < 0) {
+		perror(slave_name);
+		return EXIT_FAILURE;
+	}
+	/* Raw mode so the lines and binary data pass unchanged */
+	struct termios tty;
+	tcgetattr(port->slave, &tty);
+	cfmakeraw(&tty);
+	tcsetattr(port->slave, TCSANOW, &tty);
+
+	snprintf(port->link, sizeof(port->link), "%s/sim_%s", dir, port->name);
+	unlink(port->link);
+	if (symlink(slave_name, port->link) != 0) {
+		perror(port->link);
+		return EXIT_FAILURE;
+	}
+	printf("%s on %s\n", port->link, slave_name);
+	return EXIT_SUCCESS;
+}
+
+static void send_event(sim_cw_t *cw, double t) {
+	char line[128];
+	cw->event_num++;
+	cw->count++;
+	double elapsed_s = t - start_time;
+	int time_ms = (int)(elapsed_s * 1000);
+	int count_avg = elapsed_s > 0 ? (int)(cw->count / elapsed_s * 60) : 0;
+	double sipm = 20 + 200 * ((double)rand() / RAND_MAX) * ((double)rand() / RAND_MAX);
+	int n = snprintf(line, sizeof(line), "%c %d %d %d %.2f %d %.1f\r",
+			cw->master_slave, cw->event_num, time_ms, count_avg, sipm, cw->event_num * 2, 24.0);
+	if (write(cw->port->master, line, n) != n && errno != EAGAIN)
+		perror(cw->port->name);
+}
+
+/* The mic replies to D with "D nn," followed by one byte for each bin */
+static void answer_mic(sim_port_t *port) {
+	char cmd[64];
+	int n = read(port->master, cmd, sizeof(cmd));
+	for (int i=0; i < n; i++) {
+		if (cmd[i] != 'D') continue;
+		unsigned char reply[5 + MIC_BINS];
+		memcpy(reply, "D 32,", 5);
+		for (int b=0; b < MIC_BINS; b++)
+			reply[5 + b] = (unsigned char)(200 / (b + 1) + rand() % 8);
+		if (write(port->master, reply, sizeof(reply)) != sizeof(reply) && errno != EAGAIN)
+			perror(port->name);
+	}
+}
+
+static void signal_exit(int sig) {
+	running = 0;
+}
+
+int main(int argc, char *argv[]) {
+	const char *dir = "/tmp";
+	int opt;
+	while ((opt = getopt(argc, argv, "r:c:d:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			rate_per_s = atof(optarg) / 60.0;
+			break;
+		case 'c':
+			coincident = atof(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			printf("Usage: sim_serial [-r events per min] [-c coincident fraction] [-d dir]\n");
+			return EXIT_FAILURE;
+		}
+	}
+	if (rate_per_s <= 0) rate_per_s = 1.0 / 60;
+
+	signal(SIGINT, signal_exit);
+	signal(SIGTERM, signal_exit);
+	signal(SIGPIPE, SIG_IGN);
+	srand(time(NULL));
+
+	for (int i=0; i < 3; i++)
+		if (open_port(&ports[i], dir) != EXIT_SUCCESS)
+			return EXIT_FAILURE;
+
+	start_time = now_s();
+	sim_cw_t cw[2] = {
+		{ 'M', &ports[0], 0, 0, start_time + next_interval() },
+		{ 'S', &ports[1], 0, 0, start_time + next_interval() }
+	};
+
+	while (running) {
+		double t = now_s();
+		for (int i=0; i < 2; i++) {
+			if (t < cw[i].next) continue;
+			send_event(&cw[i], t);
+			if ((double)rand() / RAND_MAX < coincident)
+				send_event(&cw[1 - i], t);
+			cw[i].next = t + next_interval();
+		}
+
+		double wait = fmin(cw[0].next, cw[1].next) - now_s();
+		if (wait < 0) wait = 0;
+		if (wait > 0.1) wait = 0.1;
+		struct timeval tv = { 0, (long)(wait * 1e6) };
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(ports[2].master, &fds);
+		if (select(ports[2].master + 1, &fds, NULL, NULL, &tv) > 0)
+			answer_mic(&ports[2]);
+	}
+
+	for (int i=0; i < 3; i++) {
+		unlink(ports[i].link);
+		close(ports[i].slave);
+		close(ports[i].master);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,472 @@
+/*
+ * telem_columns.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Ground converter from the archive exports, WOD and CosmicWatch logs to a columnar file
+ * for analysis.  Any number of files can be given.  Each is sorted by its first byte into
+ * telemetry samples, aggregated records or a CW text log, and each kind goes to its own
+ * output, prefix.kind.col.  The columns come from TELEM_SCHEMA, the aggregated record built
+ * from it and CW_SCHEMA, so they always match the flight code.
+ *
+ * The input files are memory mapped and split across the threads by file.  The first pass
+ * counts the rows in each file, which gives each file its place in the output.  The output
+ * is then sized and mapped and the second pass decodes every file straight into its rows
+ * of each column, so the threads never wait on each other.
+ *
+ * The output file is a col_header_t, then a col_desc_t for each column, then the columns.
+ * Each column is rows values of its type, starting on an 8 byte boundary.  The sample and
+ * WOD files start with a time_ms column, which is the sample time, or the time of the first
+ * sample in a WOD record.  The CW files have the time_ms from the detector, which is in ms
+ * since it started, then a master column that is 1 for an M line and 0 for an S line.
+ * Their last column is utc_ms, the event time placed by the time service, or 0 for a line
+ * from before it was logged.
+ * With -c a CSV file of the same rows is written too.  That is much slower.
+ *
+ * Usage: telem_columns [-j threads] [-c] -o prefix file...
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "telem_schema.h"
+#include "telem_agg.h"
+#include "cosmic_watch.h"
+
+#define COL_MAGIC "SCOL"
+#define COL_VERSION 1
+#define COL_NAME_LEN 32
+#define COL_ALIGN 8
+#define MAX_COLUMNS 256
+#define MAX_PATH 1024
+
+enum {
+	COL_U32,
+	COL_I32,
+	COL_F32,
+	COL_U64
+};
+static const int col_width[] = { 4, 4, 4, 8 };
+
+enum {
+	KIND_RT,
+	KIND_WOD,
+	KIND_CW,
+	NUM_KINDS
+};
+static const char *kind_names[] = { "rt", "wod", "cw" };
+
+typedef struct __attribute__((__packed__)) col_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t rows;
+	uint32_t columns;
+	uint32_t kind;                 /* 0 RT, 1 WOD, 2 CW */
+} col_header_t;
+
+typedef struct __attribute__((__packed__)) col_desc {
+	char name[COL_NAME_LEN];
+	uint32_t type;                 /* COL_U32, COL_I32, COL_F32 or COL_U64 */
+	uint32_t width;                /* Bytes in each value */
+	uint64_t offset;               /* Bytes from the start of the file to the column */
+} col_desc_t;
+
+typedef struct column {
+	col_desc_t desc;
+	const telem_field_t *field;    /* The telemetry field, or NULL */
+	int element;                   /* The element of an array field */
+	uint8_t *data;
+} column_t;
+
+typedef struct output {
+	column_t columns[MAX_COLUMNS];
+	int num_columns;
+	uint64_t rows;
+	uint8_t *map;
+	size_t map_len;
+} output_t;
+
+typedef struct input {
+	char *path;
+	int kind;
+	const uint8_t *map;
+	size_t len;
+	uint64_t rows;
+	uint64_t row0;                 /* The row in the output of the first row of this file */
+} input_t;
+
+static output_t outputs[NUM_KINDS];
+static input_t *inputs;
+static int num_inputs;
+static int next_input;
+
+static void add_column(output_t *out, const char *name, int type, const telem_field_t *field, int element) {
+	column_t *col = &out->columns[out->num_columns++];
+	memset(col, 0, sizeof(column_t));
+	snprintf(col->desc.name, COL_NAME_LEN, "%s", name);
+	col->desc.type = type;
+	col->desc.width = col_width[type];
+	col->field = field;
+	col->element = element;
+}
+
+static void add_telem_columns(output_t *out, const telem_field_t *fields, int num_fields) {
+	char name[COL_NAME_LEN];
+	add_column(out, "time_ms", COL_U64, NULL, 0);
+	for (int f=0; f < num_fields; f++) {
+		for (int i=0; i < fields[f].count; i++) {
+			if (fields[f].count == 1)
+				snprintf(name, sizeof(name), "%s", fields[f].name);
+			else
+				snprintf(name, sizeof(name), "%s_%d", fields[f].name, i);
+			add_column(out, name, fields[f].is_signed ? COL_I32 : COL_U32, &fields[f], i);
+		}
+	}
+}
+
+#define CW_COLUMN(name, type, is_float) add_column(out, #name, is_float ? COL_F32 : COL_U32, NULL, 0);
+static void add_cw_columns(output_t *out) {
+	add_column(out, "master", COL_U32, NULL, 0);
+	CW_SCHEMA(CW_COLUMN)
+	add_column(out, "utc_ms", COL_U64, NULL, 0);
+}
+
+/* A number from a CW line, which is digits with an optional sign and decimal point */
+static bool parse_number(const char **pp, const char *end, double *value) {
+	const char *p = *pp;
+	while (p < end && *p == ' ') p++;
+	bool negative = false;
+	if (p < end && *p == '-') {
+		negative = true;
+		p++;
+	}
+	const char *start = p;
+	double v = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+		v = v * 10 + (*p++ - '0');
+	if (p < end && *p == '.') {
+		p++;
+		double scale = 0.1;
+		while (p < end && *p >= '0' && *p <= '9') {
+			v += (*p++ - '0') * scale;
+			scale *= 0.1;
+		}
+	}
+	if (p == start) return false;
+	*value = negative ? -v : v;
+	*pp = p;
+	return true;
+}
+
+#define CW_PARSE(name, type, is_float) \
+	if (!parse_number(&p, end, &v)) return false; \
+	data->name = (type)v;
+
+/* Parse the line from p to end, without its new line.  Returns false if it is not data */
+static bool parse_cw_line(const char *p, const char *end, cw_data_t *data, uint64_t *utc_ms) {
+	double v;
+	if (end - p < 2 || (p[0] != 'M' && p[0] != 'S') || p[1] != ' ')
+		return false;
+	data->master_slave[0] = p[0];
+	data->master_slave[1] = 0;
+	p += 2;
+	CW_SCHEMA(CW_PARSE)
+	*utc_ms = parse_number(&p, end, &v) ? (uint64_t)v : 0;
+	return true;
+}
+
+static int binary_version(int kind) {
+	return kind == KIND_RT ? TELEM_SCHEMA_VERSION : TELEM_AGG_VERSION;
+}
+
+static int binary_len(int kind) {
+	return kind == KIND_RT ? TELEM_RECORD_LEN : TELEM_AGG_RECORD_LEN;
+}
+
+#define CW_STORE(name, type, is_float) \
+	if (is_float) \
+		((float *)cols[c].data)[row] = data.name; \
+	else \
+		((uint32_t *)cols[c].data)[row] = data.name; \
+	c++;
+
+/* Count the rows of an input, or decode them into the columns if store is true */
+static uint64_t convert(input_t *in, bool store) {
+	output_t *out = &outputs[in->kind];
+	column_t *cols = out->columns;
+	uint64_t row = in->row0;
+	uint64_t n = 0;
+	if (in->kind == KIND_CW) {
+		const char *p = (const char *)in->map;
+		const char *end = p + in->len;
+		while (p < end) {
+			const char *nl = memchr(p, '\n', end - p);
+			if (nl == NULL) nl = end;
+			cw_data_t data;
+			uint64_t utc_ms;
+			if (parse_cw_line(p, nl, &data, &utc_ms)) {
+				if (store) {
+					((uint32_t *)cols[0].data)[row] = data.master_slave[0] == 'M';
+					int c = 1;
+					CW_SCHEMA(CW_STORE)
+					((uint64_t *)cols[c].data)[row] = utc_ms;
+					row++;
+				}
+				n++;
+			}
+			p = nl + 1;
+		}
+		return n;
+	}
+
+	int version = binary_version(in->kind);
+	int len = binary_len(in->kind);
+	int time_bit = in->kind == KIND_RT ? TELEM_BIT_timestamp : TELEM_AGG_BIT_timestamp_first;
+	for (size_t pos=0; pos + len <= in->len; pos += len) {
+		const uint8_t *record = in->map + pos;
+		if (record[0] != version) continue;
+		n++;
+		if (!store) continue;
+		((uint64_t *)cols[0].data)[row] = telem_get_bits(record + 1, time_bit, 32) * 1000;
+		for (int c=1; c < out->num_columns; c++) {
+			int64_t value = telem_field_value(record, cols[c].field, cols[c].element);
+			if (cols[c].desc.type == COL_I32)
+				((int32_t *)cols[c].data)[row] = (int32_t)value;
+			else
+				((uint32_t *)cols[c].data)[row] = (uint32_t)value;
+		}
+		row++;
+	}
+	return n;
+}
+
+static bool store_pass;
+
+static void *convert_process(void *arg) {
+	int i;
+	while ((i = __atomic_fetch_add(&next_input, 1, __ATOMIC_RELAXED)) < num_inputs) {
+		if (store_pass)
+			convert(&inputs[i], true);
+		else
+			inputs[i].rows = convert(&inputs[i], false);
+	}
+	return NULL;
+}
+
+static void run_threads(int num_threads, bool store) {
+	pthread_t threads[num_threads];
+	store_pass = store;
+	next_input = 0;
+	for (int t=0; t < num_threads; t++)
+		pthread_create(&threads[t], NULL, convert_process, NULL);
+	for (int t=0; t < num_threads; t++)
+		pthread_join(threads[t], NULL);
+}
+
+static int open_input(input_t *in, char *path) {
+	in->path = path;
+	in->map = NULL;
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "Could not open %s\n", path);
+		if (fd >= 0) close(fd);
+		return EXIT_FAILURE;
+	}
+	in->len = st.st_size;
+	if (in->len == 0) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	void *map = mmap(NULL, in->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Could not map %s\n", path);
+		return EXIT_FAILURE;
+	}
+	madvise(map, in->len, MADV_SEQUENTIAL);
+	in->map = map;
+	if (in->map[0] == TELEM_SCHEMA_VERSION)
+		in->kind = KIND_RT;
+	else if (in->map[0] == TELEM_AGG_VERSION)
+		in->kind = KIND_WOD;
+	else
+		in->kind = KIND_CW;
+	return EXIT_SUCCESS;
+}
+
+/* Lay out the columns of an output and map its file */
+static int open_output(output_t *out, int kind, char *prefix) {
+	char path[MAX_PATH];
+	snprintf(path, sizeof(path), "%s.%s.col", prefix, kind_names[kind]);
+	size_t pos = sizeof(col_header_t) + out->num_columns * sizeof(col_desc_t);
+	for (int c=0; c < out->num_columns; c++) {
+		pos = (pos + COL_ALIGN - 1) / COL_ALIGN * COL_ALIGN;
+		out->columns[c].desc.offset = pos;
+		pos += out->rows * out->columns[c].desc.width;
+	}
+	out->map_len = pos;
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, out->map_len) != 0) {
+		fprintf(stderr, "Could not create %s\n", path);
+		if (fd >= 0) close(fd);
+		return EXIT_FAILURE;
+	}
+	void *map = mmap(NULL, out->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Could not map %s\n", path);
+		return EXIT_FAILURE;
+	}
+	out->map = map;
+	col_header_t *h = (col_header_t *)out->map;
+	memcpy(h->magic, COL_MAGIC, 4);
+	h->version = COL_VERSION;
+	h->rows = out->rows;
+	h->columns = out->num_columns;
+	h->kind = kind;
+	col_desc_t *desc = (col_desc_t *)(out->map + sizeof(col_header_t));
+	for (int c=0; c < out->num_columns; c++) {
+		desc[c] = out->columns[c].desc;
+		out->columns[c].data = out->map + out->columns[c].desc.offset;
+	}
+	fprintf(stderr, "%s: %llu rows of %d columns\n", path, (unsigned long long)out->rows, out->num_columns);
+	return EXIT_SUCCESS;
+}
+
+static char *put_uint(char *p, uint64_t v) {
+	char tmp[24];
+	int n = 0;
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v > 0);
+	while (n > 0)
+		*p++ = tmp[--n];
+	return p;
+}
+
+static int write_csv(output_t *out, int kind, char *prefix) {
+	char path[MAX_PATH];
+	snprintf(path, sizeof(path), "%s.%s.csv", prefix, kind_names[kind]);
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not create %s\n", path);
+		return EXIT_FAILURE;
+	}
+	for (int c=0; c < out->num_columns; c++)
+		fprintf(file, "%s%s", c ? "," : "", out->columns[c].desc.name);
+	fprintf(file, "\n");
+	char line[MAX_COLUMNS * 24];
+	for (uint64_t row=0; row < out->rows; row++) {
+		char *p = line;
+		for (int c=0; c < out->num_columns; c++) {
+			column_t *col = &out->columns[c];
+			if (c) *p++ = ',';
+			switch (col->desc.type) {
+			case COL_U32: p = put_uint(p, ((uint32_t *)col->data)[row]); break;
+			case COL_U64: p = put_uint(p, ((uint64_t *)col->data)[row]); break;
+			case COL_I32: {
+				int32_t v = ((int32_t *)col->data)[row];
+				if (v < 0) *p++ = '-';
+				p = put_uint(p, v < 0 ? -(int64_t)v : v);
+				break;
+			}
+			case COL_F32: p += sprintf(p, "%g", ((float *)col->data)[row]); break;
+			}
+		}
+		*p++ = '\n';
+		fwrite(line, 1, p - line, file);
+	}
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+static double now_s() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+	char *prefix = NULL;
+	int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	bool csv = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:co:")) != -1) {
+		switch (opt) {
+		case 'j': num_threads = atoi(optarg); break;
+		case 'c': csv = true; break;
+		case 'o': prefix = optarg; break;
+		default: prefix = NULL; optind = argc; break;
+		}
+	}
+	if (prefix == NULL || optind >= argc) {
+		fprintf(stderr, "Usage: telem_columns [-j threads] [-c] -o prefix file...\n");
+		return EXIT_FAILURE;
+	}
+	if (num_threads < 1) num_threads = 1;
+	double start = now_s();
+
+	inputs = calloc(argc - optind, sizeof(input_t));
+	size_t bytes = 0;
+	for (int i=optind; i < argc; i++)
+		if (open_input(&inputs[num_inputs], argv[i]) == EXIT_SUCCESS)
+			bytes += inputs[num_inputs++].len;
+
+	add_telem_columns(&outputs[KIND_RT], telem_fields, telem_num_fields);
+	add_telem_columns(&outputs[KIND_WOD], telem_agg_fields, telem_agg_num_fields);
+	add_cw_columns(&outputs[KIND_CW]);
+
+	/* Count the rows, then give each file its place in the output, in the order given */
+	run_threads(num_threads, false);
+	for (int i=0; i < num_inputs; i++) {
+		inputs[i].row0 = outputs[inputs[i].kind].rows;
+		outputs[inputs[i].kind].rows += inputs[i].rows;
+	}
+	int rc = EXIT_SUCCESS;
+	for (int k=0; k < NUM_KINDS; k++)
+		if (outputs[k].rows > 0 && open_output(&outputs[k], k, prefix) != EXIT_SUCCESS)
+			rc = EXIT_FAILURE;
+	if (rc != EXIT_SUCCESS)
+		return rc;
+
+	run_threads(num_threads, true);
+	double elapsed = now_s() - start;
+	fprintf(stderr, "Converted %d files, %.1f MB in %.2f s, %.0f MB/s with %d threads\n",
+			num_inputs, bytes / 1e6, elapsed, elapsed > 0 ? bytes / 1e6 / elapsed : 0, num_threads);
+
+	for (int k=0; k < NUM_KINDS; k++) {
+		if (outputs[k].rows == 0) continue;
+		if (csv && write_csv(&outputs[k], k, prefix) != EXIT_SUCCESS)
+			rc = EXIT_FAILURE;
+		munmap(outputs[k].map, outputs[k].map_len);
+	}
+	for (int i=0; i < num_inputs; i++)
+		munmap((void *)inputs[i].map, inputs[i].len);
+	free(inputs);
+	return rc;
+}
@@ -0,0 +1,88 @@
+/*
+ * telem_decode.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Ground decoder for the WOD and archive export telemetry files.  Prints each record as a
+ * line of CSV with a header of the field names from the schema.  An array field is printed
+ * as one column for each value.  The version byte of the first record says if the file has
+ * telemetry samples, like a full archive export, or aggregated records, like the WOD files.
+ * Records from another version of the schema are skipped.  The RT file is the raw
+ * sensor_telemetry_t for iors_control, not schema records, so it is not read here.
+ *
+ * Usage: telem_decode telem_file > telem.csv
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "telem_schema.h"
+#include "telem_agg.h"
+
+int main(int argc, char *argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: telem_decode telem_file > telem.csv\n");
+		return EXIT_FAILURE;
+	}
+	FILE *file = fopen(argv[1], "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Could not open %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	const telem_field_t *fields = telem_fields;
+	int num_fields = telem_num_fields;
+	int len = TELEM_RECORD_LEN;
+	int version = fgetc(file);
+	if (version == TELEM_AGG_VERSION) {
+		fields = telem_agg_fields;
+		num_fields = telem_agg_num_fields;
+		len = TELEM_AGG_RECORD_LEN;
+	} else if (version != TELEM_SCHEMA_VERSION) {
+		fprintf(stderr, "%s does not start with a version %d record\n", argv[1], TELEM_SCHEMA_VERSION);
+		return EXIT_FAILURE;
+	}
+	rewind(file);
+
+	for (int f=0; f < num_fields; f++) {
+		const telem_field_t *field = &fields[f];
+		if (field->count == 1)
+			printf("%s%s", f ? "," : "", field->name);
+		else
+			for (int i=0; i < field->count; i++)
+				printf("%s%s_%d", f || i ? "," : "", field->name, i);
+	}
+	printf("\n");
+
+	uint8_t record[TELEM_AGG_RECORD_LEN];
+	int n = 0, skipped = 0;
+	while (fread(record, 1, len, file) == len) {
+		if (record[0] != version) {
+			skipped++;
+			continue;
+		}
+		for (int f=0; f < num_fields; f++)
+			for (int i=0; i < fields[f].count; i++)
+				printf("%s%lld", f || i ? "," : "", (long long)telem_field_value(record, &fields[f], i));
+		printf("\n");
+		n++;
+	}
+	fclose(file);
+	fprintf(stderr, "%d records, %d skipped that are not version 0x%02x\n", n, skipped, version);
+	return EXIT_SUCCESS;
+}
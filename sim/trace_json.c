@@ -0,0 +1,122 @@
+/*
+ * trace_json.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Converts a sensors.trace file, saved when the sensors program gets SIGUSR1, into the
+ * Chrome trace event JSON.  Load the output in chrome://tracing or ui.perfetto.dev to see
+ * each thread's spans on a timeline.  Times are in us from the first record.
+ *
+ * Usage: trace_json sensors.trace > sensors.json
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+static char *span_names[TRACE_MAX_SPANS];
+
+static int read_all(FILE *file, void *buf, size_t len) {
+	return fread(buf, 1, len, file) == len ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void print_name(int span) {
+	if (span < TRACE_MAX_SPANS && span_names[span] != NULL) {
+		putchar('"');
+		for (char *c = span_names[span]; *c; c++) {
+			if (*c == '"' || *c == '\\') putchar('\\');
+			if (*c >= ' ') putchar(*c);
+		}
+		putchar('"');
+	} else {
+		printf("\"span_%d\"", span);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: trace_json sensors.trace > sensors.json\n");
+		return EXIT_FAILURE;
+	}
+	FILE *file = fopen(argv[1], "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Could not open %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	char magic[4];
+	uint32_t version, num_names, num_rings;
+	if (read_all(file, magic, 4) != EXIT_SUCCESS || memcmp(magic, TRACE_MAGIC, 4) != 0
+			|| read_all(file, &version, sizeof(version)) != EXIT_SUCCESS || version != TRACE_VERSION) {
+		fprintf(stderr, "%s is not a version %d trace file\n", argv[1], TRACE_VERSION);
+		return EXIT_FAILURE;
+	}
+	if (read_all(file, &num_names, sizeof(num_names)) != EXIT_SUCCESS) goto truncated;
+	for (uint32_t i=0; i < num_names; i++) {
+		uint16_t span;
+		uint8_t len;
+		if (read_all(file, &span, sizeof(span)) != EXIT_SUCCESS) goto truncated;
+		if (read_all(file, &len, sizeof(len)) != EXIT_SUCCESS) goto truncated;
+		char *name = calloc(1, len + 1);
+		if (name == NULL || read_all(file, name, len) != EXIT_SUCCESS) goto truncated;
+		if (span < TRACE_MAX_SPANS)
+			span_names[span] = name;
+		else
+			free(name);
+	}
+	if (read_all(file, &num_rings, sizeof(num_rings)) != EXIT_SUCCESS) goto truncated;
+
+	/* Read all the rings first, so the times can start at the earliest record */
+	int32_t tids[TRACE_MAX_THREADS];
+	uint32_t counts[TRACE_MAX_THREADS];
+	trace_rec_t *recs[TRACE_MAX_THREADS];
+	if (num_rings > TRACE_MAX_THREADS) goto truncated;
+	uint64_t first_ns = UINT64_MAX;
+	for (uint32_t r=0; r < num_rings; r++) {
+		if (read_all(file, &tids[r], sizeof(tids[r])) != EXIT_SUCCESS) goto truncated;
+		if (read_all(file, &counts[r], sizeof(counts[r])) != EXIT_SUCCESS) goto truncated;
+		if (counts[r] > TRACE_RING_SIZE) goto truncated;
+		recs[r] = malloc(counts[r] * sizeof(trace_rec_t) + 1);
+		if (recs[r] == NULL || read_all(file, recs[r], counts[r] * sizeof(trace_rec_t)) != EXIT_SUCCESS) goto truncated;
+		if (counts[r] > 0 && recs[r][0].ns < first_ns)
+			first_ns = recs[r][0].ns;
+	}
+	fclose(file);
+
+	printf("{\"traceEvents\":[\n");
+	int first = 1;
+	for (uint32_t r=0; r < num_rings; r++) {
+		for (uint32_t i=0; i < counts[r]; i++) {
+			trace_rec_t *rec = &recs[r][i];
+			printf("%s{\"name\":", first ? "" : ",\n");
+			print_name(rec->span);
+			printf(",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+					rec->type == TRACE_BEGIN ? 'B' : 'E', (rec->ns - first_ns) / 1000.0, tids[r]);
+			first = 0;
+		}
+		free(recs[r]);
+	}
+	printf("\n]}\n");
+	return EXIT_SUCCESS;
+
+truncated:
+	fprintf(stderr, "%s is truncated or corrupt\n", argv[1]);
+	return EXIT_FAILURE;
+}
@@ -2,6 +2,7 @@
 #include <lgpio.h>
 #include <stdio.h>
 #include <math.h>
+#include "sensor_stats.h"
 #include"AD.h"
 
 int Config_Set;
@@ -10,7 +11,7 @@ int adc_fd;
 int AD_readU16(int reg) {
 	int val;
     unsigned char Val_L,Val_H;
-    val=lgI2cReadWordData(adc_fd,reg);                    //High and low bytes are the opposite       
+    val=stats_i2c(STATS_I2C_ADS1015, lgI2cReadWordData(adc_fd,reg));                    //High and low bytes are the opposite       
     Val_H=val&0xff;
     Val_L=val>>8;
     val=(Val_H<<8)|Val_L;                               //Correct byte order
@@ -22,7 +23,7 @@ void AD_writeWord(int reg, int val) {
     Val_H=val&0xff;
     Val_L=val>>8;
     val=(Val_H<<8)|Val_L;                               ////Correct byte order
-	lgI2cWriteWordData(adc_fd,reg,val);
+	stats_i2c(STATS_I2C_ADS1015, lgI2cWriteWordData(adc_fd,reg,val));
 }
 
 unsigned int ADS1015_INIT() {
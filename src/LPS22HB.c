@@ -3,27 +3,29 @@
 #include <stdio.h>
 #include <math.h>
 #include "LPS22HB.h"
+#include "sensor_stats.h"
 
-int lps22_fd;
+int lps22_fd = -1;
 
 char LPS22HB_readByte(int reg) {
-	return lgI2cReadByteData(lps22_fd, reg);
+	return stats_i2c(STATS_I2C_LPS22HB, lgI2cReadByteData(lps22_fd, reg));
 }
 
 unsigned short LPS22HB_readU16(int reg) {
-	return lgI2cReadWordData(lps22_fd, reg);
+	return stats_i2c(STATS_I2C_LPS22HB, lgI2cReadWordData(lps22_fd, reg));
 }
 
 void LPS22HB_writeByte(int reg, int val) {
-	lgI2cWriteByteData(lps22_fd, reg, val);
+	stats_i2c(STATS_I2C_LPS22HB, lgI2cWriteByteData(lps22_fd, reg, val));
 }
 
 void LPS22HB_RESET() {
 	unsigned char Buf;
+    int tries = 0;
     Buf=LPS22HB_readU16(LPS_CTRL_REG2);
     Buf|=0x04;                                         
     LPS22HB_writeByte(LPS_CTRL_REG2,Buf);                  //SWRESET Set 1
-    while(Buf)
+    while(Buf && tries++ < 100)
     {
         Buf=LPS22HB_readU16(LPS_CTRL_REG2);
         Buf&=0x04;
@@ -37,45 +39,65 @@ void LPS22HB_START_ONESHOT() {
     LPS22HB_writeByte(LPS_CTRL_REG2,Buf);
 }
 
-unsigned char LPS22HB_INIT() {
+/**
+ * Open the sensor and run it continuously at the odr code in CTRL_REG1 with the FIFO in
+ * stream mode.  The FIFO holds the newest 32 samples, so it only needs to be drained
+ * every few seconds.  The device stays open.
+ */
+unsigned char LPS22HB_INIT(unsigned char odr) {
+    if (lps22_fd >= 0)
+        LPS22HB_close();
     lps22_fd = lgI2cOpen(1,LPS22HB_I2C_ADDRESS,0);
     if (lps22_fd < 0)
     	return EXIT_FAILURE;
-    if(LPS22HB_readByte(LPS_WHO_AM_I)!=LPS_ID) return EXIT_FAILURE;    //Check device ID
+    if((unsigned char)LPS22HB_readByte(LPS_WHO_AM_I)!=LPS_ID) {    //Check device ID
+        LPS22HB_close();
+        return EXIT_FAILURE;
+    }
     LPS22HB_RESET();                                    //Wait for reset to complete
-    LPS22HB_writeByte(LPS_CTRL_REG1 ,   0x02);              //Low-pass filter disabled , output registers not updated until MSB and LSB have been read , Enable Block Data Update , Set Output Data Rate to 0
+    LPS22HB_writeByte(LPS_CTRL_REG1, odr | LPS_CTRL_REG1_EN_LPFP | LPS_CTRL_REG1_BDU); //Low-pass filter ODR/9, Block Data Update, continuous at odr
+    LPS22HB_writeByte(LPS_CTRL_REG2, LPS_CTRL_REG2_FIFO_EN | LPS_CTRL_REG2_IF_ADD_INC);
+    LPS22HB_writeByte(LPS_FIFO_CTRL, LPS_FIFO_MODE_STREAM);
     return EXIT_SUCCESS;
 }
 
-int LPS22HB_read(int *pressure, short *temperature) {
-	//float PRESS_DATA=0;
-	//float TEMP_DATA=0;
-	unsigned char u8Buf[3];
-
-	//printf("\nPressure Sensor Test Program ...\n");
-	if(LPS22HB_INIT() != EXIT_SUCCESS) {
-		//debug_print("Pressure Sensor Error\n");
-		return EXIT_FAILURE;
-	}
-	//    printf("\nPressure Sensor OK\n");
-	LPS22HB_START_ONESHOT();        //Trigger one shot data acquisition
-	if((LPS22HB_readByte(LPS_STATUS)&0x01)==0x01)   //a new pressure data is generated
-	{
-		u8Buf[0]=LPS22HB_readByte(LPS_PRESS_OUT_XL);
-		u8Buf[1]=LPS22HB_readByte(LPS_PRESS_OUT_L);
-		u8Buf[2]=LPS22HB_readByte(LPS_PRESS_OUT_H);
-		*pressure=(u8Buf[2]<<16)+(u8Buf[1]<<8)+u8Buf[0];
-		//PRESS_DATA=(float)((u8Buf[2]<<16)+(u8Buf[1]<<8)+u8Buf[0])/4096.0f;
-	}
-	if((LPS22HB_readByte(LPS_STATUS)&0x02)==0x02)   // a new pressure data is generated
-	{
-		u8Buf[0]=LPS22HB_readByte(LPS_TEMP_OUT_L);
-		u8Buf[1]=LPS22HB_readByte(LPS_TEMP_OUT_H);
-		*temperature=(u8Buf[1]<<8)+u8Buf[0];
-		//TEMP_DATA=(float)((u8Buf[1]<<8)+u8Buf[0])/100.0f;
+void LPS22HB_close() {
+	if (lps22_fd >= 0) {
+		LPS22HB_writeByte(LPS_CTRL_REG1, 0x00); // Power down
+		lgI2cClose(lps22_fd);
 	}
+	lps22_fd = -1;
+}
 
-	//debug_print("Pressure = %6.2f hPa , Temperature = %6.2f °C\r\n", PRESS_DATA, TEMP_DATA);
-	lgI2cClose(lps22_fd);
-	return EXIT_SUCCESS;
+/**
+ * Read all of the samples in the FIFO in one transaction.  Each sample is the 3 pressure
+ * bytes and 2 temperature bytes.  With the FIFO enabled the address rolls back from
+ * TEMP_OUT_H to PRESS_OUT_XL, so a single read of 5 x n bytes pops n samples.
+ * Returns the number of samples, or -1 on an error.  overflow is set if samples were lost.
+ */
+int LPS22HB_read_fifo(int *pressure, short *temperature, int max, int *overflow) {
+	unsigned char reg = LPS_PRESS_OUT_XL;
+	unsigned char buf[LPS_FIFO_SIZE * LPS_SAMPLE_LEN];
+	if (lps22_fd < 0)
+		return -1;
+	int status = stats_i2c(STATS_I2C_LPS22HB, lgI2cReadByteData(lps22_fd, LPS_FIFO_STATUS));
+	if (status < 0)
+		return -1;
+	*overflow = (status & LPS_FIFO_STATUS_OVR) != 0;
+	int n = status & LPS_FIFO_STATUS_FSS;
+	if (n > max) n = max;
+	if (n > LPS_FIFO_SIZE) n = LPS_FIFO_SIZE;
+	if (n == 0)
+		return 0;
+	lgI2cMsg_t segs[2] = {
+			{ LPS22HB_I2C_ADDRESS, 0, 1, &reg },
+			{ LPS22HB_I2C_ADDRESS, LG_I2C_M_RD, n * LPS_SAMPLE_LEN, buf } };
+	if (stats_i2c(STATS_I2C_LPS22HB, lgI2cSegments(lps22_fd, segs, 2)) < 0)
+		return -1;
+	for (int i=0; i < n; i++) {
+		unsigned char *b = &buf[i * LPS_SAMPLE_LEN];
+		pressure[i] = (b[2]<<16)+(b[1]<<8)+b[0];
+		temperature[i] = (short)((b[4]<<8)+b[3]);
+	}
+	return n;
 }
@@ -4,10 +4,11 @@
 #include <math.h>
 #include "SHTC3.h"
 #include <unistd.h>
+#include "sensor_stats.h"
 
 unsigned short TH_DATA, RH_DATA;
-char checksum;
-int shtc3_fd;
+int shtc3_fd = -1;
+static int low_power = 0;
 
 char SHTC3_CheckCrc(char data[], unsigned char len, unsigned char checksum) {
   unsigned char bit;        // bit mask
@@ -42,12 +43,13 @@ char SHTC3_CheckCrc(char data[], unsigned char len, unsigned char checksum) {
 }
 int SHTC3_WriteCommand(unsigned short cmd) {
   char buf[] = {(cmd >> 8), cmd};
-  return lgI2cWriteByteData(shtc3_fd, buf[0], buf[1]);
+  return stats_i2c(STATS_I2C_SHTC3, lgI2cWriteByteData(shtc3_fd, buf[0], buf[1]));
   // 1:error 0:No error
 }
-void SHTC3_WAKEUP() {
-  SHTC3_WriteCommand(SHTC3_WakeUp); // write wake_up command
-  lguSleep(0.02);                           // Delay 300us
+int SHTC3_WAKEUP() {
+  int rc = SHTC3_WriteCommand(SHTC3_WakeUp); // write wake_up command
+  lguSleep(SHTC3_WAKEUP_TIME);               // Delay 240us
+  return rc;
 }
 void SHTC3_SLEEP() {
   //   bcm2835_i2c_begin();
@@ -59,41 +61,80 @@ void SHTC_SOFT_RESET() {
   lguSleep(0.02);                       // Delay 300us
 }
 
-void SHTC3_Read_DATA() {
-
-  char buf[3];
-  SHTC3_WAKEUP();
-  SHTC3_WriteCommand(SHTC3_NM_CD_ReadTH); // Read temperature first,clock streching disabled (polling)
-  lguSleep(0.02);
-  lgI2cReadDevice(shtc3_fd, buf, 3);
-
-  checksum = buf[2];
-  if (!SHTC3_CheckCrc(buf, 2, checksum))
-    TH_DATA = (buf[0] << 8 | buf[1]);
+/**
+ * Use the low power measurement.  This takes under 1ms instead of 12ms but is noisier.
+ */
+void SHTC3_set_low_power(int on) {
+  low_power = on;
+}
 
-  SHTC3_WriteCommand(SHTC3_NM_CD_ReadRH); // Read temperature first,clock streching disabled (polling)
-  lguSleep(0.02);
-  lgI2cReadDevice(shtc3_fd, buf, 3);
+/**
+ * Measure temperature and humidity with one command.  The result is temperature, CRC,
+ * humidity, CRC.  Clock stretching is disabled, so the sensor NACKs the read until the
+ * measurement is complete.  We wait the typical measurement time and then poll until
+ * the maximum time.  The sensor is put back to sleep after the read.
+ */
+int SHTC3_Read_DATA() {
+  char buf[6];
+  int rc;
+  double typ = low_power ? SHTC3_LP_MEAS_TIME_TYP : SHTC3_NM_MEAS_TIME_TYP;
+  double max = low_power ? SHTC3_LP_MEAS_TIME_MAX : SHTC3_NM_MEAS_TIME_MAX;
 
-  checksum = buf[2];
-  if (!SHTC3_CheckCrc(buf, 2, checksum))
-    RH_DATA = (buf[0] << 8 | buf[1]);
+  if (SHTC3_WAKEUP() < 0)
+    return SHTC3_ERR_COMM;
+  if (SHTC3_WriteCommand(low_power ? SHTC3_LM_CD_ReadTH : SHTC3_NM_CD_ReadTH) < 0) { // Temperature first, clock stretching disabled (polling)
+    SHTC3_SLEEP();
+    return SHTC3_ERR_COMM;
+  }
+  lguSleep(typ);
+  double waited = typ;
+  while ((rc = lgI2cReadDevice(shtc3_fd, buf, 6)) != 6 && waited < max) {
+    lguSleep(SHTC3_POLL_TIME);
+    waited += SHTC3_POLL_TIME;
+  }
+  SHTC3_SLEEP();
+  stats_i2c(STATS_I2C_SHTC3, rc == 6 ? rc : LG_I2C_READ_FAILED); // The NACKs while polling are expected
+  if (rc != 6)
+    return SHTC3_ERR_TIMEOUT;
 
+  if (SHTC3_CheckCrc(buf, 2, buf[2]) || SHTC3_CheckCrc(&buf[3], 2, buf[5])) {
+    stats_count(STATS_SHTC3_CRC_ERRORS, 1);
+    return SHTC3_ERR_CRC;
+  }
+  TH_DATA = ((unsigned char)buf[0] << 8 | (unsigned char)buf[1]);
+  RH_DATA = ((unsigned char)buf[3] << 8 | (unsigned char)buf[4]);
+  return EXIT_SUCCESS;
 }
 
+/**
+ * Read the temperature and humidity.  The device is opened on the first read and kept
+ * open.  Nothing is returned unless both CRCs are good.
+ */
 int SHTC3_read(short *temp, short *humidity) {
 	//printf("\n SHTC3 Sensor Test Program ...\n");
 
-	shtc3_fd = lgI2cOpen(1, SHTC3_I2C_ADDRESS, 0);
-	if (shtc3_fd < 0)
-		return EXIT_FAILURE;
-	SHTC3_Read_DATA();
+	if (shtc3_fd < 0) {
+		shtc3_fd = lgI2cOpen(1, SHTC3_I2C_ADDRESS, 0);
+		if (shtc3_fd < 0)
+			return SHTC3_ERR_COMM;
+	}
+	int rc = SHTC3_Read_DATA();
+	if (rc != EXIT_SUCCESS) {
+		if (rc == SHTC3_ERR_COMM)
+			SHTC3_close(); // open again next time
+		return rc;
+	}
 	*temp = TH_DATA;
 	*humidity = RH_DATA;
 	//float TH_Value, RH_Value;
 	//TH_Value = 175 * (float)TH_DATA / 65536.0f - 45.0f; // Calculate temperature value
 	//RH_Value = 100 * (float)RH_DATA / 65536.0f;         // Calculate humidity value
 	//debug_print("Temperature = %6.2f°C , Humidity = %6.2f%% \r\n", TH_Value, RH_Value);
-	lgI2cClose(shtc3_fd);
 	return EXIT_SUCCESS;
 }
+
+void SHTC3_close() {
+	if (shtc3_fd >= 0)
+		lgI2cClose(shtc3_fd);
+	shtc3_fd = -1;
+}
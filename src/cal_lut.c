@@ -0,0 +1,201 @@
+/*
+ * cal_lut.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Calibration curves.  Each named curve converts a raw reading to a value, for example
+ * ADC counts to mV or a temperature to a correction.  A curve is a piecewise linear set
+ * of points, a polynomial or, for curves defined in the code, a function.  When it is
+ * defined it is evaluated at CAL_LUT_SIZE + 1 evenly spaced points over its range and
+ * stored in a table.  A conversion is then an index and one linear interpolation,
+ * whatever the curve.
+ *
+ * The drivers define their default curves in code.  The curves file is loaded after
+ * that and replaces any curve with the same name, so a curve can be changed or added
+ * without a recompile.  The file is key=value like the config file:
+ *
+ *   name=pwl x0:y0 x1:y1 ...
+ *   name=poly xmin xmax c0 c1 c2 ...     y = c0 + c1 x + c2 x^2 ...
+ *
+ * Curves are only defined at startup before the threads are started, so the tables are
+ * not locked.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cal_lut.h"
+#include "str_util.h"
+#include "debug.h"
+
+#define MAX_CURVE_LINE_LENGTH 512
+
+typedef struct cal_lut {
+	char name[CAL_LUT_NAME_LEN];
+	double xmin;
+	double xmax;
+	double inv_step;
+	double table[CAL_LUT_SIZE + 1];
+} cal_lut_t;
+
+static cal_lut_t curves[CAL_LUT_MAX_CURVES];
+static int num_of_curves = 0;
+
+int cal_lut_find(const char *name) {
+	for (int i=0; i < num_of_curves; i++)
+		if (strcmp(curves[i].name, name) == 0)
+			return i;
+	return -1;
+}
+
+/* Find the curve to (re)define, or add a new one.  Returns NULL if the table is full */
+static cal_lut_t *cal_lut_slot(const char *name, double xmin, double xmax) {
+	if (xmax <= xmin) {
+		error_print("Curve %s has an empty range\n", name);
+		return NULL;
+	}
+	int i = cal_lut_find(name);
+	if (i < 0) {
+		if (num_of_curves >= CAL_LUT_MAX_CURVES) {
+			error_print("Too many calibration curves, can not add: %s\n", name);
+			return NULL;
+		}
+		i = num_of_curves++;
+		strlcpy(curves[i].name, name, sizeof(curves[i].name));
+	}
+	curves[i].xmin = xmin;
+	curves[i].xmax = xmax;
+	curves[i].inv_step = CAL_LUT_SIZE / (xmax - xmin);
+	return &curves[i];
+}
+
+/**
+ * Define a piecewise linear curve.  The x values must increase.  Two points with the
+ * same x make a step.
+ */
+int cal_lut_define_pwl(const char *name, const double *x, const double *y, int n) {
+	if (n < 2) return EXIT_FAILURE;
+	for (int k=1; k < n; k++)
+		if (x[k] < x[k-1]) {
+			error_print("Curve %s x values must increase\n", name);
+			return EXIT_FAILURE;
+		}
+	cal_lut_t *lut = cal_lut_slot(name, x[0], x[n-1]);
+	if (lut == NULL) return EXIT_FAILURE;
+	int k = 0;
+	for (int i=0; i <= CAL_LUT_SIZE; i++) {
+		double xi = lut->xmin + i / lut->inv_step;
+		while (k < n - 2 && xi > x[k+1]) k++;
+		if (x[k+1] == x[k])
+			lut->table[i] = y[k+1];
+		else
+			lut->table[i] = y[k] + (y[k+1] - y[k]) * (xi - x[k]) / (x[k+1] - x[k]);
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Define a polynomial c[0] + c[1] x + ... over xmin to xmax
+ */
+int cal_lut_define_poly(const char *name, double xmin, double xmax, const double *c, int n) {
+	if (n < 1) return EXIT_FAILURE;
+	cal_lut_t *lut = cal_lut_slot(name, xmin, xmax);
+	if (lut == NULL) return EXIT_FAILURE;
+	for (int i=0; i <= CAL_LUT_SIZE; i++) {
+		double xi = lut->xmin + i / lut->inv_step;
+		double yi = 0;
+		for (int k=n-1; k >= 0; k--)
+			yi = yi * xi + c[k];
+		lut->table[i] = yi;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Define a curve from a function.  This is for curves that are neither piecewise linear
+ * nor polynomial, like a thermistor.  The function is only called here.
+ */
+int cal_lut_define_fn(const char *name, double xmin, double xmax, double (*fn)(double)) {
+	cal_lut_t *lut = cal_lut_slot(name, xmin, xmax);
+	if (lut == NULL) return EXIT_FAILURE;
+	for (int i=0; i <= CAL_LUT_SIZE; i++)
+		lut->table[i] = fn(lut->xmin + i / lut->inv_step);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Convert x with a curve.  Outside the range the curve is held at its end value, use
+ * cal_lut_in_range() if that matters.  An invalid curve returns 0.
+ */
+double cal_lut_eval(int curve, double x) {
+	if (curve < 0 || curve >= num_of_curves) return 0;
+	cal_lut_t *lut = &curves[curve];
+	double t = (x - lut->xmin) * lut->inv_step;
+	if (t <= 0) return lut->table[0];
+	if (t >= CAL_LUT_SIZE) return lut->table[CAL_LUT_SIZE];
+	int i = (int)t;
+	double f = t - i;
+	return lut->table[i] + f * (lut->table[i+1] - lut->table[i]);
+}
+
+int cal_lut_in_range(int curve, double x) {
+	if (curve < 0 || curve >= num_of_curves) return 0;
+	return x >= curves[curve].xmin && x <= curves[curve].xmax;
+}
+
+/**
+ * Load curves from the file.  A missing file is not an error, the defaults are used.
+ */
+int cal_lut_load(char *filename) {
+	char line[MAX_CURVE_LINE_LENGTH];
+	double a[CAL_LUT_MAX_POINTS], b[CAL_LUT_MAX_POINTS];
+	char *save;
+	debug_print("Loading curves from: %s:\n", filename);
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		debug_print(" No curves file, using defaults\n");
+		return EXIT_FAILURE;
+	}
+	while (fgets(line, sizeof line, file) != NULL) {
+		if (line[0] == '#') continue;
+		line[strcspn(line,"\n")] = 0;
+		char *name = strtok_r(line, "=", &save);
+		char *type = strtok_r(NULL, " ", &save);
+		if (name == NULL || type == NULL) continue;
+		int n = 0;
+		int rc = EXIT_FAILURE;
+		char *tok;
+		if (strcmp(type, "pwl") == 0) {
+			while ((tok = strtok_r(NULL, " ", &save)) != NULL && n < CAL_LUT_MAX_POINTS)
+				if (sscanf(tok, "%lf:%lf", &a[n], &b[n]) == 2) n++;
+			rc = cal_lut_define_pwl(name, a, b, n);
+		} else if (strcmp(type, "poly") == 0) {
+			while ((tok = strtok_r(NULL, " ", &save)) != NULL && n < CAL_LUT_MAX_POINTS)
+				a[n++] = atof(tok);
+			if (n >= 3)
+				rc = cal_lut_define_poly(name, a[0], a[1], &a[2], n - 2);
+		}
+		if (rc == EXIT_SUCCESS)
+			debug_print(" %s %s\n", name, type);
+		else
+			error_print("Invalid curve in %s: %s\n", filename, name);
+	}
+	fclose(file);
+	return EXIT_SUCCESS;
+}
@@ -25,9 +25,17 @@
 #include "sensor_telemetry.h"
 #include "cosmic_watch.h"
 #include "str_util.h"
+#include "sensor_stats.h"
+#include "trace.h"
+#include "log_index.h"
+#include "storage_quota.h"
+#include "time_service.h"
+#include "device_supervisor.h"
+
+#define CW_NS_PER_CHAR (10 * 1000000000ULL / 9600) /* 8N1 at B9600 */
 
 /* Forward declarations */
-int cw_listen_process(char *data_folder_path, char *serial_dev, speed_t speed, int *thread_status);
+int cw_listen_process(int cw, int device, char *data_folder_path, char *serial_dev, speed_t speed, int *thread_status);
 cw_data_t *cw_parse_data(char *str_data);
 void cw_debug_print_data(cw_data_t *data);
 
@@ -39,6 +47,8 @@ cw_data_t cw_coincident_data; // This is the co-incident data
 /* Local vars */
 static int cw1_listen_thread_called = 0;
 static int cw2_listen_thread_called = 0;
+static log_index_t cw_raw_index = LOG_INDEX_INIT; /* Written with the cw_mutex held */
+static log_index_t cw_coincident_index = LOG_INDEX_INIT;
 int debug_parsing = false;
 
 /* This is global and set in main.c */
@@ -51,13 +61,22 @@ int debug_counts = false;
  *
  * Data is sent in plain text, space delimited, with the following columns:
  * Event_number Time_in_ms_since_start ADC sipm(mV) dead_time_ms temp_deg_c
+ * Each line is written to the log with the UTC ms of the event added on the end, which is
+ * placed from the detector time by the time service.
+ *
+ * cw is 0 for the first detector and 1 for the second.  It selects the stats counters.
+ * device is its id in the device supervisor, which is told once the port works.  Returns
+ * EXIT_FAILURE if the port can not be opened or stops working, so the caller can try again
+ * after a backoff, or EXIT_SUCCESS when the thread is asked to exit.
  *
  */
-int cw_listen_process(char *data_folder_path, char *serial_dev, speed_t speed, int *thread_status) {
+int cw_listen_process(int cw, int device, char *data_folder_path, char *serial_dev, speed_t speed, int *thread_status) {
+	int stats_offset = cw * (STATS_CW2_BYTES - STATS_CW1_BYTES);
 	char response[CW_RESPONSE_LEN];
 	FILE *fptr;
 	int file_error = false;
 	int first_entry = true;
+	int working = false;
     int max_file_size = g_state_sensors_cw_raw_max_file_size_in_kb;
 
 
@@ -68,14 +87,38 @@ int cw_listen_process(char *data_folder_path, char *serial_dev, speed_t speed, i
 		while (*thread_status) { // monitor the serial port while program running
 			//if (g_verbose) debug_print("Waiting for CW: %s..\n",serial_dev);
 			//				int n = read(fd, response, CW_RESPONSE_LEN);
+			trace_begin(TRACE_CW_READ);
 			int len = read_serial_line(serial_dev, speed, response, CW_RESPONSE_LEN, '\r');
+			/* Stamp the line as it arrives.  The detector sent it a line's worth of characters earlier */
+			uint64_t arrival_ns = time_mono_ns() - (len > 0 ? (len + 1) * CW_NS_PER_CHAR : 0);
+			trace_end(TRACE_CW_READ);
+			/* -2 is a timeout with no line, so go round and check thread_status */
+			if (len == -1 || len == -3) {
+				/* The port has gone, rather than a bad line */
+				close_serial(fd);
+				log_err(g_log_filename, SENSOR_ERR_CW_FAILURE);
+				return EXIT_FAILURE;
+			}
 			usleep(10*1000);
 			if (len > 0) {
+				if (!working) {
+					supervisor_ok(device);
+					working = true;
+				}
 				//response[n] = 0; // terminate the string
 				//debug_print("cw1##%s##",response);
+				stats_count(STATS_CW1_BYTES + stats_offset, len + 1);
+				stats_count(STATS_CW1_LINES + stats_offset, 1);
 				pthread_mutex_lock(&cw_mutex);
+				trace_begin(TRACE_CW_PARSE);
 				cw_data_t *cw_data = cw_parse_data(response);
+				trace_end(TRACE_CW_PARSE);
+				if (cw_data == NULL)
+					stats_count(STATS_CW1_BAD_LINES + stats_offset, 1);
 				if (cw_data != NULL) {
+					stats_cw_event(cw, cw_data->event_num);
+					/* Place the event on the common time base from the detector clock */
+					uint64_t event_ms = time_cw_place(cw, cw_data->time_ms, arrival_ns) / 1000000;
 					if (debug_counts) cw_debug_print_data(cw_data);
 					/* Write data to the temp file */
 					char log_path[MAX_FILE_PATH_LEN];
@@ -83,43 +126,63 @@ int cw_listen_process(char *data_folder_path, char *serial_dev, speed_t speed, i
 					strlcat(log_path,"/",MAX_FILE_PATH_LEN);
 					strlcat(log_path,get_folder_str(FolderTxt),MAX_FILE_PATH_LEN);
 					strlcat(log_path,"/",MAX_FILE_PATH_LEN);
+					int quota_stream;
+					log_index_t *index;
 					if (cw_data->master_slave[0] == 'M') {
 						max_file_size = g_state_sensors_cw_raw_max_file_size_in_kb;
 						strlcat(log_path,g_sensors_cw_raw_log_path,MAX_FILE_PATH_LEN);
+						quota_stream = QUOTA_CW_RAW;
+						index = &cw_raw_index;
 					} else {
 						max_file_size = g_state_sensors_cw_coincident_max_file_size_in_kb;
 						strlcat(log_path,g_sensors_cw_coincident_log_path,MAX_FILE_PATH_LEN);
+						quota_stream = QUOTA_CW_COINCIDENT;
+						index = &cw_coincident_index;
 					}
-					if (max_file_size != 0) {
+					if (max_file_size != 0 && quota_write_allowed(quota_stream)) {
 						char tmp_filename[MAX_FILE_PATH_LEN];
 						log_make_tmp_filename(log_path, tmp_filename);
+						trace_begin(TRACE_CW_WRITE);
+						uint64_t write_start = stats_now_us();
 						fptr = fopen(tmp_filename, "a");
 						if (fptr != NULL) {
 							if (first_entry) {
 								/* *Write the date time */
 								char data_str[256];
-								time_t now = time(0);
-								strftime(data_str, sizeof(data_str), "SOOSS CosmicWatch start: %y%m%d %H%M%S UTC", gmtime(&now));
+								uint64_t now_ms = time_utc_ms();
+								time_t now = now_ms / 1000;
+								char date_str[32];
+								strftime(date_str, sizeof(date_str), "%y%m%d %H%M%S", gmtime(&now));
+								snprintf(data_str, sizeof(data_str), "SOOSS CosmicWatch start: %s.%03d UTC", date_str, (int)(now_ms % 1000));
 								fwrite(data_str, 1, 256, fptr);
 								fwrite("\n", 1, 1, fptr);
 								first_entry=false;
 							}
+							/* The line from the detector then the UTC ms of the event */
+							char stamp[32];
+							int stamp_len = snprintf(stamp, sizeof(stamp), " %llu\n", (unsigned long long)event_ms);
 							fwrite(response, 1, len, fptr);
-							fwrite("\n", 1, 1, fptr);
-							fclose(fptr);
+							fwrite(stamp, 1, stamp_len, fptr);
+							stats_file_io(write_start, fclose(fptr) == 0);
 							file_error = false;
 
 							long size = get_file_size(tmp_filename);
+							if (size >= len + stamp_len)
+								log_index_add(index, log_path, event_ms / 1000, size - len - stamp_len);
 
 							if (size/1024 > max_file_size) {
 								if (g_verbose) printf("Rolling SENSOR CW file %s as it is: %.1f KB\n",log_path, size/1024.0);
 								log_add_to_directory(log_path);
+								log_index_roll(index);
+								quota_roll(quota_stream, size);
 							}
 						} else {
+							stats_file_io(write_start, false);
 							if (!file_error)
 								log_err(g_log_filename, SENSOR_ERR_CW_FAILURE);
 							file_error = true;
 						}
+						trace_end(TRACE_CW_WRITE);
 					}
 				} /* If cw_data != NULL */
 				pthread_mutex_unlock(&cw_mutex);
@@ -134,6 +197,25 @@ int cw_listen_process(char *data_folder_path, char *serial_dev, speed_t speed, i
 		return EXIT_FAILURE;
 	}
 }
+/**
+ * Run a listener until it is asked to exit.  If the port can not be opened, or stops
+ * working, it is tried again after the backoff from the device supervisor, rather than the
+ * thread exiting for good.
+ */
+static void cw_supervise(int cw, char *data_folder_path, char *serial_dev, int *thread_status) {
+	char name[8];
+	snprintf(name, sizeof(name), "cw%d", cw + 1);
+	int device = supervisor_add(name);
+	int tries = 0;
+	while (supervisor_wait(device, thread_status)) {
+		if (tries++ > 0)
+			supervisor_restarted(device);
+		if (cw_listen_process(cw, device, data_folder_path, serial_dev, B9600, thread_status) == EXIT_SUCCESS)
+			break;
+		supervisor_failed(device, time(0));
+	}
+}
+
 void *cw1_listen_process(void * arg) {
 	char *data_folder_path;
 	data_folder_path = (char *) arg;
@@ -143,7 +225,7 @@ void *cw1_listen_process(void * arg) {
 	}
 	cw1_listen_thread_called = true;
 	//debug_print("Starting Thread: %s\n", name);
-	cw_listen_process(data_folder_path, g_cw1_serial_dev, B9600, &cw1_listen_thread_called);
+	cw_supervise(0, data_folder_path, g_cw1_serial_dev, &cw1_listen_thread_called);
 	debug_print("CW1 Thread.  Exiting: %s\n", data_folder_path);
 	return NULL;
 }
@@ -157,7 +239,7 @@ void *cw2_listen_process(void * arg) {
 	}
 	cw2_listen_thread_called = true;
 	//debug_print("Starting Thread: %s\n", name);
-	cw_listen_process(data_folder_path, g_cw2_serial_dev, B9600, &cw2_listen_thread_called);
+	cw_supervise(1, data_folder_path, g_cw2_serial_dev, &cw2_listen_thread_called);
 	debug_print("CW2 Thread.  Exiting: %s\n", data_folder_path);
 	return NULL;
 }
@@ -0,0 +1,176 @@
+/*
+ * device_supervisor.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * The devices are used from the main loop and the reader threads, so they are kept under
+ * one mutex.  Only the changes of state are printed, so a device that stays down does not
+ * fill the log.  An id of -1, from a full table, is always allowed to try.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common_config.h"
+#include "sensors_config.h"
+#include "device_supervisor.h"
+#include "str_util.h"
+#include "debug.h"
+
+typedef struct device {
+	char name[16];
+	int state;
+	unsigned int failures;         /* Since it last worked */
+	unsigned int total_failures;
+	unsigned int restarts;         /* Reader threads started again */
+	int backoff;                   /* Seconds of the current wait */
+	uint32_t next_try;
+} device_t;
+
+static device_t devices[SUPERVISOR_MAX_DEVICES];
+static int num_of_devices = 0;
+static pthread_mutex_t supervisor_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Add a device and return its id.  A device that is already known keeps its id and its
+ * history, so a thread that is started again can add itself again.
+ */
+int supervisor_add(const char *name) {
+	pthread_mutex_lock(&supervisor_mutex);
+	int id;
+	for (id=0; id < num_of_devices; id++)
+		if (strcmp(devices[id].name, name) == 0)
+			break;
+	if (id == num_of_devices) {
+		if (num_of_devices < SUPERVISOR_MAX_DEVICES) {
+			memset(&devices[id], 0, sizeof(device_t));
+			strlcpy(devices[id].name, name, sizeof(devices[id].name));
+			num_of_devices++;
+		} else {
+			error_print("Too many devices to supervise, can not add: %s\n", name);
+			id = -1;
+		}
+	}
+	pthread_mutex_unlock(&supervisor_mutex);
+	return id;
+}
+
+/**
+ * True if the device can be opened or probed now, because it has not failed or its wait
+ * is over.
+ */
+int supervisor_may_try(int id, uint32_t now) {
+	if (id < 0) return true;
+	pthread_mutex_lock(&supervisor_mutex);
+	int may = devices[id].state != DEVICE_FAILED || now >= devices[id].next_try;
+	pthread_mutex_unlock(&supervisor_mutex);
+	return may;
+}
+
+void supervisor_ok(int id) {
+	if (id < 0) return;
+	pthread_mutex_lock(&supervisor_mutex);
+	device_t *d = &devices[id];
+	if (d->state == DEVICE_FAILED)
+		debug_print("Device %s is working again after %d failures\n", d->name, d->failures);
+	d->state = DEVICE_OK;
+	d->failures = 0;
+	d->backoff = 0;
+	pthread_mutex_unlock(&supervisor_mutex);
+}
+
+/**
+ * The device could not be opened or has stopped working.  It is not tried again until its
+ * wait is over, and the wait doubles each time.
+ */
+void supervisor_failed(int id, uint32_t now) {
+	if (id < 0) return;
+	pthread_mutex_lock(&supervisor_mutex);
+	device_t *d = &devices[id];
+	if (d->backoff <= 0)
+		d->backoff = g_supervisor_backoff_min;
+	else if (d->backoff < g_supervisor_backoff_max / 2)
+		d->backoff *= 2;
+	else
+		d->backoff = g_supervisor_backoff_max;
+	if (d->backoff < 1)
+		d->backoff = 1;
+	d->next_try = now + d->backoff;
+	d->failures++;
+	d->total_failures++;
+	if (d->state != DEVICE_FAILED)
+		debug_print("Device %s failed, trying again in %d seconds\n", d->name, d->backoff);
+	d->state = DEVICE_FAILED;
+	pthread_mutex_unlock(&supervisor_mutex);
+}
+
+void supervisor_restarted(int id) {
+	if (id < 0) return;
+	pthread_mutex_lock(&supervisor_mutex);
+	devices[id].restarts++;
+	pthread_mutex_unlock(&supervisor_mutex);
+}
+
+/**
+ * Forget the failures of a device that has been switched off, so it is tried as soon as
+ * it is switched on again.
+ */
+void supervisor_reset(int id) {
+	if (id < 0) return;
+	pthread_mutex_lock(&supervisor_mutex);
+	devices[id].state = DEVICE_UNKNOWN;
+	devices[id].failures = 0;
+	devices[id].backoff = 0;
+	pthread_mutex_unlock(&supervisor_mutex);
+}
+
+/**
+ * Sleep until the device may be tried again, or until *running is cleared so the thread
+ * can exit.  Returns *running.
+ */
+int supervisor_wait(int id, int *running) {
+	while (*running && !supervisor_may_try(id, time(0)))
+		sleep(1);
+	return *running;
+}
+
+int supervisor_num_failed() {
+	int n = 0;
+	pthread_mutex_lock(&supervisor_mutex);
+	for (int id=0; id < num_of_devices; id++)
+		if (devices[id].state == DEVICE_FAILED)
+			n++;
+	pthread_mutex_unlock(&supervisor_mutex);
+	return n;
+}
+
+/**
+ * Print a line for each device to the stats file
+ */
+void supervisor_print(FILE *file) {
+	uint32_t now = time(0);
+	pthread_mutex_lock(&supervisor_mutex);
+	for (int id=0; id < num_of_devices; id++) {
+		device_t *d = &devices[id];
+		fprintf(file, "device %s state %d failures %u restarts %u retry_in %d\n", d->name, d->state,
+				d->total_failures, d->restarts,
+				d->state == DEVICE_FAILED && d->next_try > now ? (int)(d->next_try - now) : 0);
+	}
+	pthread_mutex_unlock(&supervisor_mutex);
+}
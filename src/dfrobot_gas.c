@@ -22,14 +22,63 @@
 #include <lgpio.h>
 #include <math.h>
 #include "dfrobot_gas.h"
+#include "cal_lut.h"
+#include "sensor_stats.h"
 
 //unsigned short TH_DATA, CONC_DATA;
 int dfr_gas_fd = -1;
-int _tempswitch = 0;
+
+#define DFR_CURVE_UNRESOLVED -2
+static int thermistor_curve = -1;
+static int gain_curve[256];
+static int offset_curve[256];
+
+/* Names used for the per gas compensation curves, dfr_gain_<name> and dfr_offset_<name> */
+static const struct {
+  uint8_t type;
+  const char *name;
+} gas_names[] = {
+  {O2, "o2"}, {CO, "co"}, {H2S, "h2s"}, {NO2, "no2"}, {O3, "o3"}, {CL2, "cl2"}, {NH3, "nh3"},
+  {H2, "h2"}, {HCL, "hcl"}, {SO2, "so2"}, {HF, "hf"}, {_PH3, "ph3"}
+};
+
+/* Thermistor on the sensor board, 10 bit ADC to C */
+static double thermistor_c(double adc) {
+  double Vpd3 = 3*adc/1024;
+  double Rth = Vpd3*10000/(3-Vpd3);
+  return 1/(1/(273.15+25)+1/3380.13*log(Rth/10000))-273.15;
+}
+
+/**
+ * Define the default curves for this sensor.  Called before the curves file is loaded.
+ * The temperature compensation curves for each gas are only in the curves file.
+ */
+void dfr_gas_define_curves() {
+  cal_lut_define_fn("dfr_thermistor_c", 1, 1023, thermistor_c);
+  thermistor_curve = cal_lut_find("dfr_thermistor_c");
+  for (int i=0; i < 256; i++) {
+    gain_curve[i] = DFR_CURVE_UNRESOLVED;
+    offset_curve[i] = DFR_CURVE_UNRESOLVED;
+  }
+}
+
+/* Look up the compensation curves for a gas the first time we see it */
+static void dfr_resolve_curves(uint8_t gastype) {
+  char name[CAL_LUT_NAME_LEN];
+  gain_curve[gastype] = -1;
+  offset_curve[gastype] = -1;
+  for (unsigned int i=0; i < sizeof(gas_names)/sizeof(gas_names[0]); i++)
+    if (gas_names[i].type == gastype) {
+      snprintf(name, sizeof(name), "dfr_gain_%s", gas_names[i].name);
+      gain_curve[gastype] = cal_lut_find(name);
+      snprintf(name, sizeof(name), "dfr_offset_%s", gas_names[i].name);
+      offset_curve[gastype] = cal_lut_find(name);
+    }
+}
 
 int dfr_write_command(unsigned short cmd) {
   char buf[] = {(cmd >> 8), cmd};
-  return lgI2cWriteByteData(dfr_gas_fd, buf[0], buf[1]);
+  return stats_i2c(STATS_I2C_DFROBOT, lgI2cWriteByteData(dfr_gas_fd, buf[0], buf[1]));
   // 1:error 0:No error
 }
 
@@ -59,30 +108,28 @@ float readTempC(void) {
   uint8_t recvbuf[9] = {0};
   buf[0] = CMD_GET_TEMP;
   sProtocol_t _protocol = pack(buf, sizeof(buf));
-  lgI2cWriteI2CBlockData(dfr_gas_fd, 0, (char *)&_protocol, sizeof(_protocol));
+  stats_i2c(STATS_I2C_DFROBOT, lgI2cWriteI2CBlockData(dfr_gas_fd, 0, (char *)&_protocol, sizeof(_protocol)));
   lguSleep(0.02);
-  lgI2cReadI2CBlockData(dfr_gas_fd, 0, (char *)recvbuf, 9);
-  if (recvbuf[8] != FucCheckSum(recvbuf, 8))
+  stats_i2c(STATS_I2C_DFROBOT, lgI2cReadI2CBlockData(dfr_gas_fd, 0, (char *)recvbuf, 9));
+  if (recvbuf[8] != FucCheckSum(recvbuf, 8)) {
+    stats_count(STATS_DFR_CHECKSUM_ERRORS, 1);
     return 0.0;
+  }
   uint16_t temp_ADC = (recvbuf[2] << 8) + recvbuf[3];
-  float Vpd3=3*(float)temp_ADC/1024;
-  float Rth = Vpd3*10000/(3-Vpd3);
-  float Tbeta = 1/(1/(273.15+25)+1/3380.13*log(Rth/10000))-273.15;
-  return Tbeta;
+  return cal_lut_eval(thermistor_curve, temp_ADC);
 }
 
-float readGasConcentrationPPM(void) {
+float readGasConcentrationPPM(float temp) {
   uint8_t buf[6] = {0};
   uint8_t recvbuf[9] = {0};
   uint8_t gastype;
   uint8_t decimal_digits;
   buf[0] = CMD_GET_GAS_CONCENTRATION;
   sProtocol_t _protocol = pack(buf, sizeof(buf));
-  lgI2cWriteI2CBlockData(dfr_gas_fd, 0, (char *)&_protocol, sizeof(_protocol));
+  stats_i2c(STATS_I2C_DFROBOT, lgI2cWriteI2CBlockData(dfr_gas_fd, 0, (char *)&_protocol, sizeof(_protocol)));
   lguSleep(0.02);
-  lgI2cReadI2CBlockData(dfr_gas_fd,0, (char *)recvbuf, 9);
+  stats_i2c(STATS_I2C_DFROBOT, lgI2cReadI2CBlockData(dfr_gas_fd,0, (char *)recvbuf, 9));
   float Con=0.0;
-  float _temp = 0.0;
   if(FucCheckSum(recvbuf,8) == recvbuf[8])
   {
     Con=((recvbuf[2]<<8)+recvbuf[3])*1.0;
@@ -98,128 +145,21 @@ float readGasConcentrationPPM(void) {
       default:
         break;
     }
-    if (_tempswitch == ON)
-    {
-      switch (gastype)
-      {
-        case O2:
-          break;
-        case CO:
-          if (((_temp) > -20) && ((_temp) <= 20)){
-            Con = (Con / (0.005 * (_temp) + 0.9));
-          }else if (((_temp) > 20) && ((_temp) <= 40)){
-            Con = (Con / (0.005 * (_temp) + 0.9) - (0.3 * (_temp)-6));
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case H2S:
-          if (((_temp) > -20) && ((_temp) <= 20)){
-            Con = (Con / (0.005 * (_temp) + 0.92));
-          }else if (((_temp) > 20) && ((_temp) <= 60)){
-            Con = Con / (0.015*_temp - 0.3 );
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case NO2:
-          if (((_temp) > -20) && ((_temp) <= 0)){
-            Con = ((Con / (0.005 * (_temp) + 0.9) - (-0.0025 * (_temp) + 0.005)));
-          }else if (((_temp) > 0) && ((_temp) <= 20)){
-            Con = ((Con / (0.005 * (_temp) + 0.9) - (0.005 * (_temp) + 0.005)));
-          }else if (((_temp) > 20) && ((_temp) <= 40)){
-            Con = ((Con / (0.005 * (_temp) + 0.9) - (0.0025 * (_temp) + 0.1)));
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case O3:
-          if (((_temp) > -20) && ((_temp) <= 0)){
-            Con = ((Con / (0.015 * (_temp) + 1.1) - 0.05));
-          }else if (((_temp) > 0) && ((_temp) <= 20)){
-            Con = ((Con / 1.1 - (0.01 * (_temp))));
-          }else if (((_temp) > 20) && ((_temp) <= 40)){
-            Con = ((Con / 1.1 - (-0.005 * (_temp) + 0.3)));
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case CL2:
-          if (((_temp) > -20) && ((_temp) <= 0)){
-            Con = ((Con / (0.015 * (_temp) + 1.1) - (-0.0025 * (_temp))));
-          }else if (((_temp) > 0) && ((_temp) <= 20)){
-            Con = ((Con / 1.1 - 0.005 * (_temp)));
-          }else if (((_temp) > 20) && ((_temp) <= 40)){
-            Con = ((Con / 1.1 - (-0.005 * (_temp) +0.3)));
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case NH3:
-          if (((_temp) > -20) && ((_temp) <= 0)){
-            Con = (Con / (0.006 * (_temp) + 0.95) - (-0.006 * (_temp) + 0.25));
-          }else if (((_temp) > 0) && ((_temp) <= 20)){
-            Con = (Con / (0.006 * (_temp) + 0.95) - (-0.012 * (_temp) + 0.25));
-          }else if (((_temp) > 20) && ((_temp) <= 40)){
-            Con = (Con / (0.005 * (_temp) + 1.08) - (-0.1 * (_temp) + 2));
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case H2:
-          if (((_temp) > -20) && ((_temp) <= 20)){
-            Con = (Con / (0.74 * (_temp) + 0.007) - 5);
-          }else if (((_temp) > 20) && ((_temp) <= 40)){
-            Con = (Con / (0.025 * (_temp) + 0.3) - 5);
-          }else if (((_temp) > 40) && ((_temp) <= 60)){
-            Con = (Con / (0.001 * (_temp) + 0.9) - (0.75 * _temp -25));
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case HF:
-          if (((_temp) > -20) && ((_temp) <= 0)){
-            Con = (((Con / 1) - (-0.0025 * (_temp))));
-          }else if (((_temp) > 0) && ((_temp) <= 20)){
-            Con = ((Con / 1 + 0.1));
-          }else if (((_temp) > 20) && ((_temp) <= 40)){
-            Con = ((Con / 1 - (0.0375 * (_temp)-0.85)));
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case _PH3:
-          if (((_temp) > -20) && ((_temp) <= 40)){
-            Con = ((Con / (0.005 * (_temp) + 0.9)));
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case HCL:
-          if ((_temp > -20) && (_temp <= 0)){
-            Con = Con - (-0.0075 * _temp - 0.1);
-          }else if ((_temp > 0) && (_temp <= 20)){
-            Con = Con - (-0.1);
-          }else if ((_temp > 20) && (_temp < 50)){
-            Con = Con - (-0.01 * _temp + 0.1);
-          }else{
-            Con = 0.0;
-          }
-          break;
-        case SO2:
-          if ((_temp >- 40) && (_temp <= 40)){
-            Con = Con / (0.006 * _temp + 0.95);
-          }else if ((_temp > 40) && (_temp <= 60)){
-            Con = Con / (0.006 * _temp + 0.95) - (0.05 * _temp - 2);
-          }else{
-            Con = 0.0;
-          }
-          break;
-        default:
-          break;
+    /* Temperature compensation, if there are curves for this gas in the curves file */
+    if (gain_curve[gastype] == DFR_CURVE_UNRESOLVED)
+      dfr_resolve_curves(gastype);
+    int g = gain_curve[gastype];
+    int o = offset_curve[gastype];
+    if (g >= 0 || o >= 0) {
+      if ((g >= 0 && !cal_lut_in_range(g, temp)) || (o >= 0 && !cal_lut_in_range(o, temp))) {
+        Con = 0.0;
+      } else {
+        if (g >= 0) Con = Con / cal_lut_eval(g, temp);
+        if (o >= 0) Con = Con - cal_lut_eval(o, temp);
       }
     }
   }else{
+    stats_count(STATS_DFR_CHECKSUM_ERRORS, 1);
     Con = 0.0;
   }
   if(Con < 0.00001){
@@ -234,8 +174,8 @@ int dfr_gas_read(short *temp, short *conc) {
 	dfr_gas_fd = lgI2cOpen(1, DFR_GAS_I2C_ADDR, 0);
 	if (dfr_gas_fd < 0)
 		return EXIT_FAILURE;
-	float c = readGasConcentrationPPM();
 	float t = readTempC();
+	float c = readGasConcentrationPPM(t);
 	*temp = (short)(t*100);
 	*conc = (short)(c*100);
 	printf("Temperature = %6.2f°C , O2 Conc = %6.1f%% \n", t, c);
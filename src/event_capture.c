@@ -0,0 +1,413 @@
+/*
+ * event_capture.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The rings are filled by the pressure and IMU threads and by the main loop.  Adding a
+ * sample is a copy under the mutex of its ring, so the steady state cost is small and
+ * nothing is written to the SD card until a trigger fires.  The triggers are only checked
+ * from the main loop, so their state needs no lock.
+ *
+ * The rings are sized when the capture is started, from the pre and post seconds and the
+ * rate of each channel.  The pressure rate is the configured ODR.  The telemetry ring
+ * allows for a sample every second, which is the fastest the main loop samples.
+ *
+ * The main loop can be held up for many seconds by a slow sensor read, such as the O2, so
+ * the capture can not wait until the post trigger time to read the rings.  By then the
+ * oldest pre trigger samples would have been overwritten.  Instead the pre trigger samples
+ * are copied into the capture buffer as soon as the trigger fires, and each check after
+ * that copies the samples added since.  The copy goes by the place in the ring, not the
+ * time, so a sample from a late FIFO drain is still picked up.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common_config.h"
+#include "sensors_config.h"
+#include "iors_log.h"
+#include "telem_schema.h"
+#include "pressure_trend.h"
+#include "imu_bias.h"
+#include "event_capture.h"
+#include "trace.h"
+#include "time_service.h"
+#include "str_util.h"
+#include "debug.h"
+
+#define CAPTURE_RECORD_HEADER_LEN 6    /* channel, length and the ms offset */
+#define CAPTURE_RING_MARGIN_S 2        /* Extra seconds in each ring for the late FIFO drains */
+#define CAPTURE_RING_MIN_S 30          /* Each ring holds at least this long, more than the main loop can stall between copies */
+
+typedef struct capture_ring {
+	const char *name;
+	int payload_len;
+	int rate;                      /* Samples per second */
+	int capacity;
+	uint32_t count;                /* Samples added.  The newest is at (count - 1) % capacity */
+	uint8_t *samples;              /* Each is a uint64 ms time then the payload */
+	pthread_mutex_t mutex;
+} capture_ring_t;
+
+static capture_ring_t rings[CAPTURE_NUM_CHANNELS] = {
+	{ .name = "pressure", .payload_len = 6, .mutex = PTHREAD_MUTEX_INITIALIZER },
+	{ .name = "imu", .payload_len = 12, .mutex = PTHREAD_MUTEX_INITIALIZER },
+	{ .name = "telem", .payload_len = TELEM_RECORD_LEN, .mutex = PTHREAD_MUTEX_INITIALIZER }
+};
+
+/* The values a trigger can test.  Every scalar in the schema, then the pressure trend */
+typedef struct capture_value {
+	const char *name;
+	int bit;
+	int bits;
+	int is_signed;
+	int valid_bit;
+} capture_value_t;
+
+#define VALUE_NONE(name)
+#define VALUE_INT(name, bits, valid) { #name, TELEM_BIT_##name, bits, true, TELEM_BIT_##valid },
+#define VALUE_UINT(name, bits, valid) { #name, TELEM_BIT_##name, bits, false, TELEM_BIT_##valid },
+#define VALUE_ARRAY(name, n, bits, valid)
+static const capture_value_t values[] = {
+	TELEM_SCHEMA(VALUE_NONE, VALUE_NONE, VALUE_INT, VALUE_UINT, VALUE_ARRAY)
+};
+#define NUM_TELEM_VALUES ((int)(sizeof(values) / sizeof(capture_value_t)))
+#define VALUE_PRESSURE_TREND NUM_TELEM_VALUES
+
+enum {
+	OP_GT,
+	OP_LT,
+	OP_RISE,
+	OP_FALL
+};
+static const char *op_names[] = { ">", "<", "rise", "fall" };
+
+typedef struct capture_trigger {
+	char text[CAPTURE_TRIGGER_LEN];
+	int value;
+	int op;
+	double threshold;
+	int active;                    /* The predicate was true at the last check */
+	int have_last;
+	double last;
+} capture_trigger_t;
+
+static capture_trigger_t triggers[CAPTURE_MAX_TRIGGERS];
+static int num_triggers = 0;
+
+static int enabled = false;
+static char path[MAX_FILE_PATH_LEN];
+static int pre_seconds;
+static int post_seconds;
+static int capturing = false;
+static int trigger_num;
+static uint64_t trigger_ms;
+static uint8_t *buffer = NULL;         /* The capture is built here then written at once */
+static size_t buffer_len;
+static uint8_t *buffer_end;            /* Where the next record goes */
+static uint32_t buffer_count;          /* Records in the buffer */
+static uint32_t copied[CAPTURE_NUM_CHANNELS];  /* Ring samples looked at so far */
+
+uint64_t capture_now_ms() {
+	return time_utc_ms();
+}
+
+/**
+ * Parse a trigger from the config file, e.g. "CO2_conc > 2000".  Returns EXIT_FAILURE if
+ * it can not be parsed.
+ */
+static int capture_add_trigger(const char *text) {
+	char name[32], op[8];
+	double threshold;
+	if (sscanf(text, "%31s %7s %lf", name, op, &threshold) != 3) {
+		error_print("Capture trigger should be: value op threshold, not: %s\n", text);
+		return EXIT_FAILURE;
+	}
+	capture_trigger_t *t = &triggers[num_triggers];
+	memset(t, 0, sizeof(capture_trigger_t));
+	t->value = -1;
+	if (strcmp(name, "pressure_trend") == 0)
+		t->value = VALUE_PRESSURE_TREND;
+	for (int i=0; i < NUM_TELEM_VALUES; i++)
+		if (strcmp(name, values[i].name) == 0)
+			t->value = i;
+	t->op = -1;
+	for (int i=0; i < (int)(sizeof(op_names) / sizeof(op_names[0])); i++)
+		if (strcmp(op, op_names[i]) == 0)
+			t->op = i;
+	if (t->value < 0 || t->op < 0) {
+		error_print("Unknown value or op in capture trigger: %s\n", text);
+		return EXIT_FAILURE;
+	}
+	t->threshold = threshold;
+	strlcpy(t->text, text, sizeof(t->text));
+	num_triggers++;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Parse the triggers and allocate the rings and the capture buffer.  The capture is left
+ * off if there are no triggers or no seconds to capture.  The config is only read here, so
+ * a change needs a restart.
+ */
+int capture_init(char *capture_path) {
+	strlcpy(path, capture_path, sizeof(path));
+	num_triggers = 0;
+	for (int i=0; i < g_num_capture_triggers; i++)
+		capture_add_trigger(g_capture_triggers[i]);
+	pre_seconds = g_capture_pre_seconds;
+	post_seconds = g_capture_post_seconds;
+	if (num_triggers == 0 || pre_seconds < 0 || post_seconds < 0 || pre_seconds + post_seconds == 0) {
+		debug_print("Event capture is off\n");
+		return EXIT_SUCCESS;
+	}
+	rings[CAPTURE_PRESSURE].rate = g_pressure_odr;
+	rings[CAPTURE_IMU].rate = (int)lround(1.0 / IMU_BIAS_SAMPLE_PERIOD);
+	rings[CAPTURE_TELEM].rate = 1;
+
+	buffer_len = sizeof(capture_header_t);
+	for (int c=0; c < CAPTURE_NUM_CHANNELS; c++) {
+		capture_ring_t *ring = &rings[c];
+		int seconds = pre_seconds + post_seconds;
+		if (seconds < CAPTURE_RING_MIN_S)
+			seconds = CAPTURE_RING_MIN_S;
+		ring->capacity = (seconds + CAPTURE_RING_MARGIN_S) * ring->rate;
+		ring->count = 0;
+		ring->samples = malloc((size_t)ring->capacity * (sizeof(uint64_t) + ring->payload_len));
+		if (ring->samples == NULL) {
+			error_print("Could not allocate the %s capture ring\n", ring->name);
+			capture_close();
+			return EXIT_FAILURE;
+		}
+		buffer_len += (size_t)ring->capacity * (CAPTURE_RECORD_HEADER_LEN + ring->payload_len);
+	}
+	buffer = malloc(buffer_len);
+	if (buffer == NULL) {
+		error_print("Could not allocate %ld bytes for the capture\n", (long)buffer_len);
+		capture_close();
+		return EXIT_FAILURE;
+	}
+	debug_print("Event capture of %d s before and %d s after %d triggers, %ld bytes\n",
+			pre_seconds, post_seconds, num_triggers, (long)buffer_len);
+	__atomic_store_n(&enabled, true, __ATOMIC_RELEASE);
+	return EXIT_SUCCESS;
+}
+
+static void ring_add(capture_ring_t *ring, uint64_t ms, const void *payload) {
+	if (!__atomic_load_n(&enabled, __ATOMIC_ACQUIRE)) return;
+	pthread_mutex_lock(&ring->mutex);
+	if (ring->samples == NULL) {   /* Closed since we looked */
+		pthread_mutex_unlock(&ring->mutex);
+		return;
+	}
+	uint8_t *sample = ring->samples + (size_t)(ring->count % ring->capacity) * (sizeof(uint64_t) + ring->payload_len);
+	memcpy(sample, &ms, sizeof(uint64_t));
+	memcpy(sample + sizeof(uint64_t), payload, ring->payload_len);
+	ring->count++;
+	pthread_mutex_unlock(&ring->mutex);
+}
+
+/**
+ * Add a pressure sample.  The FIFO is drained in bursts, so the caller works out the time
+ * of each sample.
+ */
+void capture_add_pressure(int pressure, short temperature, uint64_t ms) {
+	uint8_t payload[6];
+	int32_t p = pressure;
+	int16_t t = temperature;
+	memcpy(payload, &p, 4);
+	memcpy(payload + 4, &t, 2);
+	ring_add(&rings[CAPTURE_PRESSURE], ms, payload);
+}
+
+void capture_add_imu(const short acc[3], const short gyro[3]) {
+	int16_t payload[6];
+	for (int i=0; i < 3; i++) {
+		payload[i] = acc[i];
+		payload[i+3] = gyro[i];
+	}
+	ring_add(&rings[CAPTURE_IMU], capture_now_ms(), payload);
+}
+
+static void capture_start(int t, uint64_t ms);
+
+/* Returns true if the predicate has just become true */
+static int trigger_eval(capture_trigger_t *t, int valid, double value) {
+	if (!valid) {
+		t->active = false;
+		t->have_last = false;
+		return false;
+	}
+	int p = false;
+	switch (t->op) {
+	case OP_GT: p = value > t->threshold; break;
+	case OP_LT: p = value < t->threshold; break;
+	case OP_RISE: p = t->have_last && value - t->last > t->threshold; break;
+	case OP_FALL: p = t->have_last && t->last - value > t->threshold; break;
+	}
+	t->last = value;
+	t->have_last = true;
+	int fired = p && !t->active;
+	t->active = p;
+	return fired;
+}
+
+/**
+ * Add a telemetry sample to its ring and check the triggers on its values.  Called from
+ * the main loop once the sample is complete.
+ */
+void capture_add_telemetry(const sensor_telemetry_t *telem) {
+	if (!enabled) return;
+	uint64_t ms = capture_now_ms();
+	uint8_t record[TELEM_RECORD_LEN];
+	telem_encode(telem, record);
+	ring_add(&rings[CAPTURE_TELEM], ms, record);
+
+	for (int i=0; i < num_triggers; i++) {
+		capture_trigger_t *t = &triggers[i];
+		if (t->value == VALUE_PRESSURE_TREND) continue;
+		const capture_value_t *v = &values[t->value];
+		int valid = telem_get_bits(record + 1, v->valid_bit, TELEM_FLAG_BITS) == SENSOR_ON;
+		uint64_t raw = telem_get_bits(record + 1, v->bit, v->bits);
+		double value = v->is_signed ? (double)telem_sign_extend(raw, v->bits) : (double)raw;
+		if (trigger_eval(t, valid, value) && !capturing)
+			capture_start(i, ms);
+	}
+}
+
+/* Append the samples of a ring that are in the capture window, and that were added since
+ * the last copy, to the buffer */
+static void ring_copy(int channel, uint64_t from, uint64_t to) {
+	capture_ring_t *ring = &rings[channel];
+	size_t record_len = CAPTURE_RECORD_HEADER_LEN + ring->payload_len;
+	pthread_mutex_lock(&ring->mutex);
+	uint32_t first = ring->count > (uint32_t)ring->capacity ? ring->count - ring->capacity : 0;
+	if (copied[channel] < first)
+		copied[channel] = first;
+	for (; copied[channel] < ring->count; copied[channel]++) {
+		uint8_t *sample = ring->samples + (size_t)(copied[channel] % ring->capacity) * (sizeof(uint64_t) + ring->payload_len);
+		uint64_t ms;
+		memcpy(&ms, sample, sizeof(uint64_t));
+		if (ms < from || ms > to) continue;
+		if (buffer_end + record_len > buffer + buffer_len) break;
+		int32_t offset = (int32_t)((int64_t)ms - (int64_t)trigger_ms);
+		buffer_end[0] = channel;
+		buffer_end[1] = ring->payload_len;
+		memcpy(buffer_end + 2, &offset, 4);
+		memcpy(buffer_end + CAPTURE_RECORD_HEADER_LEN, sample + sizeof(uint64_t), ring->payload_len);
+		buffer_end += record_len;
+		buffer_count++;
+	}
+	pthread_mutex_unlock(&ring->mutex);
+}
+
+/* Copy what is new in the rings into the capture */
+static void capture_collect() {
+	uint64_t from = trigger_ms > (uint64_t)pre_seconds * 1000 ? trigger_ms - (uint64_t)pre_seconds * 1000 : 0;
+	uint64_t to = trigger_ms + (uint64_t)post_seconds * 1000;
+	for (int c=0; c < CAPTURE_NUM_CHANNELS; c++)
+		ring_copy(c, from, to);
+}
+
+/* Start a capture and take the pre trigger samples out of the rings before they go */
+static void capture_start(int t, uint64_t ms) {
+	debug_print("Capture triggered by: %s\n", triggers[t].text);
+	capturing = true;
+	trigger_num = t;
+	trigger_ms = ms;
+	buffer_end = buffer + sizeof(capture_header_t);
+	buffer_count = 0;
+	memset(copied, 0, sizeof(copied));
+	capture_collect();
+}
+
+static int capture_write() {
+	trace_begin(TRACE_CAPTURE_WRITE);
+	capture_header_t *h = (capture_header_t *)buffer;
+	memset(h, 0, sizeof(capture_header_t));
+	memcpy(h->magic, CAPTURE_MAGIC, 4);
+	h->version = CAPTURE_VERSION;
+	h->trigger = trigger_num;
+	h->pre_seconds = pre_seconds;
+	h->post_seconds = post_seconds;
+	h->trigger_time = trigger_ms / 1000;
+	h->trigger_ms = trigger_ms % 1000;
+	strncpy(h->trigger_text, triggers[trigger_num].text, CAPTURE_TRIGGER_LEN);
+
+	capture_collect();
+	uint32_t count = buffer_count;
+	h->count = count;
+
+	int len = buffer_end - buffer;
+	int rc = EXIT_SUCCESS;
+	if (log_append(path, buffer, len) < len) {
+		error_print("Could not write the capture file: %s\n", path);
+		rc = EXIT_FAILURE;
+	} else {
+		log_add_to_directory(path);
+		debug_print("Captured %d samples, %d bytes\n", count, len);
+	}
+	capturing = false;
+	trace_end(TRACE_CAPTURE_WRITE);
+	return rc;
+}
+
+/**
+ * Check the triggers on the pressure trend and write the capture once its post trigger
+ * time has passed.  Called from the main loop about once a second.
+ */
+int capture_check() {
+	if (!enabled) return EXIT_SUCCESS;
+	uint64_t ms = capture_now_ms();
+	for (int i=0; i < num_triggers; i++) {
+		capture_trigger_t *t = &triggers[i];
+		if (t->value != VALUE_PRESSURE_TREND) continue;
+		double trend;
+		int valid = pressure_trend_get(&trend) == EXIT_SUCCESS;
+		if (trigger_eval(t, valid, trend) && !capturing)
+			capture_start(i, ms);
+	}
+	if (!capturing)
+		return EXIT_SUCCESS;
+	if (ms >= trigger_ms + (uint64_t)post_seconds * 1000)
+		return capture_write();
+	capture_collect();
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Write any capture in progress, with what we have after the trigger, then free the rings
+ */
+void capture_close() {
+	if (enabled && capturing)
+		capture_write();
+	__atomic_store_n(&enabled, false, __ATOMIC_RELEASE);
+	for (int c=0; c < CAPTURE_NUM_CHANNELS; c++) {
+		pthread_mutex_lock(&rings[c].mutex);
+		free(rings[c].samples);
+		rings[c].samples = NULL;
+		pthread_mutex_unlock(&rings[c].mutex);
+	}
+	free(buffer);
+	buffer = NULL;
+}
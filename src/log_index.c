@@ -0,0 +1,189 @@
+/*
+ * log_index.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The index is written to the tmp file for its path, like the log, so log_add_to_directory()
+ * rolls it in the same way.  The file is kept open between records.  The summary is kept at
+ * the front rather than in a footer so it can be written in place, and an index that is
+ * still being written can be read.  After a restart the summary is read back and the index
+ * carries on from it.
+ *
+ * The caller holds any lock that protects the log, so the index needs none of its own.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "common_config.h"
+#include "sensors_config.h"
+#include "iors_log.h"
+#include "log_index.h"
+#include "str_util.h"
+#include "debug.h"
+
+static int index_open(log_index_t *index, char *log_path) {
+	strlcpy(index->path, log_path, sizeof(index->path));
+	strlcat(index->path, LOG_INDEX_EXT, sizeof(index->path));
+	char tmp_filename[MAX_FILE_PATH_LEN];
+	log_make_tmp_filename(index->path, tmp_filename);
+	index->fd = open(tmp_filename, O_RDWR | O_CREAT, 0644);
+	if (index->fd < 0) {
+		error_print("Could not open the log index: %s\n", tmp_filename);
+		return EXIT_FAILURE;
+	}
+
+	log_index_header_t *h = &index->header;
+	log_index_entry_t entry;
+	if (pread(index->fd, h, sizeof(log_index_header_t), 0) == sizeof(log_index_header_t)
+			&& memcmp(h->magic, LOG_INDEX_MAGIC, 4) == 0 && h->version == LOG_INDEX_VERSION
+			&& h->entries > 0
+			&& pread(index->fd, &entry, sizeof(entry), sizeof(log_index_header_t)
+					+ (h->entries - 1) * sizeof(entry)) == sizeof(entry)) {
+		index->last_entry_time = entry.time;
+		h->interval = g_log_index_interval;
+		return EXIT_SUCCESS;
+	}
+	/* A new index, or one we can not use.  Start it again */
+	if (ftruncate(index->fd, 0) != 0) {
+		error_print("Could not truncate the log index: %s\n", tmp_filename);
+		close(index->fd);
+		index->fd = -1;
+		return EXIT_FAILURE;
+	}
+	memset(h, 0, sizeof(log_index_header_t));
+	memcpy(h->magic, LOG_INDEX_MAGIC, 4);
+	h->version = LOG_INDEX_VERSION;
+	h->interval = g_log_index_interval;
+	index->last_entry_time = 0;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Add a record at offset in the log at log_path, opening the index if this is the first.
+ * An entry is added to the table if it is the first record or interval seconds have passed
+ * since the last entry.
+ */
+int log_index_add(log_index_t *index, char *log_path, uint32_t time, long offset) {
+	if (g_log_index_interval <= 0) return EXIT_SUCCESS;
+	if (index->fd < 0 && index_open(index, log_path) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	log_index_header_t *h = &index->header;
+	/* The search needs times that never go backwards, but a CW event placed by the drift
+	 * fit can be a little before the one that came in before it */
+	if (h->count > 0 && time < h->last_time)
+		time = h->last_time;
+	if (h->count == 0)
+		h->first_time = time;
+	h->last_time = time;
+	h->count++;
+	if (h->entries == 0 || time >= index->last_entry_time + h->interval) {
+		log_index_entry_t entry = { .time = time, .offset = (uint32_t)offset };
+		if (pwrite(index->fd, &entry, sizeof(entry), sizeof(log_index_header_t)
+				+ h->entries * sizeof(entry)) != sizeof(entry)) {
+			error_print("Could not write the log index: %s\n", index->path);
+			return EXIT_FAILURE;
+		}
+		h->entries++;
+		index->last_entry_time = time;
+	}
+	if (pwrite(index->fd, h, sizeof(log_index_header_t), 0) != sizeof(log_index_header_t)) {
+		error_print("Could not write the log index: %s\n", index->path);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Add the index to the directory, with the log that it is for.  Call this after the log
+ * is rolled.  The next record starts a new index.
+ */
+void log_index_roll(log_index_t *index) {
+	if (index->fd < 0) return;
+	close(index->fd);
+	index->fd = -1;
+	log_add_to_directory(index->path);
+}
+
+/* Read entry i of the table.  Returns false if it can not be read */
+static int entry_read(int fd, uint32_t i, log_index_entry_t *entry) {
+	return pread(fd, entry, sizeof(log_index_entry_t), sizeof(log_index_header_t)
+			+ (off_t)i * sizeof(log_index_entry_t)) == sizeof(log_index_entry_t);
+}
+
+/**
+ * Find the bytes of a log that hold the records from time from to time to, with the index
+ * file of the log.  start is the offset of the first record and end is the offset after
+ * the last, or -1 for the end of the log.  The header is copied out if it is not NULL.
+ * Returns EXIT_FAILURE if the index can not be read or no records are in the range.
+ */
+int log_index_find(char *index_file, uint32_t from, uint32_t to, log_index_header_t *header, long *start, long *end) {
+	int fd = open(index_file, O_RDONLY);
+	if (fd < 0)
+		return EXIT_FAILURE;
+	log_index_header_t h;
+	if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || memcmp(h.magic, LOG_INDEX_MAGIC, 4) != 0
+			|| h.version != LOG_INDEX_VERSION || h.entries == 0) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	if (header != NULL)
+		*header = h;
+	if (to < h.first_time || from > h.last_time) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	/* Only the entries the searches land on are read, so a long log costs a few reads */
+	log_index_entry_t entry;
+	int ok = true;
+
+	/* The last entry at or before from, or the first entry */
+	int lo = 0, hi = h.entries - 1;
+	while (ok && lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		ok = entry_read(fd, mid, &entry);
+		if (entry.time <= from)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	if (ok && (ok = entry_read(fd, lo, &entry)))
+		*start = entry.offset;
+
+	/* The first entry after to, or the end of the log */
+	lo = 0;
+	hi = h.entries;
+	while (ok && lo < hi) {
+		int mid = (lo + hi) / 2;
+		ok = entry_read(fd, mid, &entry);
+		if (entry.time > to)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	*end = -1;
+	if (ok && lo < (int)h.entries && (ok = entry_read(fd, lo, &entry)))
+		*end = entry.offset;
+	close(fd);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,162 @@
+/*
+ * o2_cal.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * Calibration of the PS1 O2 sensor against the DFRobot reference sensor.
+ *
+ * The PS1 concentration is modeled as:
+ *
+ *   O2% = slope * mV + offset - tempco * (T - tref)
+ *
+ * The coefficients are read from the calibration file, so they can be changed without a
+ * recompile.  When the program is run with --test each PS1 reading is paired with the
+ * DFRobot reading and the board temperature.  The pairs are appended to a CSV file in the
+ * data folder and added to the least squares sums.  The sums are the normal equations,
+ * so each sample is O(1) and the fit is exact however many samples we have.
+ *
+ * The O2 level in the cabin hardly changes, so the slope can only be fitted if the
+ * PS1 voltage has moved enough, for example during a gas exposure test.  Likewise the
+ * temperature coefficient needs the temperature to move.  A coefficient that can not be
+ * seen is held at its current value and only the others are fitted.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "common_config.h"
+#include "o2_cal.h"
+#include "sensors_cal_file.h"
+#include "str_util.h"
+#include "debug.h"
+
+#define O2_CAL_PARAMS 3 /* slope, offset, -tempco */
+
+static double slope = O2_CAL_DEFAULT_SLOPE;
+static double offset = O2_CAL_DEFAULT_OFFSET;
+static double tempco = O2_CAL_DEFAULT_TEMPCO;
+static double tref = O2_CAL_DEFAULT_TREF;
+
+/* Normal equations A theta = b for phi = [mV, 1, T - tref] */
+static double A[O2_CAL_PARAMS][O2_CAL_PARAMS];
+static double b[O2_CAL_PARAMS];
+static int samples = 0;
+
+void o2_cal_init() {
+	slope = cal_file_get(O2_CAL_KEY_SLOPE, O2_CAL_DEFAULT_SLOPE);
+	offset = cal_file_get(O2_CAL_KEY_OFFSET, O2_CAL_DEFAULT_OFFSET);
+	tempco = cal_file_get(O2_CAL_KEY_TEMPCO, O2_CAL_DEFAULT_TEMPCO);
+	tref = cal_file_get(O2_CAL_KEY_TREF, O2_CAL_DEFAULT_TREF);
+	memset(A, 0, sizeof(A));
+	memset(b, 0, sizeof(b));
+	samples = 0;
+}
+
+/**
+ * Convert the PS1 voltage in mV to an O2 concentration in %, compensated for temperature.
+ */
+double o2_cal_conc(double mv, double temp_c) {
+	return slope * mv + offset - tempco * (temp_c - tref);
+}
+
+/* The temperature the calibration was made at, where there is no temperature correction */
+double o2_cal_tref() {
+	return tref;
+}
+
+/**
+ * Add a paired sample and append it to the CSV log in the data folder.
+ */
+int o2_cal_add(char *data_folder_path, double mv, double temp_c, double ref_pct) {
+	double phi[O2_CAL_PARAMS] = { mv, 1.0, temp_c - tref };
+	for (int i=0; i < O2_CAL_PARAMS; i++) {
+		for (int j=0; j < O2_CAL_PARAMS; j++)
+			A[i][j] += phi[i] * phi[j];
+		b[i] += phi[i] * ref_pct;
+	}
+	samples++;
+
+	char log_path[MAX_FILE_PATH_LEN];
+	strlcpy(log_path, data_folder_path, sizeof(log_path));
+	strlcat(log_path, "/", sizeof(log_path));
+	strlcat(log_path, O2_CAL_LOG_FILE, sizeof(log_path));
+	FILE *file = fopen(log_path, "a");
+	if (file == NULL) {
+		debug_print("ERROR: Could not open O2 calibration log: %s\n", log_path);
+		return EXIT_FAILURE;
+	}
+	fprintf(file, "%ld,%.2f,%.2f,%.2f\n", (long)time(0), mv, temp_c, ref_pct);
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Fit the coefficients we have enough spread to see and store them in the calibration
+ * table.  Returns EXIT_FAILURE if there are not enough samples yet.
+ */
+int o2_cal_fit() {
+	double theta[O2_CAL_PARAMS] = { slope, offset, -tempco };
+	int free_param[O2_CAL_PARAMS];
+	int idx[O2_CAL_PARAMS];
+	int n = 0;
+
+	if (samples < O2_CAL_MIN_SAMPLES) return EXIT_FAILURE;
+
+	/* Variance of mV and temperature from the sums */
+	double mean_mv = A[0][1] / samples;
+	double mean_t = A[2][1] / samples;
+	double var_mv = A[0][0] / samples - mean_mv * mean_mv;
+	double var_t = A[2][2] / samples - mean_t * mean_t;
+	free_param[0] = var_mv >= O2_CAL_MIN_MV_VAR;
+	free_param[1] = true;
+	free_param[2] = var_t >= O2_CAL_MIN_TEMP_VAR;
+	for (int i=0; i < O2_CAL_PARAMS; i++)
+		if (free_param[i]) idx[n++] = i;
+
+	/* Solve A_ff theta_f = b_f - A_fF theta_F by Gaussian elimination */
+	double M[O2_CAL_PARAMS][O2_CAL_PARAMS + 1];
+	for (int r=0; r < n; r++) {
+		for (int c=0; c < n; c++)
+			M[r][c] = A[idx[r]][idx[c]];
+		M[r][n] = b[idx[r]];
+		for (int j=0; j < O2_CAL_PARAMS; j++)
+			if (!free_param[j])
+				M[r][n] -= A[idx[r]][j] * theta[j];
+	}
+	for (int c=0; c < n; c++) {
+		int pivot = c;
+		for (int r=c+1; r < n; r++)
+			if (fabs(M[r][c]) > fabs(M[pivot][c])) pivot = r;
+		if (fabs(M[pivot][c]) < 1e-12) return EXIT_FAILURE;
+		for (int k=0; k <= n; k++) {
+			double tmp = M[c][k]; M[c][k] = M[pivot][k]; M[pivot][k] = tmp;
+		}
+		for (int r=c+1; r < n; r++) {
+			double f = M[r][c] / M[c][c];
+			for (int k=c; k <= n; k++)
+				M[r][k] -= f * M[c][k];
+		}
+	}
+	for (int r=n-1; r >= 0; r--) {
+		double v = M[r][n];
+		for (int k=r+1; k < n; k++)
+			v -= M[r][k] * theta[idx[k]];
+		theta[idx[r]] = v / M[r][r];
+	}
+
+	slope = theta[0];
+	offset = theta[1];
+	tempco = -theta[2];
+	cal_file_set(O2_CAL_KEY_SLOPE, slope);
+	cal_file_set(O2_CAL_KEY_OFFSET, offset);
+	cal_file_set(O2_CAL_KEY_TEMPCO, tempco);
+	cal_file_set(O2_CAL_KEY_TREF, tref);
+	debug_print("O2 cal from %d samples: slope %.6f%s offset %.4f tempco %.6f%s\n", samples,
+			slope, free_param[0] ? "" : " (held)", offset, tempco, free_param[2] ? "" : " (held)");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+/*
+ * pressure_trend.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * The LPS22HB runs continuously with its FIFO in stream mode.  A background thread
+ * drains the FIFO in one transaction and feeds every sample into a linear regression
+ * of pressure against time over a sliding window.  The slope is the pressure trend in
+ * hPa/min.  If the pressure falls faster than PRESSURE_LEAK_RATE for more than
+ * PRESSURE_LEAK_PERSIST_S then we flag a leak.  This is seen within seconds rather than
+ * at the next telemetry period.
+ *
+ * The samples are equally spaced, so x is just the sample number in the window.  The
+ * sums of x and x^2 then only depend on the number of samples, and the sums of p and
+ * x.p can be slid along the window in O(1) per sample.  The raw pressure counts are
+ * integers, so the sums are kept in 64 bit integers and do not drift.
+ *
+ * The main loop reads the latest sample with pressure_trend_read() and no longer
+ * waits for a conversion.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <lgpio.h>
+
+#include "LPS22HB.h"
+#include "pressure_trend.h"
+#include "event_capture.h"
+#include "device_supervisor.h"
+#include "debug.h"
+
+static pthread_mutex_t pressure_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int pressure_thread_called = false;
+static unsigned char odr_code = LPS_ODR_10HZ;
+static int odr = 10;
+
+/* Latest sample */
+static int last_pressure;
+static short last_temperature;
+static time_t last_sample_time = 0;
+
+/* Sliding window regression */
+static int window[PRESSURE_TREND_WINDOW_S * PRESSURE_TREND_MAX_ODR];
+static int window_len = PRESSURE_TREND_WINDOW_S * 10;
+static int head = 0;   /* Oldest sample */
+static int n = 0;      /* Samples in the window */
+static int64_t s_p = 0;
+static int64_t s_xp = 0;
+static double trend = 0;
+static int trend_valid = false;
+static int leak_count = 0;
+static int leak = false;
+
+/* Must be called with the mutex held */
+static void pressure_trend_reset() {
+	head = 0;
+	n = 0;
+	s_p = s_xp = 0;
+	trend = 0;
+	trend_valid = false;
+	leak_count = 0;
+}
+
+/**
+ * Start the sensor in continuous mode at odr_hz, which must be 1, 10, 25, 50 or 75.
+ */
+int pressure_trend_init(int odr_hz) {
+	pthread_mutex_lock(&pressure_mutex);
+	switch (odr_hz) {
+	case 1: odr_code = LPS_ODR_1HZ; break;
+	case 10: odr_code = LPS_ODR_10HZ; break;
+	case 25: odr_code = LPS_ODR_25HZ; break;
+	case 50: odr_code = LPS_ODR_50HZ; break;
+	case 75: odr_code = LPS_ODR_75HZ; break;
+	default:
+		error_print("Pressure ODR must be 1, 10, 25, 50 or 75 Hz, not %d.  Using 10Hz\n", odr_hz);
+		odr_hz = 10;
+		odr_code = LPS_ODR_10HZ;
+	}
+	odr = odr_hz;
+	window_len = PRESSURE_TREND_WINDOW_S * odr;
+	pressure_trend_reset();
+	int rc = LPS22HB_INIT(odr_code);
+	pthread_mutex_unlock(&pressure_mutex);
+	return rc;
+}
+
+/**
+ * Add a raw pressure sample to the window and update the trend.  Must be called with
+ * the mutex held.
+ */
+static void pressure_trend_add_locked(int p) {
+	if (n < window_len) {
+		window[(head + n) % window_len] = p;
+		s_p += p;
+		s_xp += (int64_t)n * p;
+		n++;
+	} else {
+		/* Every sample moves down one place in x as the oldest drops out */
+		int p0 = window[head];
+		s_xp = s_xp - (s_p - p0) + (int64_t)(n - 1) * p;
+		s_p = s_p - p0 + p;
+		window[head] = p;
+		head = (head + 1) % window_len;
+	}
+
+	if (n < PRESSURE_TREND_MIN_SAMPLES_S * odr) return;
+	double sx = (double)n * (n - 1) / 2;
+	double sxx = (double)(n - 1) * n * (2 * n - 1) / 6;
+	double slope = ((double)n * s_xp - sx * s_p) / (n * sxx - sx * sx); // counts per sample
+	trend = slope / LPS_LSB_PER_HPA * odr * 60;
+	trend_valid = true;
+
+	if (trend < PRESSURE_LEAK_RATE) {
+		if (leak_count < PRESSURE_LEAK_PERSIST_S * odr) leak_count++;
+	} else {
+		leak_count = 0;
+	}
+	int was_leak = leak;
+	leak = (leak_count >= PRESSURE_LEAK_PERSIST_S * odr);
+	if (leak && !was_leak)
+		error_print("Pressure falling at %.2f hPa/min\n", trend);
+}
+
+void pressure_trend_add(int pressure) {
+	pthread_mutex_lock(&pressure_mutex);
+	pressure_trend_add_locked(pressure);
+	pthread_mutex_unlock(&pressure_mutex);
+}
+
+/**
+ * Return the latest pressure and temperature in sensor counts.  This does not talk to the
+ * sensor.  Returns EXIT_FAILURE if there is no recent sample.
+ */
+int pressure_trend_read(int *pressure, short *temperature) {
+	int rc = EXIT_FAILURE;
+	pthread_mutex_lock(&pressure_mutex);
+	if (last_sample_time != 0 && time(0) - last_sample_time <= PRESSURE_STALE_S) {
+		*pressure = last_pressure;
+		*temperature = last_temperature;
+		rc = EXIT_SUCCESS;
+	}
+	pthread_mutex_unlock(&pressure_mutex);
+	return rc;
+}
+
+/**
+ * Get the pressure trend in hPa/min.  Returns EXIT_FAILURE until the window has enough
+ * samples.
+ */
+int pressure_trend_get(double *hpa_per_min) {
+	pthread_mutex_lock(&pressure_mutex);
+	int valid = trend_valid;
+	*hpa_per_min = trend;
+	pthread_mutex_unlock(&pressure_mutex);
+	return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int pressure_leak_detected() {
+	pthread_mutex_lock(&pressure_mutex);
+	int l = leak;
+	pthread_mutex_unlock(&pressure_mutex);
+	return l;
+}
+
+/**
+ * Background thread that drains the FIFO.  If the FIFO overflowed then the samples are no
+ * longer equally spaced, so the window is restarted.  If the sensor stops responding we
+ * try to initialize it again, once its backoff from the device supervisor is over.
+ */
+void *pressure_trend_process(void * arg) {
+	int pressure[LPS_FIFO_SIZE];
+	short temperature[LPS_FIFO_SIZE];
+	int overflow = false;
+
+	if (pressure_thread_called) {
+		printf("ERROR: Pressure thread already started\n");
+		return NULL;
+	}
+	pressure_thread_called = true;
+	int device = supervisor_add("lps22"); /* The same device as the lps22 driver */
+	while (pressure_thread_called) {
+		pthread_mutex_lock(&pressure_mutex);
+		int num = LPS22HB_read_fifo(pressure, temperature, LPS_FIFO_SIZE, &overflow);
+		if (num < 0) {
+			debug_print("Pressure sensor FIFO read failed\n");
+			pressure_trend_reset();
+			pthread_mutex_unlock(&pressure_mutex);
+			supervisor_failed(device, time(0));
+			if (!supervisor_wait(device, &pressure_thread_called))
+				break;
+			pthread_mutex_lock(&pressure_mutex);
+			LPS22HB_INIT(odr_code);
+		} else {
+			supervisor_ok(device);
+			if (overflow) {
+				debug_print("Pressure sensor FIFO overflow\n");
+				pressure_trend_reset();
+			}
+			/* The last sample in the FIFO is the newest, the others are one ODR period apart */
+			uint64_t ms = capture_now_ms();
+			for (int i=0; i < num; i++) {
+				pressure_trend_add_locked(pressure[i]);
+				capture_add_pressure(pressure[i], temperature[i], ms - (uint64_t)(num - 1 - i) * 1000 / odr);
+			}
+			if (num > 0) {
+				last_pressure = pressure[num-1];
+				last_temperature = temperature[num-1];
+				last_sample_time = time(0);
+			}
+		}
+		/* Drain at least twice per FIFO fill */
+		double period = LPS_FIFO_SIZE / 2.0 / odr;
+		pthread_mutex_unlock(&pressure_mutex);
+		lguSleep(period < PRESSURE_DRAIN_PERIOD ? period : PRESSURE_DRAIN_PERIOD);
+	}
+	return NULL;
+}
+
+void pressure_trend_exit_process() {
+	pressure_thread_called = false;
+}
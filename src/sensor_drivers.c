@@ -0,0 +1,504 @@
+/*
+ * sensor_drivers.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The sensor drivers.  Each one connects a device driver to its fields in the telemetry.
+ * They are registered in the order they are read.  The temperature and pressure are read
+ * before the CO2 and O2 sensors that are compensated with them.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sensor_driver.h"
+#include "sensors_state_file.h"
+#include "sensors_gpio.h"
+#include "AD.h"
+#include "LPS22HB.h"
+#include "pressure_trend.h"
+#include "SHTC3.h"
+#include "xensiv_pasco2.h"
+#include "IMU.h"
+#include "imu_bias.h"
+#include "TCS34087.h"
+#include "flicker.h"
+#include "dfrobot_gas.h"
+#include "o2_cal.h"
+#include "cal_lut.h"
+#include "sensor_stats.h"
+#include "debug.h"
+
+#define ADC_O2_CHAN 2
+#define ADC_METHANE_CHAN 0
+#define ADC_AIR_QUALITY_CHAN 1
+#define ADC_BUS_V_CHAN 3
+
+/* Defined in sensors.c */
+extern int calibrate_with_dfrobot_sensor;
+extern char data_folder_path[MAX_FILE_PATH_LEN];
+extern int g_num_of_file_io_errors;
+
+static float board_temperature = 0.0;
+static float o2_volts = -1; // PS1 mV this cycle, paired with the DFRobot reading when calibrating
+
+/* Calibration curves used by the drivers */
+static int lut_o2_temp_offset = -1;
+static int lut_ps1_mv = -1;
+static int lut_shtc3_temp_c = -1;
+static int lut_shtc3_rh_pct = -1;
+static int lut_lps22_pressure_hpa = -1;
+static int lut_lps22_temp_c = -1;
+
+/**
+ * Define the default calibration curves, then load the curves file which can replace
+ * them, then look up the curves we use.
+ */
+static void define_cal_curves(char *curves_file_name) {
+	/* Temperature correction for the O2 sensor */
+	double o2_temp[] = { 0.0, 10.0, 20.0, 30.0, 40.0, 50.0 };
+	double o2_offset[] = { 3.0, 1.0, 0.0, -1.0, -2.0, -3.0 };
+	cal_lut_define_pwl("o2_temp_offset", o2_temp, o2_offset, sizeof(o2_temp)/sizeof(double));
+
+	/* ADC counts to mV for the PS1 O2 sensor */
+	double ps1_mv[] = { 0, 0.125 };
+	cal_lut_define_poly("ps1_mv", 0, 32767, ps1_mv, 2);
+
+	/* SHTC3 raw to C and %RH */
+	double shtc3_temp[] = { -45.0, 175.0 / 65536.0 };
+	cal_lut_define_poly("shtc3_temp_c", 0, 65535, shtc3_temp, 2);
+	double shtc3_rh[] = { 0, 100.0 / 65536.0 };
+	cal_lut_define_poly("shtc3_rh_pct", 0, 65535, shtc3_rh, 2);
+
+	/* LPS22 raw to hPa and C */
+	double lps22_press[] = { 0, 1.0 / LPS_LSB_PER_HPA };
+	cal_lut_define_poly("lps22_pressure_hpa", 0, 1260 * LPS_LSB_PER_HPA, lps22_press, 2);
+	double lps22_temp[] = { 0, 1.0 / LPS_LSB_PER_DEGC };
+	cal_lut_define_poly("lps22_temp_c", -32768, 32767, lps22_temp, 2);
+
+	dfr_gas_define_curves();
+
+	cal_lut_load(curves_file_name);
+
+	lut_o2_temp_offset = cal_lut_find("o2_temp_offset");
+	lut_ps1_mv = cal_lut_find("ps1_mv");
+	lut_shtc3_temp_c = cal_lut_find("shtc3_temp_c");
+	lut_shtc3_rh_pct = cal_lut_find("shtc3_rh_pct");
+	lut_lps22_pressure_hpa = cal_lut_find("lps22_pressure_hpa");
+	lut_lps22_temp_c = cal_lut_find("lps22_temp_c");
+}
+
+/* MQ-6 methane sensor on the ADC */
+static int methane_read(uint32_t now) {
+	short val;
+	if (adc_read(ADC_METHANE_CHAN, &val) != EXIT_SUCCESS) {
+		if (g_verbose)
+			printf("Could not open MQ-6 Methane sensor ADC channel %d\n",ADC_METHANE_CHAN);
+		return SENSOR_READ_ERR;
+	}
+	g_sensor_telemetry.methane_conc = val;
+	g_sensor_telemetry.methane_sensor_valid = SENSOR_ON;
+	if (g_verbose)
+		printf("MQ-6 Methane: %d,",val);
+	return SENSOR_READ_OK;
+}
+
+static void methane_clear(int valid) {
+	g_sensor_telemetry.methane_conc = 0;
+	g_sensor_telemetry.methane_sensor_valid = valid;
+}
+
+/* MQ-135 air quality sensor on the ADC */
+static int air_q_read(uint32_t now) {
+	short val;
+	if (adc_read(ADC_AIR_QUALITY_CHAN, &val) != EXIT_SUCCESS) {
+		if (g_verbose)
+			printf("Could not open MQ-135 Air Quality ADC channel %d\n",ADC_AIR_QUALITY_CHAN);
+		return SENSOR_READ_ERR;
+	}
+	if (g_verbose)
+		printf("MQ-135 Air Q: %d\n",val);
+	g_sensor_telemetry.air_quality = val;
+	g_sensor_telemetry.air_q_sensor_valid = SENSOR_ON;
+	return SENSOR_READ_OK;
+}
+
+static void air_q_clear(int valid) {
+	g_sensor_telemetry.air_quality = 0;
+	g_sensor_telemetry.air_q_sensor_valid = valid;
+}
+
+/* SHTC3 temperature and humidity.  The temperature compensates the O2 sensor */
+static int shtc3_read(uint32_t now) {
+	short temperature, humidity;
+	int shtc3_rc = SHTC3_read(&temperature, &humidity);
+	if (shtc3_rc != EXIT_SUCCESS) {
+		if (g_verbose)
+			printf("Could not read SHTC3 Temperature sensor: %d\n", shtc3_rc);
+		return SENSOR_READ_ERR;
+	}
+	g_sensor_telemetry.SHTC3_temp = temperature;
+	g_sensor_telemetry.SHTC3_humidity = humidity;
+	g_sensor_telemetry.TempHumidityValid = SENSOR_ON;
+
+	board_temperature = cal_lut_eval(lut_shtc3_temp_c, (unsigned short)temperature); // Calculate temperature value, which we use to compensate O2
+	if (g_verbose) {
+		float RH_Value;
+		RH_Value = cal_lut_eval(lut_shtc3_rh_pct, (unsigned short)humidity);         // Calculate humidity value
+		printf("Temperature = %6.2f°C , Humidity = %6.2f%% \n", board_temperature, RH_Value);
+	}
+	return SENSOR_READ_OK;
+}
+
+static void shtc3_clear(int valid) {
+	g_sensor_telemetry.SHTC3_temp = 0;
+	g_sensor_telemetry.SHTC3_humidity = 0;
+	g_sensor_telemetry.TempHumidityValid = valid;
+}
+
+/* LPS22 pressure and its temperature.  The FIFO is drained in the background and the
+ * pressure trend is checked for leaks on every sample */
+static int lps22_init() {
+	return pressure_trend_init(g_pressure_odr);
+}
+
+static int pressure_leak_logged = false;
+
+static int lps22_read(uint32_t now) {
+	short lps22_temperature;
+	int pressure;
+	if (pressure_trend_read(&pressure, &lps22_temperature) != EXIT_SUCCESS) {
+		if (g_verbose)
+			printf("Could not open LPS22 Pressure sensor\n");
+		return SENSOR_READ_ERR;
+	}
+	g_sensor_telemetry.LPS22_pressure = pressure;
+	g_sensor_telemetry.LPS22_temp = lps22_temperature;
+	g_sensor_telemetry.PressureValid = SENSOR_ON;
+
+	double trend = 0;
+	int trend_valid = pressure_trend_get(&trend) == EXIT_SUCCESS;
+	int leak = pressure_leak_detected();
+	stats_pressure(trend_valid ? trend : 0, leak);
+	/* Report a leak once when it starts, not on every read while it lasts.  The iors log
+	 * has no error code for it, so it is counted in the stats and reported here */
+	if (leak && !pressure_leak_logged)
+		error_print("Pressure leak, the pressure is falling at %.3f hPa/min\n", trend);
+	pressure_leak_logged = leak;
+	if (g_verbose) {
+		printf("Pressure = %6.3f hPa, Temperature = %6.2f °C, Trend = %6.3f hPa/min%s\n",
+				cal_lut_eval(lut_lps22_pressure_hpa, pressure), cal_lut_eval(lut_lps22_temp_c, lps22_temperature), trend, leak ? " LEAK" : "");
+	}
+	return SENSOR_READ_OK;
+}
+
+static void lps22_clear(int valid) {
+	g_sensor_telemetry.LPS22_pressure = 0;
+	g_sensor_telemetry.LPS22_temp = 0;
+	g_sensor_telemetry.PressureValid = valid;
+}
+
+/* Setup the IMU.  Defaults are:
+ * 2g Accelerometer
+ * Gyro 32dps
+ * Mag is -4912 to 4912uT, for 2s complement 16 bit result
+ * It is sampled in the background so the gyro and accelerometer biases are learned whenever we are still */
+static int imu_init() {
+	if (imuInit() == false) {
+		if (g_verbose)
+			printf("QMI8658_init fail\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int imu_read(uint32_t now) {
+	IMU_ST_SENSOR_DATA stGyroRawData;
+	IMU_ST_SENSOR_DATA stAccelRawData;
+	IMU_ST_SENSOR_DATA stMagnRawData;
+
+	imuDataGetRaw(&stGyroRawData, &stAccelRawData, &stMagnRawData);
+	if (g_verbose) {
+		printf("Acceleration: X: %d     Y: %d     Z: %d \n",stAccelRawData.s16X, stAccelRawData.s16Y, stAccelRawData.s16Z);
+		printf("Gyroscope: X: %d     Y: %d     Z: %d \n",stGyroRawData.s16X, stGyroRawData.s16Y, stGyroRawData.s16Z);
+		printf("Magnetic: X: %d     Y: %d     Z: %d \n",stMagnRawData.s16X, stMagnRawData.s16Y, stMagnRawData.s16Z);
+	}
+	g_sensor_telemetry.AccelerationX = stAccelRawData.s16X;
+	g_sensor_telemetry.AccelerationY = stAccelRawData.s16Y;
+	g_sensor_telemetry.AccelerationZ = stAccelRawData.s16Z;
+	g_sensor_telemetry.GyroX = stGyroRawData.s16X;
+	g_sensor_telemetry.GyroY = stGyroRawData.s16Y;
+	g_sensor_telemetry.GyroZ = stGyroRawData.s16Z;
+	g_sensor_telemetry.MagX = stMagnRawData.s16X;
+	g_sensor_telemetry.MagY = stMagnRawData.s16Y;
+	g_sensor_telemetry.MagZ = stMagnRawData.s16Z;
+	g_sensor_telemetry.IMUTemp = QMI8658_readTemp();
+	g_sensor_telemetry.ImuValid = SENSOR_ON;
+	return SENSOR_READ_OK;
+}
+
+static void imu_clear(int valid) {
+	g_sensor_telemetry.AccelerationX = 0;
+	g_sensor_telemetry.AccelerationY = 0;
+	g_sensor_telemetry.AccelerationZ = 0;
+	g_sensor_telemetry.GyroX = 0;
+	g_sensor_telemetry.GyroY = 0;
+	g_sensor_telemetry.GyroZ = 0;
+	g_sensor_telemetry.MagX = 0;
+	g_sensor_telemetry.MagY = 0;
+	g_sensor_telemetry.MagZ = 0;
+	g_sensor_telemetry.IMUTemp = 0;
+	g_sensor_telemetry.ImuValid = valid;
+}
+
+/* Xensiv CO2 sensor in continuous mode.  It is compensated with the pressure */
+static int co2_init() {
+	int res = xensiv_pasco2_init(g_co2_measurement_rate);
+	if (res != EXIT_SUCCESS) {
+		if (g_verbose)
+			printf("Could not open CO2 gas sensor: %d\n",res);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int co2_read(uint32_t now) {
+	uint16_t co2_ppm_val;
+	uint16_t pressure_ref = (uint16_t)cal_lut_eval(lut_lps22_pressure_hpa, g_sensor_telemetry.LPS22_pressure);
+	int co2_rc = xensiv_pasco2_read(pressure_ref, &co2_ppm_val);
+	if (co2_rc != XENSIV_PASCO2_OK) {
+		if (g_verbose)
+			printf("CO2 Sensor not ready: %d\n", co2_rc);
+		if (co2_rc != XENSIV_PASCO2_READ_NRDY)
+			return SENSOR_READ_FAILED; // Try to initialize again next time
+		return SENSOR_READ_ERR;
+	}
+	if (g_verbose)
+		printf("CO2: %d ppm at %d hPa\n",co2_ppm_val, pressure_ref);
+	g_sensor_telemetry.CO2_conc = co2_ppm_val;
+	g_sensor_telemetry.co2_sensor_valid = SENSOR_ON;
+	return SENSOR_READ_OK;
+}
+
+static void co2_clear(int valid) {
+	g_sensor_telemetry.CO2_conc = 0;
+	g_sensor_telemetry.co2_sensor_valid = valid;
+}
+
+/* PS1 solid state O2 sensor.  Average 10 readings over 10 seconds.  It is compensated
+ * with the SHTC3 temperature */
+static int o2_read(uint32_t now) {
+	short val;
+	int rc;
+	int c=0;
+	float avg=0.0, max=0.0,min=65555;
+	o2_volts = -1;
+	// Dummy read which will be low
+	rc = adc_read(ADC_O2_CHAN, &val);
+	sleep(1);
+	while (c < 10) {
+		rc = adc_read(ADC_O2_CHAN, &val);
+		if (rc != EXIT_SUCCESS) {
+			if (g_verbose)
+				printf("Could not open O2 Sensor ADC channel %d\n",ADC_O2_CHAN);
+			return SENSOR_READ_ERR;
+		}
+		if (val > max) max = val;
+		if (val < min) min = val;
+		avg+= val;
+		sleep(1);
+		c++;
+	}
+	avg = avg / c;
+	float volts = cal_lut_eval(lut_ps1_mv, avg);
+	float o2_conc = o2_cal_conc(volts, o2_cal_tref()); // Not temperature compensated
+	// VE2TCP prototype - float o2_conc = -0.01805 * volts + 44.5835;
+
+	g_sensor_telemetry.O2_raw = volts;
+	/* Temperature correction from the o2_temp_offset curve.  This is only printed, the
+	 * telemetry is compensated with the calibrated temperature coefficient */
+	double offset = 0.0;
+	if (cal_lut_in_range(lut_o2_temp_offset, board_temperature)) {
+		offset = cal_lut_eval(lut_o2_temp_offset, board_temperature);
+		if (g_verbose)
+			printf("Lookup: %2.1f compensate by: %2.3f\n", board_temperature, offset);
+	}
+
+	if (g_verbose)
+		printf("PS1 O2 Conc: %.2f (%.2f) %d(%0.2fmv) max:%0.2f min:%0.2f\n",o2_conc + offset, o2_conc, val,(float)volts,
+				cal_lut_eval(lut_ps1_mv, max), cal_lut_eval(lut_ps1_mv, min));
+	/* Out of range means the sensor or its ADC has failed, so the read is an error */
+	if (o2_conc > 25 || o2_conc < 0)
+		return SENSOR_READ_ERR;
+	g_sensor_telemetry.o2_sensor_valid = SENSOR_ON;
+	g_sensor_telemetry.O2_conc = (short)(o2_cal_conc(volts, board_temperature)*100);
+	o2_volts = volts;
+	return SENSOR_READ_OK;
+}
+
+static void o2_clear(int valid) {
+	o2_volts = -1;
+	g_sensor_telemetry.o2_sensor_valid = valid;
+	g_sensor_telemetry.O2_conc = 0;
+	g_sensor_telemetry.O2_raw = 0;
+}
+
+/* DFRobot O2 sensor, only connected when we are calibrating the PS1.  It replaces the O2
+ * concentration in the telemetry */
+static int dfr_read(uint32_t now) {
+	short gas_temp;
+	short gas_conc;
+	if (dfr_gas_read(&gas_temp, &gas_conc) != EXIT_SUCCESS) {
+		if (g_verbose)
+			printf("Could not open DF Robot O2 Sensor\n");
+		return SENSOR_READ_ERR;
+	}
+	printf("O2 Cal = %6.1f%%, Temperature = %6.2f°C\n", gas_conc/100.0, gas_temp/100.0);
+	g_sensor_telemetry.O2_conc = gas_conc;
+	/* Pair the reference with the PS1 reading and refit the PS1 coefficients */
+	if (o2_volts >= 0) {
+		if (o2_cal_add(data_folder_path, o2_volts, board_temperature, gas_conc/100.0) != EXIT_SUCCESS)
+			g_num_of_file_io_errors++;
+		o2_cal_fit();
+	}
+	return SENSOR_READ_OK;
+}
+
+static void dfr_clear(int valid) {
+	/* The PS1 values stay in the telemetry */
+}
+
+/* TCS34087 color sensor.  The flicker FIFO is drained in the background */
+static int color_init() {
+	/* We may need to pass the gain through from config.  We would add to the command line so iors_control
+	 * can set it */
+	if (TCS34087_Init(TCS34087_GAIN_16X) != 0)
+		return EXIT_FAILURE;
+	if (g_verbose)
+		printf("TCS34087 init\n");
+	return EXIT_SUCCESS;
+}
+
+static void color_close() {
+	TCS34087_Close();
+}
+
+static int color_read(uint32_t now) {
+	RGB rgb;
+	uint8_t rc = TCS34087_Read(&rgb);
+	if (rc == TCS34087_READ_TIMEOUT)
+		return SENSOR_READ_ERR;
+	/* Saturated at the lowest exposure is still a valid, if clipped, reading.  Saturated at
+	 * any other settings means the AGC ran out of tries, so the reading is not valid */
+	if (rc == TCS34087_READ_SATURATED && !TCS34087_At_Min_Exposure())
+		return SENSOR_READ_ERR;
+	/* Lux uses the gain and integration time the AGC chose.  RGB888 is scaled to fixed settings */
+	uint32_t RGB888=TCS34087_GetRGB888(TCS34087_Normalize(rgb));
+	uint16_t level = TCS34087_Get_Lux(rgb);
+
+	if (g_verbose)
+		printf("RGB888 :R=%d   G=%d  B=%d   RGB888=0X%X  C=%d LUX=%d Gain=%.1f Tint=%.1fms%s\n", (RGB888>>16), \
+				(RGB888>>8) & 0xff, (RGB888) & 0xff, RGB888, rgb.C,level,
+				TCS34087_Get_Gain_Value(TCS34087_Get_Gain()), TCS34087_Get_Integration_Time_ms(),
+				rc == TCS34087_READ_SATURATED ? " SATURATED" : "");
+
+	flicker_result_t flicker;
+	flicker_get(&flicker);
+	if (flicker.frames > 0)
+		stats_flicker(flicker.frequency, flicker.depth);
+	else
+		stats_flicker(0, 0);
+	if (g_verbose && flicker.frames > 0)
+		printf("Flicker: %.1fHz amplitude %.1f%% depth %.1f%% mean %.0f%s\n", flicker.frequency,
+				flicker.amplitude * 100, flicker.depth * 100, flicker.mean, flicker.saturated ? " SATURATED" : "");
+
+	g_sensor_telemetry.light_level = level;
+	g_sensor_telemetry.light_RGB = RGB888;
+	g_sensor_telemetry.ColorValid = SENSOR_ON;
+	return SENSOR_READ_OK;
+}
+
+static void color_clear(int valid) {
+	g_sensor_telemetry.ColorValid = valid;
+	g_sensor_telemetry.light_level = 0;
+	g_sensor_telemetry.light_RGB = 0;
+}
+
+static sensor_driver_t methane_driver = {
+	.name = "methane", .enabled = &g_state_sensors_methane_enabled, .gpio_en = SENSORS_GPIO_MQ6_EN,
+	.warm_up = &g_mq6_warm_up,
+	.read = methane_read, .clear = methane_clear
+};
+static sensor_driver_t air_q_driver = {
+	.name = "air_q", .enabled = &g_state_sensors_air_q_enabled, .gpio_en = SENSORS_GPIO_MQ135_EN,
+	.warm_up = &g_mq135_warm_up,
+	.read = air_q_read, .clear = air_q_clear
+};
+static sensor_driver_t shtc3_driver = {
+	.name = "shtc3", .enabled = &g_state_sensors_temp_humidity_enabled, .gpio_en = -1,
+	.caps = SENSOR_CAP_PROVIDES_TEMP,
+	.read = shtc3_read, .clear = shtc3_clear, .close = SHTC3_close
+};
+static sensor_driver_t lps22_driver = {
+	.name = "lps22", .enabled = &g_state_sensors_pressure_enabled, .gpio_en = -1,
+	.caps = SENSOR_CAP_PROVIDES_PRESSURE,
+	.init = lps22_init, .process = pressure_trend_process, .exit_process = pressure_trend_exit_process,
+	.read = lps22_read, .clear = lps22_clear, .close = LPS22HB_close
+};
+static sensor_driver_t imu_driver = {
+	.name = "imu", .enabled = &g_state_sensors_imu_enabled, .gpio_en = -1,
+	.init = imu_init, .process = imu_bias_process, .exit_process = imu_bias_exit_process,
+	.read = imu_read, .clear = imu_clear, .close = imuClose
+};
+static sensor_driver_t co2_driver = {
+	.name = "co2", .enabled = &g_state_sensors_co2_enabled, .gpio_en = SENSORS_GPIO_CO2_EN,
+	.caps = SENSOR_CAP_NEEDS_PRESSURE, .warm_up = &g_co2_warm_up,
+	.init = co2_init, .read = co2_read, .clear = co2_clear, .close = xensiv_pasco2_close
+};
+static sensor_driver_t o2_driver = {
+	.name = "o2", .enabled = &g_state_sensors_o2_enabled, .gpio_en = -1,
+	.caps = SENSOR_CAP_NEEDS_TEMP,
+	.read = o2_read, .clear = o2_clear
+};
+static sensor_driver_t dfr_driver = {
+	.name = "dfrobot", .enabled = &calibrate_with_dfrobot_sensor, .gpio_en = -1,
+	.read = dfr_read, .clear = dfr_clear
+};
+static sensor_driver_t color_driver = {
+	.name = "color", .enabled = &g_state_sensors_color_enabled, .gpio_en = -1,
+	.init = color_init, .process = flicker_process, .exit_process = flicker_exit_process,
+	.read = color_read, .clear = color_clear, .close = color_close
+};
+
+/**
+ * Define the calibration curves and register the sensors in the order they are read.
+ */
+void sensor_drivers_register(char *curves_file_name) {
+	define_cal_curves(curves_file_name);
+
+	sensor_register(&methane_driver);
+	sensor_register(&air_q_driver);
+	sensor_register(&shtc3_driver);
+	sensor_register(&lps22_driver);
+	sensor_register(&imu_driver);
+	sensor_register(&co2_driver);
+	sensor_register(&o2_driver);
+	sensor_register(&dfr_driver);
+	sensor_register(&color_driver);
+}
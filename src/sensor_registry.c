@@ -0,0 +1,273 @@
+/*
+ * sensor_registry.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The sensor registry.  Each sensor registers a driver and the registry does the work
+ * that is the same for every sensor:
+ * - Power the sensor on or off to match its enabled flag in the state file
+ * - Open the device, start its background thread, and open it again after a failure,
+ *   or after its thread has stopped, with the backoff from the device supervisor
+ * - Only read a sensor if the sensors it depends on were read this cycle
+ * - Switch a sensor with a warm up time on just before its read and off after it, and
+ *   report it as off if it is read before it has warmed up
+ * - Zero the telemetry and set the valid flag when the sensor is off or in error
+ *
+ * The sensors are read in the order they were registered.
+ *
+ */
+
+#define _GNU_SOURCE /* For pthread_tryjoin_np */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <lgpio.h>
+
+#include "sensor_driver.h"
+#include "sensor_stats.h"
+#include "trace.h"
+#include "time_service.h"
+#include "device_supervisor.h"
+#include "debug.h"
+
+static sensor_driver_t *drivers[SENSOR_MAX_DRIVERS];
+static int num_of_drivers = 0;
+static int registry_gpio_hd = -1;
+
+void sensor_registry_init(int gpio_hd) {
+	registry_gpio_hd = gpio_hd;
+	num_of_drivers = 0;
+}
+
+int sensor_register(sensor_driver_t *driver) {
+	if (num_of_drivers >= SENSOR_MAX_DRIVERS) {
+		error_print("Too many sensor drivers, can not add: %s\n", driver->name);
+		return EXIT_FAILURE;
+	}
+	driver->open = false;
+	driver->status = SENSOR_OFF;
+	driver->pthread = 0;
+	driver->powered = false;
+	driver->read_since_power_on = false;
+	driver->stats_id = stats_sensor_add(driver->name);
+	driver->device_id = supervisor_add(driver->name);
+	if (driver->stats_id >= 0)
+		trace_name(TRACE_SENSOR + driver->stats_id, driver->name);
+	drivers[num_of_drivers++] = driver;
+	return EXIT_SUCCESS;
+}
+
+static void sensor_power(sensor_driver_t *d, int on, uint32_t now) {
+	if (on && !d->powered) {
+		d->power_on_time = now;
+		d->read_since_power_on = false;
+	}
+	d->powered = on;
+	if (d->gpio_en >= 0 && registry_gpio_hd >= 0)
+		lgGpioWrite(registry_gpio_hd, d->gpio_en, on);
+}
+
+/* True for a driver that has its power switched on only around its reads */
+static int sensor_scheduled(sensor_driver_t *d) {
+	return d->warm_up != NULL && *d->warm_up > 0 && d->gpio_en >= 0;
+}
+
+static int sensor_warming(sensor_driver_t *d, uint32_t now) {
+	return sensor_scheduled(d) && now - d->power_on_time < *d->warm_up;
+}
+
+static int sensor_open(sensor_driver_t *d, uint32_t now) {
+	if (d->open) return EXIT_SUCCESS;
+	/* A device that failed is left alone until its backoff is over */
+	if (!supervisor_may_try(d->device_id, now))
+		return EXIT_FAILURE;
+	if (d->init != NULL && d->init() != EXIT_SUCCESS) {
+		if (g_verbose)
+			printf("Could not open %s sensor\n", d->name);
+		supervisor_failed(d->device_id, now);
+		return EXIT_FAILURE;
+	}
+	d->open = true;
+	if (d->process != NULL) {
+		/* The thread starts with the signals blocked, so they go to the main thread, which
+		 * is the one that joins this thread when it shuts down */
+		sigset_t all, old;
+		sigfillset(&all);
+		pthread_sigmask(SIG_BLOCK, &all, &old);
+		if (pthread_create(&d->pthread, NULL, d->process, NULL) != EXIT_SUCCESS) {
+			error_print("Could not start the %s thread.\n", d->name);
+			d->pthread = 0;
+		}
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+	}
+	return EXIT_SUCCESS;
+}
+
+static void sensor_close(sensor_driver_t *d) {
+	if (!d->open) return;
+	if (d->pthread) {
+		if (d->exit_process != NULL)
+			d->exit_process();
+		pthread_join(d->pthread, NULL);
+		d->pthread = 0;
+	}
+	if (d->close != NULL)
+		d->close();
+	d->open = false;
+}
+
+/* True if a driver that provides cap was read without error this cycle */
+static int sensor_provided(int cap) {
+	for (int i=0; i < num_of_drivers; i++)
+		if ((drivers[i]->caps & cap) && drivers[i]->status == SENSOR_ON)
+			return true;
+	return false;
+}
+
+static int sensor_needs_met(sensor_driver_t *d) {
+	if ((d->caps & SENSOR_CAP_NEEDS_TEMP) && !sensor_provided(SENSOR_CAP_PROVIDES_TEMP))
+		return false;
+	if ((d->caps & SENSOR_CAP_NEEDS_PRESSURE) && !sensor_provided(SENSOR_CAP_PROVIDES_PRESSURE))
+		return false;
+	return true;
+}
+
+static void sensor_error(sensor_driver_t *d) {
+	d->status = SENSOR_ERR;
+	d->clear(SENSOR_ERR);
+}
+
+/**
+ * Open the enabled sensors.  Called once at startup.  A sensor that does not open is
+ * tried again when it is read.
+ */
+void sensors_open() {
+	for (int i=0; i < num_of_drivers; i++) {
+		sensor_driver_t *d = drivers[i];
+		if (*d->enabled) {
+			sensor_power(d, 1, time(0));
+			sensor_open(d, time(0));
+		}
+	}
+}
+
+/**
+ * Read each sensor into the telemetry.  Returns the monotonic time in the middle of the
+ * reads that were taken, as each is stamped when it is read, or 0 if none were.
+ */
+uint64_t sensors_read(uint32_t now) {
+	uint64_t read_ns_sum = 0;
+	int reads = 0;
+	trace_begin(TRACE_SENSORS_READ);
+	for (int i=0; i < num_of_drivers; i++) {
+		sensor_driver_t *d = drivers[i];
+		if (!*d->enabled) {
+			/* Close a disabled sensor and stop its thread.  One with a power pin also loses its
+			 * settings when it is powered off, so it must be opened again anyway */
+			sensor_close(d);
+			sensor_power(d, 0, now);
+			supervisor_reset(d->device_id);
+			d->status = SENSOR_OFF;
+			d->clear(SENSOR_OFF);
+			continue;
+		}
+		/* A background thread should only stop when it is asked.  Close the driver so it is
+		 * opened again, with a new thread, once the backoff is over */
+		if (d->pthread && pthread_tryjoin_np(d->pthread, NULL) == 0) {
+			error_print("The %s thread stopped, it will be started again\n", d->name);
+			d->pthread = 0;
+			supervisor_failed(d->device_id, now);
+			supervisor_restarted(d->device_id);
+			sensor_close(d);
+		}
+		sensor_power(d, 1, now);
+		/* A device waiting out its backoff has already had its failure counted */
+		if (!d->open && !supervisor_may_try(d->device_id, now)) {
+			sensor_error(d);
+			continue;
+		}
+		if (sensor_open(d, now) != EXIT_SUCCESS || !sensor_needs_met(d)) {
+			stats_sensor_error(d->stats_id);
+			sensor_error(d);
+			continue;
+		}
+		/* A reading before the warm up would not be valid, so do not take it.  The valid
+		 * fields only have SENSOR_OFF, SENSOR_ON and SENSOR_ERR, so it is reported as off */
+		if (sensor_warming(d, now)) {
+			d->status = SENSOR_OFF;
+			d->clear(SENSOR_OFF);
+			continue;
+		}
+		uint64_t start = stats_now_us();
+		trace_begin(TRACE_SENSOR + d->stats_id);
+		uint64_t read_start = time_mono_ns();
+		int rc = d->read(now);
+		d->read_ns = read_start + (time_mono_ns() - read_start) / 2;
+		trace_end(TRACE_SENSOR + d->stats_id);
+		stats_sensor_read(d->stats_id, start, rc == SENSOR_READ_OK);
+		d->read_since_power_on = true;
+		if (rc == SENSOR_READ_OK) {
+			d->status = SENSOR_ON;
+			read_ns_sum += d->read_ns;
+			reads++;
+			supervisor_ok(d->device_id);
+		} else {
+			sensor_error(d);
+			if (rc == SENSOR_READ_FAILED) {
+				supervisor_failed(d->device_id, now);
+				sensor_close(d);
+			}
+		}
+	}
+	trace_end(TRACE_SENSORS_READ);
+	return reads > 0 ? read_ns_sum / reads : 0;
+}
+
+/**
+ * Switch the scheduled sensors on their warm up time before their next read and off once
+ * they have been read.  next_cycle is when sensors_read will next be called.  If the gap
+ * to the next read is shorter than the warm up then the power is left on.  Call this often,
+ * at least once a second.
+ */
+void sensors_power_schedule(uint32_t now, uint32_t next_cycle) {
+	for (int i=0; i < num_of_drivers; i++) {
+		sensor_driver_t *d = drivers[i];
+		if (!*d->enabled || !sensor_scheduled(d))
+			continue;
+		int needed = now + *d->warm_up >= next_cycle;
+		if (!d->powered && needed) {
+			debug_print("Warming up %s for the read at %d\n", d->name, next_cycle);
+			sensor_power(d, 1, now);
+			/* Open now so a sensor that measures by itself has started before the read */
+			sensor_open(d, now);
+		} else if (d->powered && !needed && d->read_since_power_on) {
+			/* Powering off loses the sensor settings, so it is closed first */
+			sensor_close(d);
+			sensor_power(d, 0, now);
+		}
+	}
+}
+
+/**
+ * Stop the background threads and close the sensors, in the reverse order they were opened
+ */
+void sensors_close() {
+	for (int i=num_of_drivers-1; i >= 0; i--)
+		sensor_close(drivers[i]);
+}
@@ -0,0 +1,306 @@
+/*
+ * sensor_stats.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Instrumentation for the sensors.  Each counter is a plain integer that is only ever added
+ * to with the relaxed __atomic builtins, like the trace rings, so the sensor threads, the
+ * CosmicWatch listeners and the main loop can all update them without a lock.  A saved file
+ * is a snapshot, it is not consistent across counters, which is fine for spotting trends.
+ *
+ * The stats file has one line for each sensor, I2C device and counter:
+ *   sensor <name> reads <n> errors <n> mean_us <n> max_us <n> hist <bucket counts>
+ *   i2c <device> ops <n> fail <n>
+ *   <counter> <n>
+ *   file_io mean_us <n> max_us <n> hist <bucket counts>
+ *   flicker frequency_hz <n> depth_pct <n>
+ *   pressure trend_hpa_per_min <n> leak <0 or 1>
+ * The histogram buckets are under 16us, 64us, 256us .. 1.2 hours.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common_config.h"
+#include "sensor_stats.h"
+#include "str_util.h"
+#include "time_service.h"
+#include "device_supervisor.h"
+
+typedef struct stats_sensor {
+	const char *name;
+	unsigned int reads;
+	unsigned int errors;
+	stats_hist_t latency;
+} stats_sensor_t;
+
+static const char *i2c_names[STATS_I2C_NUM] = {
+	"ads1015", "shtc3", "lps22hb", "pasco2", "dfrobot", "qmi8658", "ak09918", "tcs34087"
+};
+
+static const char *counter_names[STATS_NUM] = {
+	"shtc3_crc_errors", "dfr_checksum_errors",
+	"cw1_bytes", "cw1_lines", "cw1_bad_lines", "cw1_dropped",
+	"cw2_bytes", "cw2_lines", "cw2_bad_lines", "cw2_dropped",
+	"mic_bytes", "mic_errors", "file_writes", "file_errors", "time_steps"
+};
+
+static stats_sensor_t sensors[STATS_MAX_SENSORS];
+static int num_sensors;
+static unsigned int i2c_ops[STATS_I2C_NUM];
+static unsigned int i2c_failures[STATS_I2C_NUM];
+static unsigned int counters[STATS_NUM];
+static stats_hist_t file_latency;
+static unsigned int flicker_frequency;  /* In 0.1 Hz */
+static unsigned int flicker_depth;      /* In 0.1% */
+static int pressure_trend;              /* In 0.01 hPa/min */
+static int pressure_leak;
+static unsigned int cw_last_event[2];  /* Each is only used by its own listener thread */
+static uint64_t stats_start_us;
+
+void stats_init() {
+	stats_start_us = stats_now_us();
+}
+
+uint64_t stats_now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void hist_add(stats_hist_t *hist, uint64_t us) {
+	int bucket = 0;
+	uint64_t limit = 16;
+	while (us >= limit && bucket < STATS_LAT_BUCKETS - 1) {
+		limit *= 4;
+		bucket++;
+	}
+	__atomic_fetch_add(&hist->count[bucket], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->total_us, us, __ATOMIC_RELAXED);
+	unsigned int max = __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED);
+	unsigned int val = us > UINT32_MAX ? UINT32_MAX : (unsigned int)us;
+	while (val > max && !__atomic_compare_exchange_n(&hist->max_us, &max, val, true,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static unsigned int hist_total(stats_hist_t *hist) {
+	unsigned int n = 0;
+	for (int i=0; i < STATS_LAT_BUCKETS; i++)
+		n += __atomic_load_n(&hist->count[i], __ATOMIC_RELAXED);
+	return n;
+}
+
+static void hist_print(FILE *file, stats_hist_t *hist) {
+	unsigned int n = hist_total(hist);
+	unsigned long long total = __atomic_load_n(&hist->total_us, __ATOMIC_RELAXED);
+	fprintf(file, " mean_us %llu max_us %u hist", n ? total / n : 0,
+			__atomic_load_n(&hist->max_us, __ATOMIC_RELAXED));
+	for (int i=0; i < STATS_LAT_BUCKETS; i++)
+		fprintf(file, " %u", __atomic_load_n(&hist->count[i], __ATOMIC_RELAXED));
+	fprintf(file, "\n");
+}
+
+static unsigned int counter(int counter) {
+	return __atomic_load_n(&counters[counter], __ATOMIC_RELAXED);
+}
+
+static uint16_t sat16(unsigned long long n) {
+	return n > UINT16_MAX ? UINT16_MAX : (uint16_t)n;
+}
+
+/**
+ * Add a sensor and return the id to record its reads with, or -1 if the table is full
+ */
+int stats_sensor_add(const char *name) {
+	int id = __atomic_fetch_add(&num_sensors, 1, __ATOMIC_SEQ_CST);
+	if (id >= STATS_MAX_SENSORS) {
+		__atomic_fetch_sub(&num_sensors, 1, __ATOMIC_SEQ_CST);
+		return -1;
+	}
+	sensors[id].name = name;
+	return id;
+}
+
+/**
+ * Record a read of a sensor that started at start_us
+ */
+void stats_sensor_read(int id, uint64_t start_us, int ok) {
+	if (id < 0 || id >= STATS_MAX_SENSORS) return;
+	__atomic_fetch_add(&sensors[id].reads, 1, __ATOMIC_RELAXED);
+	if (!ok)
+		__atomic_fetch_add(&sensors[id].errors, 1, __ATOMIC_RELAXED);
+	hist_add(&sensors[id].latency, stats_now_us() - start_us);
+}
+
+/* An error without a read, when the sensor could not be opened */
+void stats_sensor_error(int id) {
+	if (id < 0 || id >= STATS_MAX_SENSORS) return;
+	__atomic_fetch_add(&sensors[id].errors, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Count an I2C transaction.  rc is the lgpio return value, which is negative on a failure.
+ * It is returned so the call can be wrapped.
+ */
+int stats_i2c(int dev, int rc) {
+	__atomic_fetch_add(&i2c_ops[dev], 1, __ATOMIC_RELAXED);
+	if (rc < 0)
+		__atomic_fetch_add(&i2c_failures[dev], 1, __ATOMIC_RELAXED);
+	return rc;
+}
+
+void stats_count(int counter, unsigned int n) {
+	__atomic_fetch_add(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+/**
+ * Record a file write that started at start_us
+ */
+void stats_file_io(uint64_t start_us, int ok) {
+	stats_count(ok ? STATS_FILE_WRITES : STATS_FILE_ERRORS, 1);
+	hist_add(&file_latency, stats_now_us() - start_us);
+}
+
+/**
+ * Count the events lost by a CosmicWatch from the gap in its event numbers.  The number
+ * is 16 bits, so it wraps.  If it goes backwards the detector was restarted.
+ */
+void stats_cw_event(int cw, unsigned int event_num) {
+	uint16_t gap = (uint16_t)(event_num - cw_last_event[cw]);
+	if (cw_last_event[cw] != 0 && gap > 1 && gap < 0x8000)
+		stats_count(cw == 0 ? STATS_CW1_DROPPED : STATS_CW2_DROPPED, gap - 1);
+	cw_last_event[cw] = event_num;
+}
+
+/**
+ * Keep the flicker from the last read of the color sensor.  The frequency is in Hz and the
+ * depth is from 0 to 1.
+ */
+void stats_flicker(float frequency, float depth) {
+	__atomic_store_n(&flicker_frequency, (unsigned int)(frequency * 10 + 0.5f), __ATOMIC_RELAXED);
+	__atomic_store_n(&flicker_depth, (unsigned int)(depth * 1000 + 0.5f), __ATOMIC_RELAXED);
+}
+
+/**
+ * Keep the pressure trend and leak flag from the last read of the pressure sensor
+ */
+void stats_pressure(double hpa_per_min, int leak) {
+	int trend = hpa_per_min * 100 + (hpa_per_min < 0 ? -0.5 : 0.5);
+	__atomic_store_n(&pressure_trend, trend, __ATOMIC_RELAXED);
+	__atomic_store_n(&pressure_leak, leak, __ATOMIC_RELAXED);
+}
+
+static void fill_block(sensor_stats_block_t *block, uint32_t now) {
+	memset(block, 0, sizeof(sensor_stats_block_t));
+	block->timestamp = now;
+	block->uptime = (stats_now_us() - stats_start_us) / 1000000;
+	int n = __atomic_load_n(&num_sensors, __ATOMIC_SEQ_CST);
+	block->num_sensors = n;
+	for (int i=0; i < n; i++) {
+		block->sensor[i].reads = sat16(__atomic_load_n(&sensors[i].reads, __ATOMIC_RELAXED));
+		block->sensor[i].errors = sat16(__atomic_load_n(&sensors[i].errors, __ATOMIC_RELAXED));
+		block->sensor[i].max_latency_ms = sat16(__atomic_load_n(&sensors[i].latency.max_us, __ATOMIC_RELAXED) / 1000);
+	}
+	for (int i=0; i < STATS_I2C_NUM; i++)
+		block->i2c_failures[i] = sat16(__atomic_load_n(&i2c_failures[i], __ATOMIC_RELAXED));
+	block->crc_errors = sat16((unsigned long long)counter(STATS_SHTC3_CRC_ERRORS) + counter(STATS_DFR_CHECKSUM_ERRORS));
+	block->cw_dropped = sat16((unsigned long long)counter(STATS_CW1_DROPPED) + counter(STATS_CW1_BAD_LINES)
+			+ counter(STATS_CW2_DROPPED) + counter(STATS_CW2_BAD_LINES));
+	block->mic_errors = sat16(counter(STATS_MIC_ERRORS));
+	block->file_errors = sat16(counter(STATS_FILE_ERRORS));
+	block->file_max_latency_ms = sat16(__atomic_load_n(&file_latency.max_us, __ATOMIC_RELAXED) / 1000);
+	for (int i=0; i < QUOTA_NUM_STREAMS; i++) {
+		block->quota_state[i] = quota_state(i);
+		block->quota_used_kb[i] = sat16(quota_used_kb(i));
+	}
+	block->devices_failed = supervisor_num_failed();
+	block->flicker_frequency = sat16(__atomic_load_n(&flicker_frequency, __ATOMIC_RELAXED));
+	block->flicker_depth = sat16(__atomic_load_n(&flicker_depth, __ATOMIC_RELAXED));
+	int trend = __atomic_load_n(&pressure_trend, __ATOMIC_RELAXED);
+	block->pressure_trend = trend > INT16_MAX ? INT16_MAX : trend < INT16_MIN ? INT16_MIN : trend;
+	block->pressure_leak = __atomic_load_n(&pressure_leak, __ATOMIC_RELAXED);
+}
+
+/* Write to a tmp file then rename it, so a reader never sees a partial file */
+static int save_file(char *folder, char *name, uint32_t now, int binary) {
+	char path[MAX_FILE_PATH_LEN];
+	char tmp_path[MAX_FILE_PATH_LEN];
+	strlcpy(path, folder, sizeof(path));
+	strlcat(path, "/", sizeof(path));
+	strlcat(path, name, sizeof(path));
+	strlcpy(tmp_path, path, sizeof(tmp_path));
+	strlcat(tmp_path, ".tmp", sizeof(tmp_path));
+
+	FILE *file = fopen(tmp_path, binary ? "wb" : "w");
+	if (file == NULL)
+		return EXIT_FAILURE;
+	int rc = EXIT_SUCCESS;
+	if (binary) {
+		sensor_stats_block_t block;
+		fill_block(&block, now);
+		if (fwrite(&block, sizeof(block), 1, file) != 1)
+			rc = EXIT_FAILURE;
+	} else {
+		fprintf(file, "time %u uptime %llu\n", now, (unsigned long long)(stats_now_us() - stats_start_us) / 1000000);
+		int n = __atomic_load_n(&num_sensors, __ATOMIC_SEQ_CST);
+		for (int i=0; i < n; i++) {
+			fprintf(file, "sensor %s reads %u errors %u", sensors[i].name,
+					__atomic_load_n(&sensors[i].reads, __ATOMIC_RELAXED),
+					__atomic_load_n(&sensors[i].errors, __ATOMIC_RELAXED));
+			hist_print(file, &sensors[i].latency);
+		}
+		for (int i=0; i < STATS_I2C_NUM; i++)
+			fprintf(file, "i2c %s ops %u fail %u\n", i2c_names[i],
+					__atomic_load_n(&i2c_ops[i], __ATOMIC_RELAXED),
+					__atomic_load_n(&i2c_failures[i], __ATOMIC_RELAXED));
+		for (int i=0; i < STATS_NUM; i++)
+			fprintf(file, "%s %u\n", counter_names[i], counter(i));
+		fprintf(file, "file_io");
+		hist_print(file, &file_latency);
+		for (int i=0; i < QUOTA_NUM_STREAMS; i++)
+			fprintf(file, "quota %s used_kb %u state %d\n", quota_name(i), quota_used_kb(i), quota_state(i));
+		for (int i=0; i < TIME_NUM_CW; i++)
+			fprintf(file, "cw%d_clock fitted %d drift_ppm %.1f\n", i + 1, time_cw_fitted(i), time_cw_drift_ppm(i));
+		fprintf(file, "flicker frequency_hz %.1f depth_pct %.1f\n",
+				__atomic_load_n(&flicker_frequency, __ATOMIC_RELAXED) / 10.0,
+				__atomic_load_n(&flicker_depth, __ATOMIC_RELAXED) / 10.0);
+		fprintf(file, "pressure trend_hpa_per_min %.2f leak %d\n",
+				__atomic_load_n(&pressure_trend, __ATOMIC_RELAXED) / 100.0,
+				__atomic_load_n(&pressure_leak, __ATOMIC_RELAXED));
+		supervisor_print(file);
+		if (ferror(file))
+			rc = EXIT_FAILURE;
+	}
+	if (fclose(file) != 0)
+		rc = EXIT_FAILURE;
+	if (rc == EXIT_SUCCESS && rename(tmp_path, path) != 0)
+		rc = EXIT_FAILURE;
+	return rc;
+}
+
+/**
+ * Save the stats file and the summary block into folder
+ */
+int stats_save(char *folder, uint32_t now) {
+	if (save_file(folder, STATS_FILE_NAME, now, false) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	return save_file(folder, STATS_BLOCK_FILE_NAME, now, true);
+}
@@ -0,0 +1,164 @@
+/*
+ * sensors_cal_file.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * Calibration file.  This is a key=value file in the same format as the config
+ * file.  The values are held in a small table in memory.  The drivers read the values
+ * when they start and write them back when they learn something new.  The file is
+ * saved from the main loop, and only when something has changed.
+ *
+ * Several threads can update calibration values, so the table is protected by a mutex.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sensors_config.h"
+#include "sensors_cal_file.h"
+#include "iors_log.h"
+#include "str_util.h"
+#include "debug.h"
+
+#define MAX_CAL_LINE_LENGTH 128
+
+typedef struct cal_entry {
+	char key[CAL_FILE_MAX_KEY_LEN];
+	double value;
+} cal_entry_t;
+
+static cal_entry_t cal_table[CAL_FILE_MAX_KEYS];
+static int cal_table_len = 0;
+static int cal_dirty = false;
+static unsigned int cal_changes = 0;   /* Counts cal_file_set() calls, so a save knows if it missed one */
+static pthread_mutex_t cal_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Must be called with the mutex held */
+static int cal_find(const char *key) {
+	for (int i=0; i < cal_table_len; i++)
+		if (strcmp(cal_table[i].key, key) == 0)
+			return i;
+	return -1;
+}
+
+/* Must be called with the mutex held */
+static void cal_put(const char *key, double value) {
+	int i = cal_find(key);
+	if (i < 0) {
+		if (cal_table_len >= CAL_FILE_MAX_KEYS) {
+			error_print("Calibration table full, can not store: %s\n", key);
+			return;
+		}
+		i = cal_table_len++;
+		strlcpy(cal_table[i].key, key, sizeof(cal_table[i].key));
+	}
+	cal_table[i].value = value;
+}
+
+/**
+ * Load the calibration values from the file.  A missing file is not an error, it just
+ * means nothing has been calibrated yet and the drivers use their defaults.
+ */
+int cal_file_load(char *filename) {
+	char *key;
+	char *value;
+	char *search = "=";
+	debug_print("Loading calibration from: %s:\n", filename);
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) {
+		debug_print(" No calibration file, using defaults\n");
+		return EXIT_FAILURE;
+	}
+	char line[MAX_CAL_LINE_LENGTH];
+	pthread_mutex_lock(&cal_mutex);
+	while (fgets(line, sizeof line, file) != NULL) {
+		if (line[0] == '#') continue;
+		key = strtok(line, search);
+		value = strtok(NULL, search);
+		if (value != NULL) { /* Ignore line with no key value pair */
+			value[strcspn(value,"\n")] = 0;
+			cal_put(key, atof(value));
+			debug_print(" %s = %s\n", key, value);
+		}
+	}
+	cal_dirty = false;
+	pthread_mutex_unlock(&cal_mutex);
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Save the calibration values.  This is written to a tmp file and renamed so that a reset
+ * while we are writing does not lose the previous calibration.
+ */
+int cal_file_save(char *filename) {
+	char tmp_filename[MAX_FILE_PATH_LEN];
+	log_make_tmp_filename(filename, tmp_filename);
+	FILE *file = fopen(tmp_filename, "w");
+	if (file == NULL) {
+		debug_print("ERROR: Could not write calibration file: %s\n", tmp_filename);
+		return EXIT_FAILURE;
+	}
+	pthread_mutex_lock(&cal_mutex);
+	fprintf(file, "# sensors calibration, written by the sensors program\n");
+	for (int i=0; i < cal_table_len; i++)
+		fprintf(file, "%s=%.9g\n", cal_table[i].key, cal_table[i].value);
+	unsigned int saved_changes = cal_changes;
+	pthread_mutex_unlock(&cal_mutex);
+	if (fclose(file) != 0) {
+		debug_print("ERROR: Could not close calibration file: %s\n", tmp_filename);
+		return EXIT_FAILURE;
+	}
+	if (rename(tmp_filename, filename) != EXIT_SUCCESS) {
+		debug_print("ERROR: Could not rename calibration file to: %s\n", filename);
+		return EXIT_FAILURE;
+	}
+	/* Only clean once it is saved, and only if nothing was set while it was written */
+	pthread_mutex_lock(&cal_mutex);
+	if (cal_changes == saved_changes)
+		cal_dirty = false;
+	pthread_mutex_unlock(&cal_mutex);
+	return EXIT_SUCCESS;
+}
+
+int cal_file_is_dirty() {
+	pthread_mutex_lock(&cal_mutex);
+	int dirty = cal_dirty;
+	pthread_mutex_unlock(&cal_mutex);
+	return dirty;
+}
+
+double cal_file_get(const char *key, double default_value) {
+	double value = default_value;
+	pthread_mutex_lock(&cal_mutex);
+	int i = cal_find(key);
+	if (i >= 0)
+		value = cal_table[i].value;
+	pthread_mutex_unlock(&cal_mutex);
+	return value;
+}
+
+void cal_file_set(const char *key, double value) {
+	pthread_mutex_lock(&cal_mutex);
+	cal_put(key, value);
+	cal_dirty = true;
+	cal_changes++;
+	pthread_mutex_unlock(&cal_mutex);
+}
@@ -39,14 +39,63 @@
 #define CONFIG_CW1_SERIAL_DEVICE "cw1_serial_device"
 #define CONFIG_CW2_SERIAL_DEVICE "cw2_serial_device"
 #define CONFIG_PERIOD_TO_SAMPLE_TELEM_IN_SECONDS "period_to_sample_telem_in_seconds"
+#define CONFIG_CO2_MEASUREMENT_RATE_IN_SECONDS "co2_measurement_rate_in_seconds"
+#define CONFIG_PRESSURE_ODR "pressure_odr_hz"
+#define CONFIG_STATS_PERIOD_IN_SECONDS "stats_period_in_seconds"
+#define CONFIG_MQ6_WARM_UP_IN_SECONDS "mq6_warm_up_in_seconds"
+#define CONFIG_MQ135_WARM_UP_IN_SECONDS "mq135_warm_up_in_seconds"
+#define CONFIG_CO2_WARM_UP_IN_SECONDS "co2_warm_up_in_seconds"
+#define CONFIG_ARCHIVE_FULL_RECORDS "archive_full_records"
+#define CONFIG_ARCHIVE_MINUTE_RECORDS "archive_minute_records"
+#define CONFIG_ARCHIVE_HOUR_RECORDS "archive_hour_records"
+#define CONFIG_CAPTURE_PRE_SECONDS "capture_pre_seconds"
+#define CONFIG_CAPTURE_POST_SECONDS "capture_post_seconds"
+#define CONFIG_CAPTURE_TRIGGER "capture_trigger"
+#define CONFIG_LOG_INDEX_INTERVAL_IN_SECONDS "log_index_interval_in_seconds"
+#define CONFIG_QUOTA_TOTAL_KB "quota_total_kb"
+#define CONFIG_QUOTA_CW_RAW_KB "quota_cw_raw_kb"
+#define CONFIG_QUOTA_CW_COINCIDENT_KB "quota_cw_coincident_kb"
+#define CONFIG_QUOTA_WOD_KB "quota_wod_kb"
+#define CONFIG_QUOTA_CW_RAW_POLICY "quota_cw_raw_policy"
+#define CONFIG_QUOTA_CW_COINCIDENT_POLICY "quota_cw_coincident_policy"
+#define CONFIG_QUOTA_WOD_POLICY "quota_wod_policy"
+#define CONFIG_QUOTA_DECIMATE "quota_decimate"
+#define CONFIG_SUPERVISOR_BACKOFF_MIN_IN_SECONDS "supervisor_backoff_min_in_seconds"
+#define CONFIG_SUPERVISOR_BACKOFF_MAX_IN_SECONDS "supervisor_backoff_max_in_seconds"
 
 /* These global variables are in the sensors_config.h file */
 char g_mic_serial_dev[MAX_FILE_PATH_LEN] = "/dev/serial0"; // device name for the serial port for ultrasonic mic
 char g_cw1_serial_dev[MAX_FILE_PATH_LEN] = "/dev/serial1"; // device name for the serial port for cosmic watch
 char g_cw2_serial_dev[MAX_FILE_PATH_LEN] = "/dev/serial2"; // device name for the serial port for cosmic watch
+int g_co2_measurement_rate = 10; // seconds between CO2 measurements in continuous mode
+int g_pressure_odr = 10; // pressure samples per second, 1, 10, 25, 50 or 75
+int g_stats_period = 300; // seconds between saves of the stats file, 0 to not save it
+int g_mq6_warm_up = 60; // seconds the MQ-6 heater is on before a reading is valid
+int g_mq135_warm_up = 60; // seconds the MQ-135 heater is on before a reading is valid
+int g_co2_warm_up = 20; // seconds the CO2 sensor is on before a reading is valid
+int g_archive_full_records = 3600; // samples kept in the full rate archive, 0 for none
+int g_archive_minute_records = 10080; // minute aggregates kept in the archive, 0 for none
+int g_archive_hour_records = 2160; // hour aggregates kept in the archive, 0 for none
+int g_capture_pre_seconds = 30; // seconds kept before an event capture trigger
+int g_capture_post_seconds = 30; // seconds captured after an event capture trigger
+int g_log_index_interval = 60; // seconds between the entries in the WOD and CW log indexes, 0 for no index
+int g_quota_total_kb = 40000; // KB all of the streams can have queued, 0 for no limit
+int g_quota_cw_raw_kb = 24000; // KB the CW raw log can have queued, 0 for no limit
+int g_quota_cw_coincident_kb = 8000; // KB the CW coincident log can have queued, 0 for no limit
+int g_quota_wod_kb = 4000; // KB the WOD can have queued, 0 for no limit
+int g_quota_decimate = 10; // write one record in this many when decimating
+int g_supervisor_backoff_min = 10; // seconds before a failed device is first tried again
+int g_supervisor_backoff_max = 1800; // the longest wait between tries, the wait doubles up to this
 
 #include <sensors_config.h>
 
+/* Sized by the defines in sensors_config.h */
+char g_capture_triggers[CAPTURE_MAX_TRIGGERS][CAPTURE_TRIGGER_LEN]; // predicates that start an event capture
+int g_num_capture_triggers = 0;
+char g_quota_cw_raw_policy[MAX_QUOTA_POLICY_LEN] = "decimate"; // drop_oldest, decimate or pause
+char g_quota_cw_coincident_policy[MAX_QUOTA_POLICY_LEN] = "drop_oldest"; // drop_oldest, decimate or pause
+char g_quota_wod_policy[MAX_QUOTA_POLICY_LEN] = "drop_oldest"; // drop_oldest, decimate or pause
+
 void load_config(char *filename) {
 	char *key;
 	char *value;
@@ -54,6 +103,7 @@ void load_config(char *filename) {
 	debug_print("Loading config from: %s:\n", filename);
 	FILE *file = fopen ( filename, "r" );
 	if ( file != NULL ) {
+		g_num_capture_triggers = 0; /* The triggers are lines that add up, so start again when we reload */
 		char line [ MAX_CONFIG_LINE_LENGTH ]; /* or other suitable maximum line size */
 		while ( fgets ( line, sizeof line, file ) != NULL ) /* read a line */ {
 
@@ -75,6 +125,56 @@ void load_config(char *filename) {
 					strlcpy(g_cw1_serial_dev, value,sizeof(g_cw1_serial_dev));
 				} else if (strcmp(key, CONFIG_CW2_SERIAL_DEVICE) == 0) {
 					strlcpy(g_cw2_serial_dev, value,sizeof(g_cw2_serial_dev));
+				} else if (strcmp(key, CONFIG_CO2_MEASUREMENT_RATE_IN_SECONDS) == 0) {
+					g_co2_measurement_rate = atoi(value);
+				} else if (strcmp(key, CONFIG_PRESSURE_ODR) == 0) {
+					g_pressure_odr = atoi(value);
+				} else if (strcmp(key, CONFIG_STATS_PERIOD_IN_SECONDS) == 0) {
+					g_stats_period = atoi(value);
+				} else if (strcmp(key, CONFIG_MQ6_WARM_UP_IN_SECONDS) == 0) {
+					g_mq6_warm_up = atoi(value);
+				} else if (strcmp(key, CONFIG_MQ135_WARM_UP_IN_SECONDS) == 0) {
+					g_mq135_warm_up = atoi(value);
+				} else if (strcmp(key, CONFIG_CO2_WARM_UP_IN_SECONDS) == 0) {
+					g_co2_warm_up = atoi(value);
+				} else if (strcmp(key, CONFIG_ARCHIVE_FULL_RECORDS) == 0) {
+					g_archive_full_records = atoi(value);
+				} else if (strcmp(key, CONFIG_ARCHIVE_MINUTE_RECORDS) == 0) {
+					g_archive_minute_records = atoi(value);
+				} else if (strcmp(key, CONFIG_ARCHIVE_HOUR_RECORDS) == 0) {
+					g_archive_hour_records = atoi(value);
+				} else if (strcmp(key, CONFIG_CAPTURE_PRE_SECONDS) == 0) {
+					g_capture_pre_seconds = atoi(value);
+				} else if (strcmp(key, CONFIG_CAPTURE_POST_SECONDS) == 0) {
+					g_capture_post_seconds = atoi(value);
+				} else if (strcmp(key, CONFIG_LOG_INDEX_INTERVAL_IN_SECONDS) == 0) {
+					g_log_index_interval = atoi(value);
+				} else if (strcmp(key, CONFIG_QUOTA_TOTAL_KB) == 0) {
+					g_quota_total_kb = atoi(value);
+				} else if (strcmp(key, CONFIG_QUOTA_CW_RAW_KB) == 0) {
+					g_quota_cw_raw_kb = atoi(value);
+				} else if (strcmp(key, CONFIG_QUOTA_CW_COINCIDENT_KB) == 0) {
+					g_quota_cw_coincident_kb = atoi(value);
+				} else if (strcmp(key, CONFIG_QUOTA_WOD_KB) == 0) {
+					g_quota_wod_kb = atoi(value);
+				} else if (strcmp(key, CONFIG_QUOTA_CW_RAW_POLICY) == 0) {
+					strlcpy(g_quota_cw_raw_policy, value, sizeof(g_quota_cw_raw_policy));
+				} else if (strcmp(key, CONFIG_QUOTA_CW_COINCIDENT_POLICY) == 0) {
+					strlcpy(g_quota_cw_coincident_policy, value, sizeof(g_quota_cw_coincident_policy));
+				} else if (strcmp(key, CONFIG_QUOTA_WOD_POLICY) == 0) {
+					strlcpy(g_quota_wod_policy, value, sizeof(g_quota_wod_policy));
+				} else if (strcmp(key, CONFIG_QUOTA_DECIMATE) == 0) {
+					g_quota_decimate = atoi(value);
+				} else if (strcmp(key, CONFIG_SUPERVISOR_BACKOFF_MIN_IN_SECONDS) == 0) {
+					g_supervisor_backoff_min = atoi(value);
+				} else if (strcmp(key, CONFIG_SUPERVISOR_BACKOFF_MAX_IN_SECONDS) == 0) {
+					g_supervisor_backoff_max = atoi(value);
+				} else if (strcmp(key, CONFIG_CAPTURE_TRIGGER) == 0) {
+					if (g_num_capture_triggers < CAPTURE_MAX_TRIGGERS) {
+						strlcpy(g_capture_triggers[g_num_capture_triggers++], value, CAPTURE_TRIGGER_LEN);
+					} else {
+						error_print("Only %d capture triggers are allowed\n", CAPTURE_MAX_TRIGGERS);
+					}
 				} else {
 					error_print("Unknown key in %s file: %s\n",filename, key);
 				}
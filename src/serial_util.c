@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
 #include <errno.h>
 
@@ -88,10 +89,13 @@ int read_serial_line(char *serialdev, speed_t speed, char *buffer, size_t buffer
         bytes_read = read(fd, &ch, 1);
         if (bytes_read < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-//                // Timeout occurred
-//            	close_serial(fd);
-//                return -2;
-            	usleep(10);
+            	/* Sleep until there is data, or the port has an error which the read then returns.
+            	 * Return on a timeout so the caller can check if it has been asked to exit */
+            	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+            	if (poll(&pfd, 1, SERIAL_POLL_MS) == 0) {
+            		close_serial(fd);
+            		return -2;
+            	}
             	continue;
             } else {
                 // Read error
@@ -0,0 +1,298 @@
+/*
+ * storage_quota.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The bytes of each stream are counted in memory.  quota_roll() adds each file as it is
+ * rolled, so nothing is listed or stat'ed while a stream is under its budget.  The queue
+ * folders are only listed when the counts need to be reconciled with what is really there:
+ * once at start up, when a roll takes a stream over its budget, and each minute while a
+ * stream stays over it, which is how a stream finds that its files have been ingested.
+ *
+ * The queue folder of a stream is the folder of its log.  log_add_to_directory() in
+ * iors_common rolls the log and its index to names that start with the name of the log,
+ * so those are the files that count against the stream.  The tmp files are still being
+ * written and are left out.  The log and its index are rolled one after the other, so the
+ * oldest rolled log and the oldest rolled index are a pair.  drop_oldest removes them
+ * together, and it never removes the newest log, which was just rolled.
+ *
+ * The writers only read their state, with an atomic load, so a record that is allowed
+ * costs no lock.  The folders are listed without the mutex, so a slow card does not hold
+ * up a writer asking for its state.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "common_config.h"
+#include "sensors_config.h"
+#include "sensors_state_file.h"
+#include "iors_command.h"
+#include "iors_log.h"
+#include "log_index.h"
+#include "storage_quota.h"
+#include "str_util.h"
+#include "debug.h"
+
+typedef struct quota_stream {
+	const char *name;
+	char *log_name;                /* The file name of the log, from the state file */
+	int *budget_kb;                /* From the config file, 0 for no budget */
+	char *policy_name;
+	int policy;
+	char path[MAX_FILE_PATH_LEN];  /* The log in its queue folder */
+	uint64_t used;                 /* Bytes queued */
+	int state;
+	unsigned int records;          /* Counts the records when decimating */
+} quota_stream_t;
+
+/* What a listing of the queue folder of a stream found */
+typedef struct quota_listing {
+	uint64_t bytes;
+	int logs;                      /* Rolled logs */
+	char oldest_log[MAX_FILE_PATH_LEN];
+	char oldest_index[MAX_FILE_PATH_LEN];
+} quota_listing_t;
+
+static quota_stream_t streams[QUOTA_NUM_STREAMS] = {
+	{ .name = "cw_raw", .log_name = g_sensors_cw_raw_log_path, .budget_kb = &g_quota_cw_raw_kb, .policy_name = g_quota_cw_raw_policy },
+	{ .name = "cw_coincident", .log_name = g_sensors_cw_coincident_log_path, .budget_kb = &g_quota_cw_coincident_kb, .policy_name = g_quota_cw_coincident_policy },
+	{ .name = "wod", .log_name = g_sensors_wod_telem_path, .budget_kb = &g_quota_wod_kb, .policy_name = g_quota_wod_policy }
+};
+static const char *policy_names[] = { "drop_oldest", "decimate", "pause" };
+static const int policy_states[] = { QUOTA_DROPPING, QUOTA_DECIMATING, QUOTA_PAUSED };
+static const int stream_folders[] = { FolderTxt, FolderTxt, FolderSenWod };
+
+static pthread_mutex_t quota_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int enabled = false;
+
+static void quota_reconcile(int stream);
+
+/**
+ * Read the policies and count what is already queued.  The quota is off if there is no
+ * budget and no total.
+ */
+void quota_init(char *data_folder_path) {
+	int any_budget = g_quota_total_kb > 0;
+	pthread_mutex_lock(&quota_mutex);
+	for (int s=0; s < QUOTA_NUM_STREAMS; s++) {
+		quota_stream_t *stream = &streams[s];
+		strlcpy(stream->path, data_folder_path, MAX_FILE_PATH_LEN);
+		strlcat(stream->path, "/", MAX_FILE_PATH_LEN);
+		strlcat(stream->path, get_folder_str(stream_folders[s]), MAX_FILE_PATH_LEN);
+		strlcat(stream->path, "/", MAX_FILE_PATH_LEN);
+		strlcat(stream->path, stream->log_name, MAX_FILE_PATH_LEN);
+		stream->used = 0;
+		stream->state = QUOTA_OK;
+		stream->policy = QUOTA_DROP_OLDEST;
+		int p;
+		for (p=0; p < (int)(sizeof(policy_names) / sizeof(policy_names[0])); p++)
+			if (strcmp(stream->policy_name, policy_names[p]) == 0)
+				break;
+		if (p < (int)(sizeof(policy_names) / sizeof(policy_names[0])))
+			stream->policy = p;
+		else
+			error_print("Unknown quota policy for %s: %s, using drop_oldest\n", stream->name, stream->policy_name);
+		if (*stream->budget_kb > 0)
+			any_budget = true;
+	}
+	enabled = any_budget;
+	pthread_mutex_unlock(&quota_mutex);
+	if (enabled)
+		for (int s=0; s < QUOTA_NUM_STREAMS; s++)
+			quota_reconcile(s);
+}
+
+/* List the files rolled from the log at path that are still in its folder */
+static void quota_list(const char *path, quota_listing_t *listing) {
+	memset(listing, 0, sizeof(quota_listing_t));
+	const char *slash = strrchr(path, '/');
+	if (slash == NULL) return;
+	const char *log_name = slash + 1;
+	size_t name_len = strlen(log_name);
+	size_t ext_len = strlen(LOG_INDEX_EXT);
+	char folder[MAX_FILE_PATH_LEN];
+	strlcpy(folder, path, sizeof(folder));
+	folder[slash - path] = 0;
+
+	/* The tmp files of the log and its index are still being written */
+	char tmp_log[MAX_FILE_PATH_LEN], index_path[MAX_FILE_PATH_LEN], tmp_index[MAX_FILE_PATH_LEN];
+	log_make_tmp_filename((char *)path, tmp_log);
+	strlcpy(index_path, path, sizeof(index_path));
+	strlcat(index_path, LOG_INDEX_EXT, sizeof(index_path));
+	log_make_tmp_filename(index_path, tmp_index);
+
+	DIR *dir = opendir(folder);
+	if (dir == NULL) return;
+	time_t oldest_log_time = 0, oldest_index_time = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, log_name, name_len) != 0) continue;
+		char file_path[MAX_FILE_PATH_LEN];
+		strlcpy(file_path, folder, sizeof(file_path));
+		strlcat(file_path, "/", sizeof(file_path));
+		strlcat(file_path, entry->d_name, sizeof(file_path));
+		if (strcmp(file_path, tmp_log) == 0 || strcmp(file_path, tmp_index) == 0) continue;
+		struct stat st;
+		if (stat(file_path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+		listing->bytes += st.st_size;
+		if (strncmp(entry->d_name + name_len, LOG_INDEX_EXT, ext_len) == 0) {
+			if (listing->oldest_index[0] == 0 || st.st_mtime < oldest_index_time) {
+				strlcpy(listing->oldest_index, file_path, MAX_FILE_PATH_LEN);
+				oldest_index_time = st.st_mtime;
+			}
+		} else {
+			listing->logs++;
+			if (listing->oldest_log[0] == 0 || st.st_mtime < oldest_log_time) {
+				strlcpy(listing->oldest_log, file_path, MAX_FILE_PATH_LEN);
+				oldest_log_time = st.st_mtime;
+			}
+		}
+	}
+	closedir(dir);
+}
+
+static int quota_over_budget(quota_stream_t *stream) {
+	return *stream->budget_kb > 0 && stream->used >= (uint64_t)*stream->budget_kb * 1024;
+}
+
+/* Must be called with the mutex held */
+static void quota_set_states() {
+	uint64_t total = 0;
+	for (int s=0; s < QUOTA_NUM_STREAMS; s++)
+		total += streams[s].used;
+	int over_total = g_quota_total_kb > 0 && total >= (uint64_t)g_quota_total_kb * 1024;
+	for (int s=0; s < QUOTA_NUM_STREAMS; s++) {
+		quota_stream_t *stream = &streams[s];
+		int state = QUOTA_OK;
+		if (over_total && s < QUOTA_NUM_STREAMS - 1)
+			state = QUOTA_PAUSED;
+		else if (quota_over_budget(stream))
+			state = policy_states[stream->policy];
+		if (state != stream->state)
+			debug_print("Quota for %s is now %d with %llu KB queued\n", stream->name, state,
+					(unsigned long long)stream->used / 1024);
+		__atomic_store_n(&stream->state, state, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * Count the queued files of a stream again from its folder.  If it is still over its
+ * budget and its policy is drop_oldest, remove its oldest rolled logs and their indexes
+ * until it is under, keeping the newest log.
+ */
+static void quota_reconcile(int s) {
+	quota_stream_t *stream = &streams[s];
+	quota_listing_t listing;
+	quota_list(stream->path, &listing);
+	pthread_mutex_lock(&quota_mutex);
+	stream->used = listing.bytes;
+	int drop = stream->policy == QUOTA_DROP_OLDEST;
+	while (drop && quota_over_budget(stream) && listing.logs > 1) {
+		pthread_mutex_unlock(&quota_mutex);
+		debug_print("Quota for %s is over its budget, removing %s\n", stream->name, listing.oldest_log);
+		if (unlink(listing.oldest_log) != 0) {
+			error_print("Could not remove the queued file: %s\n", listing.oldest_log);
+			drop = false;
+		}
+		if (listing.oldest_index[0] != 0)
+			unlink(listing.oldest_index);
+		quota_list(stream->path, &listing);
+		pthread_mutex_lock(&quota_mutex);
+		stream->used = listing.bytes;
+	}
+	quota_set_states();
+	pthread_mutex_unlock(&quota_mutex);
+}
+
+/**
+ * Returns true if the next record of the stream should be written.  This is called for
+ * every record, so it takes no lock.
+ */
+int quota_write_allowed(int stream) {
+	quota_stream_t *q = &streams[stream];
+	switch (__atomic_load_n(&q->state, __ATOMIC_RELAXED)) {
+	case QUOTA_PAUSED:
+		return false;
+	case QUOTA_DECIMATING:
+		return __atomic_fetch_add(&q->records, 1, __ATOMIC_RELAXED) % (g_quota_decimate > 1 ? g_quota_decimate : 1) == 0;
+	default:
+		return true;
+	}
+}
+
+/**
+ * Count a log file of bytes that has been rolled into the directory, with its index.  If
+ * that takes the stream or the total over budget the folders are counted again, and a
+ * drop_oldest stream makes room by removing its oldest files.
+ */
+void quota_roll(int stream, long bytes) {
+	if (!enabled) return;
+	pthread_mutex_lock(&quota_mutex);
+	streams[stream].used += bytes;
+	uint64_t total = 0;
+	for (int s=0; s < QUOTA_NUM_STREAMS; s++)
+		total += streams[s].used;
+	int over_total = g_quota_total_kb > 0 && total >= (uint64_t)g_quota_total_kb * 1024;
+	int over = quota_over_budget(&streams[stream]);
+	pthread_mutex_unlock(&quota_mutex);
+	if (over_total) {
+		for (int s=0; s < QUOTA_NUM_STREAMS; s++)
+			quota_reconcile(s);
+	} else if (over) {
+		quota_reconcile(stream);
+	}
+}
+
+/**
+ * While any stream is over budget, count the folders again, so a stream starts again once
+ * its files have been ingested.  All of them are counted, as the total depends on each.
+ * Called each minute from the main loop.
+ */
+void quota_update() {
+	if (!enabled) return;
+	int any_over = false;
+	for (int s=0; s < QUOTA_NUM_STREAMS; s++)
+		if (quota_state(s) != QUOTA_OK)
+			any_over = true;
+	if (any_over)
+		for (int s=0; s < QUOTA_NUM_STREAMS; s++)
+			quota_reconcile(s);
+}
+
+int quota_state(int stream) {
+	return __atomic_load_n(&streams[stream].state, __ATOMIC_RELAXED);
+}
+
+const char *quota_name(int stream) {
+	return streams[stream].name;
+}
+
+unsigned int quota_used_kb(int stream) {
+	pthread_mutex_lock(&quota_mutex);
+	unsigned int kb = streams[stream].used / 1024;
+	pthread_mutex_unlock(&quota_mutex);
+	return kb;
+}
@@ -0,0 +1,141 @@
+/*
+ * telem_agg.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The WOD aggregator.  Adding a sample is a few adds and compares for each field, so it
+ * is done every sample period.  The mean and standard deviation are only worked out when
+ * the record is encoded.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common_config.h"
+#include "sensors_config.h"
+#include "telem_agg.h"
+
+/* A change to the schema changes this record too */
+_Static_assert(TELEM_AGG_RECORD_LEN == 276, "The aggregated record changed length, update TELEM_SCHEMA_VERSION and this check");
+
+void telem_agg_reset(telem_agg_t *agg) {
+	memset(agg, 0, sizeof(telem_agg_t));
+}
+
+static void stat_add(telem_stat_t *stat, int64_t value) {
+	if (stat->n == 0 || value < stat->min) stat->min = value;
+	if (stat->n == 0 || value > stat->max) stat->max = value;
+	stat->n++;
+	stat->sum += value;
+	stat->sum_sq += (double)value * value;
+}
+
+#define MASK(bits) ((((uint64_t)1) << (bits)) - 1)
+
+#define ADD_TIME(name) \
+	if (agg->samples == 0) agg->name##_first = telem->name; \
+	agg->name##_last = telem->name;
+#define ADD_FLAG(name) \
+	agg->name = telem->name; \
+	if (telem->name == SENSOR_ON) agg->name##_on++;
+#define ADD_INT(name, bits, valid) \
+	if (telem->valid == SENSOR_ON) stat_add(&agg->name, telem->name);
+#define ADD_UINT(name, bits, valid) \
+	if (telem->valid == SENSOR_ON) stat_add(&agg->name, (int64_t)((uint64_t)telem->name & MASK(bits)));
+#define ADD_ARRAY(name, n, bits, valid) \
+	if (telem->valid == SENSOR_ON) \
+		for (int i=0; i < (n); i++) agg->name##_sum[i] += (uint64_t)telem->name[i] & MASK(bits);
+
+/**
+ * Add a sample of the telemetry to the aggregate
+ */
+void telem_agg_add(telem_agg_t *agg, const sensor_telemetry_t *telem) {
+	TELEM_SCHEMA(ADD_TIME, ADD_FLAG, ADD_INT, ADD_UINT, ADD_ARRAY)
+	agg->samples++;
+}
+
+static uint64_t limit_count(uint32_t n) {
+	return n > MASK(TELEM_AGG_COUNT_BITS) ? MASK(TELEM_AGG_COUNT_BITS) : n;
+}
+
+static uint64_t stat_sd(const telem_stat_t *stat, int bits) {
+	if (stat->n == 0) return 0;
+	double mean = (double)stat->sum / stat->n;
+	double var = stat->sum_sq / stat->n - mean * mean;
+	double sd = var > 0 ? sqrt(var) : 0;
+	return sd > MASK(bits) ? MASK(bits) : (uint64_t)llround(sd);
+}
+
+static int64_t stat_mean(const telem_stat_t *stat) {
+	return stat->n == 0 ? 0 : llround((double)stat->sum / stat->n);
+}
+
+#define ENCODE_TIME(name) \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_first, 32, agg->name##_first); \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_last, 32, agg->name##_last); \
+	telem_put_bits(data, TELEM_AGG_BIT_samples, TELEM_AGG_COUNT_BITS, limit_count(agg->samples));
+#define ENCODE_FLAG(name) \
+	telem_put_bits(data, TELEM_AGG_BIT_##name, TELEM_FLAG_BITS, agg->name); \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_on, TELEM_AGG_COUNT_BITS, limit_count(agg->name##_on));
+#define ENCODE_INT(name, bits, valid) \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_min, bits, telem_limit_signed(agg->name.min, bits)); \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_max, bits, telem_limit_signed(agg->name.max, bits)); \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_mean, bits, telem_limit_signed(stat_mean(&agg->name), bits)); \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_sd, bits, stat_sd(&agg->name, bits));
+#define ENCODE_UINT(name, bits, valid) \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_min, bits, agg->name.min); \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_max, bits, agg->name.max); \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_mean, bits, stat_mean(&agg->name)); \
+	telem_put_bits(data, TELEM_AGG_BIT_##name##_sd, bits, stat_sd(&agg->name, bits));
+#define ENCODE_ARRAY(name, n, bits, valid) \
+	for (int i=0; i < (n); i++) \
+		telem_put_bits(data, TELEM_AGG_BIT_##name##_mean + i * (bits), bits, \
+				agg->valid##_on == 0 ? 0 : (agg->name##_sum[i] + agg->valid##_on / 2) / agg->valid##_on);
+
+/**
+ * Pack the aggregate into record, which must have TELEM_AGG_RECORD_LEN bytes.  Returns the length.
+ */
+int telem_agg_encode(const telem_agg_t *agg, uint8_t *record) {
+	memset(record, 0, TELEM_AGG_RECORD_LEN);
+	record[0] = TELEM_AGG_VERSION;
+	uint8_t *data = record + 1;
+	TELEM_SCHEMA(ENCODE_TIME, ENCODE_FLAG, ENCODE_INT, ENCODE_UINT, ENCODE_ARRAY)
+	return TELEM_AGG_RECORD_LEN;
+}
+
+#define FIELD_TIME(name) \
+	{ #name "_first", TELEM_AGG_BIT_##name##_first, 32, false, 1 }, \
+	{ #name "_last", TELEM_AGG_BIT_##name##_last, 32, false, 1 }, \
+	{ "samples", TELEM_AGG_BIT_samples, TELEM_AGG_COUNT_BITS, false, 1 },
+#define FIELD_FLAG(name) \
+	{ #name, TELEM_AGG_BIT_##name, TELEM_FLAG_BITS, false, 1 }, \
+	{ #name "_on", TELEM_AGG_BIT_##name##_on, TELEM_AGG_COUNT_BITS, false, 1 },
+#define FIELD_VALUE(name, bits, is_signed) \
+	{ #name "_min", TELEM_AGG_BIT_##name##_min, bits, is_signed, 1 }, \
+	{ #name "_max", TELEM_AGG_BIT_##name##_max, bits, is_signed, 1 }, \
+	{ #name "_mean", TELEM_AGG_BIT_##name##_mean, bits, is_signed, 1 }, \
+	{ #name "_sd", TELEM_AGG_BIT_##name##_sd, bits, false, 1 },
+#define FIELD_INT(name, bits, valid) FIELD_VALUE(name, bits, true)
+#define FIELD_UINT(name, bits, valid) FIELD_VALUE(name, bits, false)
+#define FIELD_ARRAY(name, n, bits, valid) { #name "_mean", TELEM_AGG_BIT_##name##_mean, bits, false, n },
+
+const telem_field_t telem_agg_fields[] = {
+	TELEM_SCHEMA(FIELD_TIME, FIELD_FLAG, FIELD_INT, FIELD_UINT, FIELD_ARRAY)
+};
+const int telem_agg_num_fields = sizeof(telem_agg_fields) / sizeof(telem_field_t);
@@ -0,0 +1,265 @@
+/*
+ * telem_archive.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The archive files are created at their full size when they are opened, so the SD card
+ * is never found to be full later.  A record is written into its slot and synced to the
+ * card before the count in the header is moved on.  The kernel can write the header page
+ * back at any time, so this is what keeps a count on the card from covering a record that
+ * was never written if the power is lost.  The header itself is synced every
+ * ARCHIVE_SYNC_RECORDS records, so after a power loss the count can be that far behind
+ * and the newest records are lost.  A file with a header that does not match the schema
+ * or the configured capacity is started again.
+ *
+ * The minute and hour aggregates that are in progress are kept in memory.  They are
+ * written when the program exits, but a reset loses them.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "common_config.h"
+#include "sensors_config.h"
+#include "iors_log.h"
+#include "telem_agg.h"
+#include "telem_archive.h"
+#include "str_util.h"
+#include "debug.h"
+
+#define ARCHIVE_SYNC_RECORDS 60
+
+typedef struct archive_tier {
+	const char *name;
+	const char *file_name;
+	int *capacity;                 /* From the config file, 0 turns the tier off */
+	int period;                    /* Seconds in each aggregate, 0 for every sample */
+	int version;
+	int record_len;
+	telem_archive_header_t *header;
+	uint8_t *records;
+	size_t map_len;
+	telem_agg_t agg;
+	uint32_t agg_period;           /* The period the aggregate is for */
+	int unsynced;                  /* Records since the header was synced */
+} archive_tier_t;
+
+static archive_tier_t tiers[ARCHIVE_NUM_TIERS] = {
+	{ .name = "full", .file_name = "sensors_archive_full.bin", .capacity = &g_archive_full_records,
+	  .period = 0, .version = TELEM_SCHEMA_VERSION, .record_len = TELEM_RECORD_LEN },
+	{ .name = "minute", .file_name = "sensors_archive_minute.bin", .capacity = &g_archive_minute_records,
+	  .period = 60, .version = TELEM_AGG_VERSION, .record_len = TELEM_AGG_RECORD_LEN },
+	{ .name = "hour", .file_name = "sensors_archive_hour.bin", .capacity = &g_archive_hour_records,
+	  .period = 3600, .version = TELEM_AGG_VERSION, .record_len = TELEM_AGG_RECORD_LEN }
+};
+
+static int tier_open(archive_tier_t *tier, char *folder) {
+	char path[MAX_FILE_PATH_LEN];
+	strlcpy(path, folder, sizeof(path));
+	strlcat(path, "/", sizeof(path));
+	strlcat(path, tier->file_name, sizeof(path));
+
+	tier->map_len = sizeof(telem_archive_header_t) + (size_t)*tier->capacity * tier->record_len;
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		error_print("Could not open archive file: %s\n", path);
+		return EXIT_FAILURE;
+	}
+	/* Allocate the whole file now, rather than finding the card full when we write */
+	if (ftruncate(fd, tier->map_len) != 0 || posix_fallocate(fd, 0, tier->map_len) != 0) {
+		error_print("Could not allocate %ld bytes for archive file: %s\n", (long)tier->map_len, path);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	void *map = mmap(NULL, tier->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		error_print("Could not map archive file: %s\n", path);
+		return EXIT_FAILURE;
+	}
+	tier->header = (telem_archive_header_t *)map;
+	tier->unsynced = 0;
+	tier->records = (uint8_t *)map + sizeof(telem_archive_header_t);
+
+	telem_archive_header_t *h = tier->header;
+	if (memcmp(h->magic, ARCHIVE_MAGIC, 4) != 0 || h->version != tier->version || h->record_len != tier->record_len
+			|| h->capacity != *tier->capacity || h->tier != tier - tiers) {
+		debug_print("Starting a new %s archive with %d records\n", tier->name, *tier->capacity);
+		memset(h, 0, sizeof(telem_archive_header_t));
+		memcpy(h->magic, ARCHIVE_MAGIC, 4);
+		h->version = tier->version;
+		h->tier = tier - tiers;
+		h->record_len = tier->record_len;
+		h->capacity = *tier->capacity;
+		h->count = 0;
+	} else {
+		debug_print("Opened the %s archive with %d of %d records\n", tier->name,
+				h->count < h->capacity ? h->count : h->capacity, h->capacity);
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Open, or create, the archive files in folder.  A tier that can not be opened is left out.
+ */
+int telem_archive_open(char *folder) {
+	int rc = EXIT_SUCCESS;
+	for (int i=0; i < ARCHIVE_NUM_TIERS; i++) {
+		tiers[i].header = NULL;
+		telem_agg_reset(&tiers[i].agg);
+		if (*tiers[i].capacity <= 0) continue;
+		if (tier_open(&tiers[i], folder) != EXIT_SUCCESS)
+			rc = EXIT_FAILURE;
+	}
+	return rc;
+}
+
+static void tier_write(archive_tier_t *tier, const uint8_t *record) {
+	telem_archive_header_t *h = tier->header;
+	uint8_t *slot = tier->records + (size_t)(h->count % h->capacity) * tier->record_len;
+	memcpy(slot, record, tier->record_len);
+
+	/* msync needs a page aligned address, so sync the pages the record is in */
+	uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)slot & ~(page - 1);
+	if (msync((void *)start, (uintptr_t)slot + tier->record_len - start, MS_SYNC) != 0)
+		error_print("Could not sync the %s archive record\n", tier->name);
+	__atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELEASE);
+
+	if (++tier->unsynced >= ARCHIVE_SYNC_RECORDS) {
+		msync(tier->header, sizeof(telem_archive_header_t), MS_SYNC);
+		tier->unsynced = 0;
+	}
+}
+
+static void tier_flush(archive_tier_t *tier) {
+	if (tier->agg.samples == 0) return;
+	uint8_t record[TELEM_AGG_RECORD_LEN];
+	telem_agg_encode(&tier->agg, record);
+	tier_write(tier, record);
+	telem_agg_reset(&tier->agg);
+}
+
+/**
+ * Add a sample to each tier.  An aggregate is written when a sample is in the next minute
+ * or hour.
+ */
+void telem_archive_add(const sensor_telemetry_t *telem) {
+	for (int i=0; i < ARCHIVE_NUM_TIERS; i++) {
+		archive_tier_t *tier = &tiers[i];
+		if (tier->header == NULL) continue;
+		if (tier->period == 0) {
+			uint8_t record[TELEM_RECORD_LEN];
+			telem_encode(telem, record);
+			tier_write(tier, record);
+		} else {
+			uint32_t period = telem->timestamp / tier->period;
+			if (period != tier->agg_period)
+				tier_flush(tier);
+			tier->agg_period = period;
+			telem_agg_add(&tier->agg, telem);
+		}
+	}
+}
+
+/* The time of a record.  For an aggregate it is the time of its first sample */
+static uint32_t record_time(archive_tier_t *tier, const uint8_t *record) {
+	if (tier->period == 0)
+		return telem_get_bits(record + 1, TELEM_BIT_timestamp, 32);
+	return telem_get_bits(record + 1, TELEM_AGG_BIT_timestamp_first, 32);
+}
+
+/**
+ * Append the records of a tier from the time range to the export file and add it to the
+ * directory.  Returns the number of records, or -1 if the tier is not open.
+ */
+int telem_archive_export(int tier_num, uint32_t from, uint32_t to, char *export_path) {
+	if (tier_num < 0 || tier_num >= ARCHIVE_NUM_TIERS || tiers[tier_num].header == NULL)
+		return -1;
+	archive_tier_t *tier = &tiers[tier_num];
+	telem_archive_header_t *h = tier->header;
+	uint32_t count = __atomic_load_n(&h->count, __ATOMIC_ACQUIRE);
+	uint32_t first = count > h->capacity ? count - h->capacity : 0;
+	int n = 0;
+	for (uint32_t i=first; i < count; i++) {
+		uint8_t *record = tier->records + (size_t)(i % h->capacity) * tier->record_len;
+		uint32_t t = record_time(tier, record);
+		if (t < from || t > to) continue;
+		if (log_append(export_path, record, tier->record_len) < tier->record_len) {
+			error_print("Could not write the archive export: %s\n", export_path);
+			break;
+		}
+		n++;
+	}
+	if (n > 0)
+		log_add_to_directory(export_path);
+	debug_print("Exported %d %s archive records from %u to %u\n", n, tier->name, from, to);
+	return n;
+}
+
+/**
+ * Export the time ranges in the request file in folder, then remove it.  Each line is
+ * the tier name, full, minute or hour, then the from and to times in seconds since the
+ * epoch.  Returns the number of requests.
+ */
+int telem_archive_check_requests(char *folder, char *export_path) {
+	char path[MAX_FILE_PATH_LEN];
+	strlcpy(path, folder, sizeof(path));
+	strlcat(path, "/", sizeof(path));
+	strlcat(path, ARCHIVE_REQUEST_FILE, sizeof(path));
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return 0;
+	char line[128];
+	char name[16];
+	unsigned int from, to;
+	int n = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (line[0] == '#') continue;
+		if (sscanf(line, "%15s %u %u", name, &from, &to) != 3) continue;
+		int t;
+		for (t=0; t < ARCHIVE_NUM_TIERS; t++)
+			if (strcmp(name, tiers[t].name) == 0)
+				break;
+		if (t == ARCHIVE_NUM_TIERS || telem_archive_export(t, from, to, export_path) < 0)
+			error_print("Can not export from the %s archive\n", name);
+		n++;
+	}
+	fclose(file);
+	unlink(path);
+	return n;
+}
+
+/**
+ * Write out the aggregates in progress and unmap the files
+ */
+void telem_archive_close() {
+	for (int i=0; i < ARCHIVE_NUM_TIERS; i++) {
+		archive_tier_t *tier = &tiers[i];
+		if (tier->header == NULL) continue;
+		if (tier->period != 0)
+			tier_flush(tier);
+		msync(tier->header, tier->map_len, MS_SYNC);
+		munmap(tier->header, tier->map_len);
+		tier->header = NULL;
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * telem_schema.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The encoder and decoder for the telemetry record, generated from TELEM_SCHEMA.  The
+ * fields are packed most significant bit first with no padding.  A signed field is
+ * limited to the range of its bits.  An unsigned field keeps its low bits, which is what
+ * we want for the counters that wrap and for raw readings held in a signed type.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common_config.h"
+#include "telem_schema.h"
+
+/* The schema must fit the telemetry struct */
+#define CHECK_FLAG(name)
+#define CHECK_BITS(name, bits, valid) \
+	_Static_assert((bits) <= 8 * sizeof(((sensor_telemetry_t *)0)->name), #name " has more bits in the schema than in sensor_telemetry_t");
+#define CHECK_TIME(name) CHECK_BITS(name, 32, -)
+#define CHECK_ARRAY(name, n, bits, valid) \
+	_Static_assert(sizeof(((sensor_telemetry_t *)0)->name) / sizeof(((sensor_telemetry_t *)0)->name[0]) == (n), #name " has a different length in the schema"); \
+	CHECK_BITS(name[0], bits, valid)
+TELEM_SCHEMA(CHECK_TIME, CHECK_FLAG, CHECK_BITS, CHECK_BITS, CHECK_ARRAY)
+
+/* A change to the schema changes the record, so it must change the version too */
+_Static_assert(TELEM_RECORD_LEN == 92, "The telemetry record changed length, update TELEM_SCHEMA_VERSION and this check");
+_Static_assert(TELEM_BIT_methane_conc == 54 && TELEM_BIT_sound_psd == 470, "The telemetry record layout changed");
+
+void telem_put_bits(uint8_t *data, int bit, int bits, uint64_t value) {
+	for (int i=bits-1; i >= 0; i--, bit++)
+		if ((value >> i) & 1)
+			data[bit / 8] |= 0x80 >> (bit % 8);
+}
+
+/* Takes up to a byte at a time, as the ground converter reads every field of every record */
+uint64_t telem_get_bits(const uint8_t *data, int bit, int bits) {
+	uint64_t value = 0;
+	while (bits > 0) {
+		int left = 8 - bit % 8;        /* Bits left in this byte */
+		int n = bits < left ? bits : left;
+		value = (value << n) | ((data[bit / 8] >> (left - n)) & ((1 << n) - 1));
+		bit += n;
+		bits -= n;
+	}
+	return value;
+}
+
+uint64_t telem_limit_signed(int64_t value, int bits) {
+	int64_t max = ((int64_t)1 << (bits - 1)) - 1;
+	if (value > max) value = max;
+	if (value < -max - 1) value = -max - 1;
+	return (uint64_t)value;
+}
+
+int64_t telem_sign_extend(uint64_t value, int bits) {
+	if (bits < 64 && (value >> (bits - 1)) & 1)
+		value |= ~(uint64_t)0 << bits;
+	return (int64_t)value;
+}
+
+#define ENCODE_TIME(name) telem_put_bits(data, TELEM_BIT_##name, 32, telem->name);
+#define ENCODE_FLAG(name) telem_put_bits(data, TELEM_BIT_##name, TELEM_FLAG_BITS, telem->name);
+#define ENCODE_INT(name, bits, valid) telem_put_bits(data, TELEM_BIT_##name, bits, telem_limit_signed(telem->name, bits));
+#define ENCODE_UINT(name, bits, valid) telem_put_bits(data, TELEM_BIT_##name, bits, (uint64_t)telem->name);
+#define ENCODE_ARRAY(name, n, bits, valid) \
+	for (int i=0; i < (n); i++) telem_put_bits(data, TELEM_BIT_##name + i * (bits), bits, telem->name[i]);
+
+/**
+ * Pack the telemetry into record, which must have TELEM_RECORD_LEN bytes.  Returns the length.
+ */
+int telem_encode(const sensor_telemetry_t *telem, uint8_t *record) {
+	memset(record, 0, TELEM_RECORD_LEN);
+	record[0] = TELEM_SCHEMA_VERSION;
+	uint8_t *data = record + 1;
+	TELEM_SCHEMA(ENCODE_TIME, ENCODE_FLAG, ENCODE_INT, ENCODE_UINT, ENCODE_ARRAY)
+	return TELEM_RECORD_LEN;
+}
+
+#define DECODE_TIME(name) telem->name = telem_get_bits(data, TELEM_BIT_##name, 32);
+#define DECODE_FLAG(name) telem->name = telem_get_bits(data, TELEM_BIT_##name, TELEM_FLAG_BITS);
+#define DECODE_INT(name, bits, valid) telem->name = telem_sign_extend(telem_get_bits(data, TELEM_BIT_##name, bits), bits);
+#define DECODE_UINT(name, bits, valid) telem->name = telem_get_bits(data, TELEM_BIT_##name, bits);
+#define DECODE_ARRAY(name, n, bits, valid) \
+	for (int i=0; i < (n); i++) telem->name[i] = telem_get_bits(data, TELEM_BIT_##name + i * (bits), bits);
+
+/**
+ * Unpack a record into the telemetry.  Fields that are not in the schema are zero.
+ * Returns EXIT_FAILURE if the record is short or from another version of the schema.
+ */
+int telem_decode(const uint8_t *record, int len, sensor_telemetry_t *telem) {
+	if (len < TELEM_RECORD_LEN || record[0] != TELEM_SCHEMA_VERSION)
+		return EXIT_FAILURE;
+	memset(telem, 0, sizeof(sensor_telemetry_t));
+	const uint8_t *data = record + 1;
+	TELEM_SCHEMA(DECODE_TIME, DECODE_FLAG, DECODE_INT, DECODE_UINT, DECODE_ARRAY)
+	return EXIT_SUCCESS;
+}
+
+#define FIELD_TIME(name) { #name, TELEM_BIT_##name, 32, false, 1 },
+#define FIELD_FLAG(name) { #name, TELEM_BIT_##name, TELEM_FLAG_BITS, false, 1 },
+#define FIELD_INT(name, bits, valid) { #name, TELEM_BIT_##name, bits, true, 1 },
+#define FIELD_UINT(name, bits, valid) { #name, TELEM_BIT_##name, bits, false, 1 },
+#define FIELD_ARRAY(name, n, bits, valid) { #name, TELEM_BIT_##name, bits, false, n },
+
+const telem_field_t telem_fields[] = {
+	TELEM_SCHEMA(FIELD_TIME, FIELD_FLAG, FIELD_INT, FIELD_UINT, FIELD_ARRAY)
+};
+const int telem_num_fields = sizeof(telem_fields) / sizeof(telem_field_t);
+
+/**
+ * Return value i of a field from a record, where i is 0 unless the field is an array
+ */
+int64_t telem_field_value(const uint8_t *record, const telem_field_t *field, int i) {
+	uint64_t value = telem_get_bits(record + 1, field->bit + i * field->bits, field->bits);
+	return field->is_signed ? telem_sign_extend(value, field->bits) : (int64_t)value;
+}
@@ -0,0 +1,228 @@
+/*
+ * time_service.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * NTP slews the monotonic clock with the system clock, so the offset between them only
+ * changes when the system clock is stepped.  It is read with atomics as every thread maps
+ * its stamps with it.
+ *
+ * Each CW fit is only added to by its own listener thread, but it is read by the stats, so
+ * it has a mutex.  The fit is worked out again every TIME_CW_REFIT lines rather than for
+ * every line, so a busy detector costs little.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common_config.h"
+#include "time_service.h"
+#include "sensor_stats.h"
+#include "debug.h"
+
+typedef struct time_cw_fit {
+	uint32_t detector_ms[TIME_CW_FIT_POINTS];
+	uint64_t arrival_ns[TIME_CW_FIT_POINTS];
+	int head;                      /* Where the next line goes */
+	int num;
+	int since_fit;                 /* Lines since the last fit */
+	int valid;
+	uint32_t base_ms;              /* The fit is arrival = base_ns + (a + b * (detector - base_ms)) ms */
+	uint64_t base_ns;
+	double a;
+	double b;
+	double x[TIME_CW_FIT_POINTS];  /* Work space for the fit */
+	double y[TIME_CW_FIT_POINTS];
+} time_cw_fit_t;
+
+static int64_t utc_offset_ns;         /* UTC less the monotonic clock */
+static int offset_set = false;
+static time_cw_fit_t fits[TIME_NUM_CW];
+static pthread_mutex_t fit_mutex[TIME_NUM_CW] = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER };
+
+uint64_t time_mono_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void time_service_init() {
+	for (int cw=0; cw < TIME_NUM_CW; cw++) {
+		pthread_mutex_lock(&fit_mutex[cw]);
+		memset(&fits[cw], 0, sizeof(time_cw_fit_t));
+		pthread_mutex_unlock(&fit_mutex[cw]);
+	}
+	offset_set = false;
+	time_service_update();
+}
+
+/**
+ * Read the offset of UTC from the monotonic clock again.  The system clock is read between
+ * two reads of the monotonic clock and matched to their middle.  Call this often, at least
+ * once a second, so a step of the system clock is soon picked up.
+ */
+void time_service_update() {
+	struct timespec ts;
+	uint64_t mono_before = time_mono_ns();
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t mono_after = time_mono_ns();
+	int64_t utc_ns = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	int64_t offset = utc_ns - (int64_t)(mono_before + (mono_after - mono_before) / 2);
+
+	int64_t change = offset - __atomic_load_n(&utc_offset_ns, __ATOMIC_RELAXED);
+	if (offset_set && (change > TIME_STEP_NS || change < -TIME_STEP_NS)) {
+		stats_count(STATS_TIME_STEPS, 1);
+		debug_print("The system clock was stepped by %.3f seconds\n", change / 1e9);
+	}
+	__atomic_store_n(&utc_offset_ns, offset, __ATOMIC_RELAXED);
+	offset_set = true;
+}
+
+uint64_t time_mono_to_utc_ns(uint64_t mono_ns) {
+	return mono_ns + __atomic_load_n(&utc_offset_ns, __ATOMIC_RELAXED);
+}
+
+uint64_t time_utc_ms() {
+	return time_mono_to_utc_ns(time_mono_ns()) / 1000000;
+}
+
+/* Least squares of y on x over the points with use set, from the base of the fit */
+static int cw_line(time_cw_fit_t *fit, const uint8_t *use, double *a, double *b) {
+	double sum_x = 0, sum_y = 0;
+	int n = 0;
+	for (int p=0; p < fit->num; p++) {
+		if (!use[p]) continue;
+		sum_x += fit->x[p];
+		sum_y += fit->y[p];
+		n++;
+	}
+	if (n < 2) return false;
+	double mean_x = sum_x / n;
+	double mean_y = sum_y / n;
+	double sxx = 0, sxy = 0;
+	for (int p=0; p < fit->num; p++) {
+		if (!use[p]) continue;
+		double dx = fit->x[p] - mean_x;
+		sxx += dx * dx;
+		sxy += dx * (fit->y[p] - mean_y);
+	}
+	if (sxx <= 0) return false;
+	*b = sxy / sxx;
+	*a = mean_y - *b * mean_x;
+	return true;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* Fit the arrival times to the detector times.  Must be called with the mutex held */
+static void cw_fit(time_cw_fit_t *fit) {
+	int first = (fit->head - fit->num + TIME_CW_FIT_POINTS) % TIME_CW_FIT_POINTS;
+	int last = (fit->head - 1 + TIME_CW_FIT_POINTS) % TIME_CW_FIT_POINTS;
+	uint32_t span = fit->detector_ms[last] - fit->detector_ms[first];
+	if (fit->num < TIME_CW_MIN_POINTS || span < TIME_CW_MIN_SPAN_MS)
+		return;
+
+	/* In ms from the oldest line, so the sums keep their precision.  The order of the
+	 * points does not matter to the fit */
+	uint32_t base_ms = fit->detector_ms[first];
+	uint64_t base_ns = fit->arrival_ns[first];
+	uint8_t use[TIME_CW_FIT_POINTS];
+	for (int p=0; p < fit->num; p++) {
+		fit->x[p] = fit->detector_ms[p] - base_ms;
+		fit->y[p] = (int64_t)(fit->arrival_ns[p] - base_ns) / 1e6;
+		use[p] = true;
+	}
+	double a, b;
+	if (!cw_line(fit, use, &a, &b))
+		return;
+
+	/* Fit again to the quarter of the lines with the least delay, which lie along the
+	 * bottom of the spread, then move the line down onto the least delay of all */
+	double residual[TIME_CW_FIT_POINTS], sorted[TIME_CW_FIT_POINTS];
+	for (int p=0; p < fit->num; p++)
+		sorted[p] = residual[p] = fit->y[p] - (a + b * fit->x[p]);
+	qsort(sorted, fit->num, sizeof(double), compare_double);
+	double limit = sorted[fit->num / 4];
+	for (int p=0; p < fit->num; p++)
+		use[p] = residual[p] <= limit;
+	if (!cw_line(fit, use, &a, &b))
+		return;
+	double least = 0;
+	for (int p=0; p < fit->num; p++) {
+		double r = fit->y[p] - (a + b * fit->x[p]);
+		if (p == 0 || r < least)
+			least = r;
+	}
+	fit->base_ms = base_ms;
+	fit->base_ns = base_ns;
+	fit->a = a + least;
+	fit->b = b;
+	fit->valid = true;
+}
+
+/**
+ * Add a line from detector cw, with its time from the detector and the monotonic time it
+ * arrived.  Returns the UTC ns of the event, placed with the fit, or the arrival time until
+ * there is a fit.  A detector time that goes backwards means the detector restarted, so
+ * the fit starts again.
+ */
+uint64_t time_cw_place(int cw, uint32_t detector_ms, uint64_t arrival_ns) {
+	time_cw_fit_t *fit = &fits[cw];
+	pthread_mutex_lock(&fit_mutex[cw]);
+	if (fit->num > 0 && detector_ms < fit->detector_ms[(fit->head - 1 + TIME_CW_FIT_POINTS) % TIME_CW_FIT_POINTS]) {
+		debug_print("CW%d restarted, starting its clock fit again\n", cw + 1);
+		memset(fit, 0, sizeof(time_cw_fit_t));
+	}
+	fit->detector_ms[fit->head] = detector_ms;
+	fit->arrival_ns[fit->head] = arrival_ns;
+	fit->head = (fit->head + 1) % TIME_CW_FIT_POINTS;
+	if (fit->num < TIME_CW_FIT_POINTS)
+		fit->num++;
+	if (!fit->valid || ++fit->since_fit >= TIME_CW_REFIT) {
+		fit->since_fit = 0;
+		cw_fit(fit);
+	}
+	uint64_t event_ns = arrival_ns;
+	if (fit->valid)
+		event_ns = fit->base_ns + (int64_t)((fit->a + fit->b * (double)(detector_ms - fit->base_ms)) * 1e6);
+	pthread_mutex_unlock(&fit_mutex[cw]);
+	return time_mono_to_utc_ns(event_ns);
+}
+
+int time_cw_fitted(int cw) {
+	pthread_mutex_lock(&fit_mutex[cw]);
+	int valid = fits[cw].valid;
+	pthread_mutex_unlock(&fit_mutex[cw]);
+	return valid;
+}
+
+/**
+ * The drift of the detector clock in parts per million.  Positive if it runs slow.
+ */
+double time_cw_drift_ppm(int cw) {
+	pthread_mutex_lock(&fit_mutex[cw]);
+	double ppm = fits[cw].valid ? (fits[cw].b - 1) * 1e6 : 0;
+	pthread_mutex_unlock(&fit_mutex[cw]);
+	return ppm;
+}
@@ -0,0 +1,180 @@
+/*
+ * trace.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: g0kla
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ * The trace rings.  A thread claims a ring the first time it records a span and gives it
+ * back when it exits, so the sensor threads that are restarted do not run out of rings.
+ * The ring is only written by its thread.  The dump copies each ring and then drops any
+ * records that were overwritten while it was copying.
+ *
+ * The file is:
+ *   "STRC", uint32 version, uint32 number of names,
+ *     for each name: uint16 span, uint8 length, the characters
+ *   uint32 number of rings,
+ *     for each ring: int32 thread id, uint32 number of records, the trace_rec_t records
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "common_config.h"
+#include "trace.h"
+#include "str_util.h"
+
+__thread trace_ring_t *trace_thread_ring;
+
+static trace_ring_t rings[TRACE_MAX_THREADS];
+static const char *span_names[TRACE_MAX_SPANS] = {
+	[TRACE_CYCLE] = "cycle",
+	[TRACE_SENSORS_READ] = "sensors_read",
+	[TRACE_MIC_READ] = "mic_read",
+	[TRACE_SAVE_RT] = "save_rt_telem",
+	[TRACE_SAVE_WOD] = "save_wod",
+	[TRACE_CW_READ] = "cw_read",
+	[TRACE_CW_PARSE] = "cw_parse",
+	[TRACE_CW_WRITE] = "cw_write",
+	[TRACE_STATS_SAVE] = "stats_save",
+	[TRACE_CAPTURE_WRITE] = "capture_write",
+};
+static pthread_key_t ring_key;
+static volatile sig_atomic_t dump_requested = 0;
+
+/* Called when a thread exits, to give its ring back */
+static void ring_release(void *arg) {
+	trace_ring_t *ring = (trace_ring_t *)arg;
+	__atomic_store_n(&ring->in_use, 0, __ATOMIC_SEQ_CST);
+}
+
+void trace_init() {
+	pthread_key_create(&ring_key, ring_release);
+}
+
+trace_ring_t *trace_ring_claim() {
+	for (int i=0; i < TRACE_MAX_THREADS; i++) {
+		int expected = 0;
+		if (__atomic_compare_exchange_n(&rings[i].in_use, &expected, 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			rings[i].tid = syscall(SYS_gettid);
+			__atomic_store_n(&rings[i].head, 0, __ATOMIC_SEQ_CST);
+			pthread_setspecific(ring_key, &rings[i]);
+			trace_thread_ring = &rings[i];
+			return &rings[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Name a span.  Used for the sensors, which are only known when they are registered
+ */
+void trace_name(int span, const char *name) {
+	if (span >= 0 && span < TRACE_MAX_SPANS)
+		span_names[span] = name;
+}
+
+/* Signal handler.  The dump is done by the main loop, because it is not safe in a handler */
+void trace_request_dump(int sig) {
+	dump_requested = 1;
+}
+
+int trace_dump_requested() {
+	if (!dump_requested) return false;
+	dump_requested = 0;
+	return true;
+}
+
+static int write_ring(FILE *file, trace_ring_t *ring, trace_rec_t *buf) {
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	unsigned int count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+	unsigned int first = head - count;
+	for (unsigned int i=0; i < count; i++)
+		buf[i] = ring->rec[(first + i) & (TRACE_RING_SIZE - 1)];
+	/* The thread kept writing while we copied, so drop the records it overwrote.  The slot
+	 * for record now may be half written, so it counts as overwritten too */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	unsigned int now = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	unsigned int skip = 0;
+	if (now + 1 - first > TRACE_RING_SIZE)
+		skip = now + 1 - first - TRACE_RING_SIZE;
+	if (skip > count) skip = count;
+	int32_t tid = ring->tid;
+	uint32_t n = count - skip;
+	if (fwrite(&tid, sizeof(tid), 1, file) != 1) return EXIT_FAILURE;
+	if (fwrite(&n, sizeof(n), 1, file) != 1) return EXIT_FAILURE;
+	if (n > 0 && fwrite(&buf[skip], sizeof(trace_rec_t), n, file) != n) return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Save the rings to the trace file in folder.  It is written to a tmp file and renamed.
+ */
+int trace_dump(char *folder) {
+	char path[MAX_FILE_PATH_LEN];
+	char tmp_path[MAX_FILE_PATH_LEN];
+	strlcpy(path, folder, sizeof(path));
+	strlcat(path, "/", sizeof(path));
+	strlcat(path, TRACE_FILE_NAME, sizeof(path));
+	strlcpy(tmp_path, path, sizeof(tmp_path));
+	strlcat(tmp_path, ".tmp", sizeof(tmp_path));
+
+	trace_rec_t *buf = malloc(TRACE_RING_SIZE * sizeof(trace_rec_t));
+	if (buf == NULL) return EXIT_FAILURE;
+	FILE *file = fopen(tmp_path, "wb");
+	if (file == NULL) {
+		free(buf);
+		return EXIT_FAILURE;
+	}
+	int rc = EXIT_SUCCESS;
+	uint32_t version = TRACE_VERSION;
+	uint32_t num_names = 0;
+	for (int i=0; i < TRACE_MAX_SPANS; i++)
+		if (span_names[i] != NULL) num_names++;
+	fwrite(TRACE_MAGIC, 4, 1, file);
+	fwrite(&version, sizeof(version), 1, file);
+	fwrite(&num_names, sizeof(num_names), 1, file);
+	for (int i=0; i < TRACE_MAX_SPANS; i++) {
+		if (span_names[i] == NULL) continue;
+		uint16_t span = i;
+		uint8_t len = strnlen(span_names[i], 255);
+		fwrite(&span, sizeof(span), 1, file);
+		fwrite(&len, sizeof(len), 1, file);
+		fwrite(span_names[i], 1, len, file);
+	}
+	/* Pick the rings first, so the count matches even if a ring is reclaimed while we write */
+	int used[TRACE_MAX_THREADS];
+	uint32_t num_rings = 0;
+	for (int i=0; i < TRACE_MAX_THREADS; i++)
+		if (__atomic_load_n(&rings[i].head, __ATOMIC_SEQ_CST) > 0) used[num_rings++] = i;
+	fwrite(&num_rings, sizeof(num_rings), 1, file);
+	for (uint32_t i=0; i < num_rings; i++)
+		if (write_ring(file, &rings[used[i]], buf) != EXIT_SUCCESS)
+			rc = EXIT_FAILURE;
+	if (ferror(file))
+		rc = EXIT_FAILURE;
+	if (fclose(file) != 0)
+		rc = EXIT_FAILURE;
+	free(buf);
+	if (rc == EXIT_SUCCESS && rename(tmp_path, path) != 0)
+		rc = EXIT_FAILURE;
+	return rc;
+}
@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <termios.h>
 
 #include "sensors_state_file.h"
@@ -25,15 +26,20 @@
 #include "ultrasonic_mic.h"
 #include "serial_util.h"
 #include "sensor_telemetry.h"
+#include "sensor_stats.h"
+#include "device_supervisor.h"
 
 /* Forward declarations */
 
 /* Local variables */
 static int mic_listen_thread_called = false;
 static unsigned char response[MIC_RESPONSE_LEN];
+static int mic_device = -1;
 
 void mic_err(int err) {
 	int i;
+	if (err == SENSOR_ERR)
+		stats_count(STATS_MIC_ERRORS, 1);
 	g_sensor_telemetry.microphone_valid = err;
 	for (i=0; i<32; i++) {
 		g_sensor_telemetry.sound_psd[i] = 0;
@@ -50,17 +56,28 @@ void mic_err(int err) {
  * Where nn is the number of bins in the FFT.  Each bin is a byte of data.  It is sent as raw bytes.
  * By default the FFT length 64 and there are 32 bins in the result
  *
+ * A mic that does not answer is not asked again until its backoff from the device
+ * supervisor is over.  Each try can take a few hundred ms.
+ *
  */
 void mic_read_data() {
 	char * cmd = "D";
 	int cmd_len = 1;
 	int i;
 
+	if (mic_device < 0)
+		mic_device = supervisor_add("mic");
 	if (g_state_sensors_cosmic_watch_enabled) {
+		uint32_t now = time(0);
+		if (!supervisor_may_try(mic_device, now)) {
+			mic_err(SENSOR_ERR);
+			return;
+		}
 
 		int rc = serial_send_cmd(g_mic_serial_dev, B38400, cmd, cmd_len, response, MIC_RESPONSE_LEN);
 //		debug_print("%s\n",response);
 		if (rc > 0) {
+			stats_count(STATS_MIC_BYTES, rc);
 			if (response[0] == 'D') { // We have data
 				for (i=0; i<32; i++) {
 					g_sensor_telemetry.sound_psd[i] = response[i+5];
@@ -68,14 +85,18 @@ void mic_read_data() {
 				}
 				g_sensor_telemetry.microphone_valid = SENSOR_ON;
 				debug_print("\n");
+				supervisor_ok(mic_device);
 			} else {
 				mic_err(SENSOR_ERR);
+				supervisor_failed(mic_device, now);
 			}
 		} else {
 			mic_err(SENSOR_ERR);
+			supervisor_failed(mic_device, now);
 		}
 	} else {
 		mic_err(SENSOR_OFF);
+		supervisor_reset(mic_device);
 	}
 }
 
@@ -35,15 +35,18 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include <assert.h>
 #include <arpa/inet.h>
 #include <lgpio.h>
 #include "xensiv_pasco2.h"
+#include "sensor_stats.h"
 
 #define XENSIV_PASCO2_COMM_DELAY_MS             (5U)
 #define XENSIV_PASCO2_COMM_TEST_VAL             (0xA5U)
 
 #define XENSIV_PASCO2_SOFT_RESET_DELAY_MS       (2000U)
+#define XENSIV_PASCO2_SOFT_RESET_POLL_MS        (10U)
 
 #define XENSIV_PASCO2_FCS_MEAS_RATE_S           (10)
 
@@ -56,15 +59,22 @@
 #define XENSIV_PASCO2_UART_ACK                  (0x06U)
 #define XENSIV_PASCO2_UART_NAK                  (0x15U)
 
+/* The device is kept open while it is measuring in continuous mode */
+static int xensiv_pasco2_fd = -1;
+static uint16_t xensiv_pasco2_meas_rate = XENSIV_PASCO2_FCS_MEAS_RATE_S;
+static uint16_t xensiv_pasco2_press_ref = 0; /* Last pressure sent to the sensor, 0 if none */
+static uint16_t xensiv_pasco2_last_ppm = 0;
+static time_t xensiv_pasco2_last_time = 0;
+
 int32_t xensiv_pasco2_cmd(int dev, xensiv_pasco2_cmd_t cmd) {
-    return lgI2cWriteByteData(dev, (uint8_t)XENSIV_PASCO2_REG_SENS_RST, cmd);
+    return stats_i2c(STATS_I2C_PASCO2, lgI2cWriteByteData(dev, (uint8_t)XENSIV_PASCO2_REG_SENS_RST, cmd));
 }
 
 int32_t xensiv_pasco2_start_single_mode(int dev) {
     xensiv_pasco2_measurement_config_t meas_config;
     /* Get measurement Config */
     int32_t res = EXIT_FAILURE;
-    int32_t count = lgI2cReadI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_CFG, (char *)&(meas_config.u), 1U);
+    int32_t count = stats_i2c(STATS_I2C_PASCO2, lgI2cReadI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_CFG, (char *)&(meas_config.u), 1U));
 
     if (count != 1) {
     	return EXIT_FAILURE;
@@ -74,7 +84,7 @@ int32_t xensiv_pasco2_start_single_mode(int dev) {
     		printf("CO2 Sensor not set to op mode idle\n");
     		meas_config.b.op_mode = XENSIV_PASCO2_OP_MODE_IDLE;
     		/* Set measurement congfig */
-    		res = lgI2cWriteI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_CFG, (char *)&(meas_config.u), 1U);
+    		res = stats_i2c(STATS_I2C_PASCO2, lgI2cWriteI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_CFG, (char *)&(meas_config.u), 1U));
     	    if (XENSIV_PASCO2_OK != res) return res;
     	}
     }
@@ -82,44 +92,78 @@ int32_t xensiv_pasco2_start_single_mode(int dev) {
     meas_config.b.op_mode = XENSIV_PASCO2_OP_MODE_SINGLE;
     meas_config.b.boc_cfg = XENSIV_PASCO2_BOC_CFG_AUTOMATIC;
     //printf("CO2 Sensor writing single mode\n");
-    res = lgI2cWriteI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_CFG, (char *)&(meas_config.u), 1U);
+    res = stats_i2c(STATS_I2C_PASCO2, lgI2cWriteI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_CFG, (char *)&(meas_config.u), 1U));
     return res;
 }
 
-int xensiv_pasco2_init() {
-	int xensiv_pasco2_fd = -1;
-	xensiv_pasco2_fd = lgI2cOpen(1, XENSIV_PASCO2_I2C_ADDR, 0);
-	if (xensiv_pasco2_fd < 0)
+/**
+ * Put the sensor in continuous mode.  It must be idle while the rate is changed.
+ */
+int32_t xensiv_pasco2_start_continuous_mode(int dev, uint16_t meas_rate) {
+    xensiv_pasco2_measurement_config_t meas_config;
+    meas_config.u = 0;
+    meas_config.b.op_mode = XENSIV_PASCO2_OP_MODE_IDLE;
+    int32_t res = stats_i2c(STATS_I2C_PASCO2, lgI2cWriteI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_CFG, (char *)&(meas_config.u), 1U));
+    if (XENSIV_PASCO2_OK != res) return res;
+
+    uint16_t rate = (uint16_t)htons(meas_rate);
+    res = stats_i2c(STATS_I2C_PASCO2, lgI2cWriteI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_RATE_H, (char *)&rate, 2U));
+    if (XENSIV_PASCO2_OK != res) return res;
+
+    meas_config.b.op_mode = XENSIV_PASCO2_OP_MODE_CONTINUOUS;
+    meas_config.b.boc_cfg = XENSIV_PASCO2_BOC_CFG_AUTOMATIC;
+    return stats_i2c(STATS_I2C_PASCO2, lgI2cWriteI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_CFG, (char *)&(meas_config.u), 1U));
+}
+
+/**
+ * Open the sensor, reset it and start continuous measurements every meas_rate seconds.
+ * After a soft reset we poll for the sensor to be ready rather than waiting the full
+ * reset delay.  The device stays open until xensiv_pasco2_close().
+ */
+int xensiv_pasco2_init(uint16_t meas_rate) {
+	if (xensiv_pasco2_fd >= 0)
+		xensiv_pasco2_close();
+	if (meas_rate < XENSIV_PASCO2_MEAS_RATE_MIN) meas_rate = XENSIV_PASCO2_MEAS_RATE_MIN;
+	if (meas_rate > XENSIV_PASCO2_MEAS_RATE_MAX) meas_rate = XENSIV_PASCO2_MEAS_RATE_MAX;
+	xensiv_pasco2_meas_rate = meas_rate;
+	xensiv_pasco2_press_ref = 0;
+	xensiv_pasco2_last_time = 0;
+
+	int fd = lgI2cOpen(1, XENSIV_PASCO2_I2C_ADDR, 0);
+	if (fd < 0)
 		return EXIT_FAILURE;
 	/* Check communication */
 	uint8_t data = XENSIV_PASCO2_COMM_TEST_VAL;
 
-	int res = lgI2cWriteI2CBlockData(xensiv_pasco2_fd, (uint8_t)XENSIV_PASCO2_REG_SCRATCH_PAD, (char *)&data, 1U);
+	int res = stats_i2c(STATS_I2C_PASCO2, lgI2cWriteI2CBlockData(fd, (uint8_t)XENSIV_PASCO2_REG_SCRATCH_PAD, (char *)&data, 1U));
 
 	if (XENSIV_PASCO2_OK != res){
-		lgI2cClose(xensiv_pasco2_fd);
+		lgI2cClose(fd);
 		return res;
 	}
-	int count = lgI2cReadI2CBlockData(xensiv_pasco2_fd, (uint8_t)XENSIV_PASCO2_REG_SCRATCH_PAD, (char *)&data, 1U);
+	int count = stats_i2c(STATS_I2C_PASCO2, lgI2cReadI2CBlockData(fd, (uint8_t)XENSIV_PASCO2_REG_SCRATCH_PAD, (char *)&data, 1U));
 
 	if ((count == 1) && (XENSIV_PASCO2_COMM_TEST_VAL == data)) {
 		//printf("CO2 Sensor Scratch Read OK\n");
 		/* Soft reset */
-		res = xensiv_pasco2_cmd(xensiv_pasco2_fd, XENSIV_PASCO2_CMD_SOFT_RESET);
+		res = xensiv_pasco2_cmd(fd, XENSIV_PASCO2_CMD_SOFT_RESET);
 		if (XENSIV_PASCO2_OK != res) {
-			lgI2cClose(xensiv_pasco2_fd);
+			lgI2cClose(fd);
 			return res;
 		}
-		lguSleep(XENSIV_PASCO2_SOFT_RESET_DELAY_MS/1000.0);
-
-		//printf("CO2 Sensor Reset OK\n");
-		/* Read the sensor status and verify if the sensor is ready */
-		count = lgI2cReadI2CBlockData(xensiv_pasco2_fd, (uint8_t)XENSIV_PASCO2_REG_SENS_STS, (char *)&data, 1U);
+		/* Read the sensor status until the sensor is ready */
+		unsigned int waited = 0;
+		do {
+			lguSleep(XENSIV_PASCO2_SOFT_RESET_POLL_MS/1000.0);
+			waited += XENSIV_PASCO2_SOFT_RESET_POLL_MS;
+			count = stats_i2c(STATS_I2C_PASCO2, lgI2cReadI2CBlockData(fd, (uint8_t)XENSIV_PASCO2_REG_SENS_STS, (char *)&data, 1U));
+		} while ((count != 1 || (data & XENSIV_PASCO2_REG_SENS_STS_SEN_RDY_MSK) == 0U)
+				&& waited < XENSIV_PASCO2_SOFT_RESET_DELAY_MS);
 		if (count != 1) {
-			lgI2cClose(xensiv_pasco2_fd);
+			lgI2cClose(fd);
 			return EXIT_FAILURE;
 		}
-		printf("CO2 Sensor Status: %0x\n",data);
+		printf("CO2 Sensor Status: %0x after %dms\n",data, waited);
 		if (data != 0xC0) {
 			if ((data & XENSIV_PASCO2_REG_SENS_STS_ICCER_MSK) != 0U) {
 				printf("CO2 Sensor ICCERR\n");
@@ -147,25 +191,45 @@ int xensiv_pasco2_init() {
 		res = XENSIV_PASCO2_ERR_COMM;
 	}
 
-	lgI2cClose(xensiv_pasco2_fd);
+	if (res == XENSIV_PASCO2_OK)
+		res = xensiv_pasco2_start_continuous_mode(fd, meas_rate);
+	if (res != XENSIV_PASCO2_OK) {
+		lgI2cClose(fd);
+		return res;
+	}
+	xensiv_pasco2_fd = fd;
 	return res;
 }
 
+/**
+ * Put the sensor back in idle and close the device
+ */
+void xensiv_pasco2_close() {
+	if (xensiv_pasco2_fd < 0) return;
+	xensiv_pasco2_measurement_config_t meas_config;
+	meas_config.u = 0;
+	meas_config.b.op_mode = XENSIV_PASCO2_OP_MODE_IDLE;
+	stats_i2c(STATS_I2C_PASCO2, lgI2cWriteI2CBlockData(xensiv_pasco2_fd, (uint8_t)XENSIV_PASCO2_REG_MEAS_CFG, (char *)&(meas_config.u), 1U));
+	lgI2cClose(xensiv_pasco2_fd);
+	xensiv_pasco2_fd = -1;
+}
+
 int32_t xensiv_pasco2_set_pressure_compensation(int dev, uint16_t val) {
 	val = (uint16_t)htons(val);
-	return lgI2cWriteI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_PRESS_REF_H, (char *)&val, 2U);
+	return stats_i2c(STATS_I2C_PASCO2, lgI2cWriteI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_PRESS_REF_H, (char *)&val, 2U));
 }
 
 int32_t xensiv_pasco2_get_result(int dev, uint16_t * val) {
 	xensiv_pasco2_meas_status_t meas_status;
 	/* Get measurement status */
-    int32_t count = lgI2cReadI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_STS, (char *)&(meas_status), 1U);
+    int32_t count = stats_i2c(STATS_I2C_PASCO2, lgI2cReadI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_MEAS_STS, (char *)&(meas_status), 1U));
 
     if (count != 1) {
     	return EXIT_FAILURE;
     } else {
         if (meas_status.b.drdy != 0U) {
-            count = lgI2cReadI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_CO2PPM_H, (char *)val, 2U);
+            count = stats_i2c(STATS_I2C_PASCO2, lgI2cReadI2CBlockData(dev, (uint8_t)XENSIV_PASCO2_REG_CO2PPM_H, (char *)val, 2U));
+            if (count != 2) return EXIT_FAILURE;
             *val = ntohs(*val);
         }
         else {
@@ -177,37 +241,41 @@ int32_t xensiv_pasco2_get_result(int dev, uint16_t * val) {
 }
 
 /**
- * Measure the Co2 concentration.  If we have a pressure reading then pass it in,
- * otherwise pass 0.
+ * Return the latest Co2 concentration.  The sensor measures in continuous mode, so this
+ * only checks MEAS_STS.drdy and reads the result if there is a new one.  It does not
+ * wait.  The last result is returned until it is older than two measurement periods,
+ * then XENSIV_PASCO2_READ_NRDY is returned.
+ *
+ * If we have a pressure reading then pass it in, otherwise pass 0.  The pressure is
+ * only written to the sensor when it changes by XENSIV_PASCO2_PRESS_REF_DELTA hPa.
  * We must have first called the init() routine.
  *
  */
 int xensiv_pasco2_read(uint16_t press_ref, uint16_t * co2_ppm_val) {
-	int xensiv_pasco2_fd = -1;
-	xensiv_pasco2_fd = lgI2cOpen(1, XENSIV_PASCO2_I2C_ADDR, 0);
 	if (xensiv_pasco2_fd < 0)
 		return EXIT_FAILURE;
 	int32_t res = EXIT_FAILURE;
-	//printf("CO2 Sensor Start Single Mode\n");
-	res = xensiv_pasco2_start_single_mode(xensiv_pasco2_fd);
-	if (res != EXIT_SUCCESS) {
-		lgI2cClose(xensiv_pasco2_fd);
-		return res;
-	}
 
-	/* Wait at least 1 second for sensor to measure gas conc */
-	lguSleep(1.2);
-        
-	/* Set the pressure if we have it */
-	if (press_ref >= 750 && press_ref <= 1150) {
+	/* Set the pressure if we have it and it has changed */
+	if (press_ref >= 750 && press_ref <= 1150
+			&& abs((int)press_ref - (int)xensiv_pasco2_press_ref) >= XENSIV_PASCO2_PRESS_REF_DELTA) {
 		res = xensiv_pasco2_set_pressure_compensation(xensiv_pasco2_fd, press_ref);
-		if (XENSIV_PASCO2_OK != res) {
-			lgI2cClose(xensiv_pasco2_fd);
+		if (XENSIV_PASCO2_OK != res)
 			return res;
-		}
+		xensiv_pasco2_press_ref = press_ref;
 	}
-	res = xensiv_pasco2_get_result(xensiv_pasco2_fd, co2_ppm_val);
-	lgI2cClose(xensiv_pasco2_fd);
 
-    return res;
+	uint16_t val;
+	res = xensiv_pasco2_get_result(xensiv_pasco2_fd, &val);
+	time_t now = time(0);
+	if (res == EXIT_SUCCESS) {
+		xensiv_pasco2_last_ppm = val;
+		xensiv_pasco2_last_time = now;
+	} else if (res != XENSIV_PASCO2_READ_NRDY) {
+		return res;
+	}
+	if (xensiv_pasco2_last_time == 0 || now - xensiv_pasco2_last_time > 2 * xensiv_pasco2_meas_rate)
+		return XENSIV_PASCO2_READ_NRDY;
+	*co2_ppm_val = xensiv_pasco2_last_ppm;
+	return EXIT_SUCCESS;
 }